@@ -0,0 +1,478 @@
+/*
+ * --alignment-check: report every layer of a drive (partitions, md member
+ * data offsets, mounted filesystems) which does not line up with the
+ * physical sector size or queue/optimal_io_size of the drive.
+ *
+ * Sector sizes come from the kernel (queue/...), and for ATA drives are
+ * cross-checked against IDENTIFY words 106 and 209, since some USB bridges
+ * hide 4kB physical sectors (and offset-aligned drives) from the kernel.
+ *
+ * With --alignment-penalty, the cost of each misaligned layer is measured,
+ * by timing O_DIRECT random reads on the layer's own block grid against
+ * the same reads moved back onto physical boundaries.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+extern int verbose;  /* libhdparm.c */
+
+#define ALIGN_PENALTY_READS	256	/* per side: on the layer's grid, and on physical boundaries */
+#define ALIGN_MIN_IO_BYTES	4096	/* flash pages are rarely smaller, whatever the drive reports */
+
+struct align_dev {
+	int		dfd;		/* O_DIRECT, for --alignment-penalty, or -1 */
+	char		*buf;
+	__u64		fd_base;	/* byte offset of the opened device within the drive */
+	__u64		fd_bytes;
+	unsigned int	logical, physical, optimal;
+	unsigned int	boundary;	/* byte offset of the first physical sector boundary */
+	unsigned int	io_bytes;	/* size of each timed read */
+	__u64		seed;
+	int		have_header;
+	unsigned int	nlayers, nmisaligned;
+};
+
+#define ALIGN_UNKNOWN	(~0ULL)	/* start of a layer which sysfs does not tell us */
+
+struct align_part {
+	char	name[NAME_MAX + 1];
+	__u64	start, size;	/* bytes */
+};
+
+/*
+ * Bytes by which offset lies beyond the last boundary of unit.
+ */
+static unsigned int misaligned_by (__u64 offset, unsigned int unit, unsigned int boundary)
+{
+	if (!unit)
+		return 0;
+	return (offset + unit - (boundary % unit)) % unit;
+}
+
+static const char *align_status (char *s, __u64 offset, unsigned int unit, unsigned int boundary)
+{
+	unsigned int off = misaligned_by(offset, unit, boundary);
+
+	if (!unit)
+		return "-";
+	if (!off)
+		return "ok";
+	sprintf(s, "+%u", off);
+	return s;
+}
+
+/*
+ * MB/sec of random reads at physical boundaries within [start, start+bytes)
+ * of the drive, and of the same reads moved forward by shift bytes,
+ * interleaved so that both see the same seeks and caching.
+ */
+static int measure_penalty (struct align_dev *ad, __u64 start, __u64 bytes, unsigned int shift,
+				double *aligned_MBps, double *shifted_MBps)
+{
+	double secs[2] = {0, 0};
+	struct hdparm_timer t;
+	__u64 base, nblocks;
+	unsigned int i;
+
+	if (start < ad->fd_base)
+		start = ad->fd_base;
+	if (start + bytes > ad->fd_base + ad->fd_bytes)
+		bytes = (start < ad->fd_base + ad->fd_bytes) ? ad->fd_base + ad->fd_bytes - start : 0;
+	base = start + (ad->io_bytes - misaligned_by(start, ad->io_bytes, ad->boundary)) % ad->io_bytes;
+	if (start + bytes < base + 2 * ad->io_bytes)
+		return ERANGE;
+	nblocks = (start + bytes - base) / ad->io_bytes - 1;	/* room for the last shifted read */
+
+	timer_start(&t);
+	for (i = 0; i < 2 * ALIGN_PENALTY_READS; ++i) {
+		__u64 offset;
+
+		ad->seed ^= ad->seed << 13;
+		ad->seed ^= ad->seed >> 7;
+		ad->seed ^= ad->seed << 17;
+		offset = base + (ad->seed % nblocks) * ad->io_bytes + ((i & 1) ? shift : 0);
+		timer_lap(&t);
+		if (pread(ad->dfd, ad->buf, ad->io_bytes, offset - ad->fd_base) != (ssize_t)ad->io_bytes) {
+			int err = errno ? errno : EIO;
+			perror("pread() failed");
+			return err;
+		}
+		secs[i & 1] += timer_lap(&t);
+	}
+	*aligned_MBps = (double)ALIGN_PENALTY_READS * ad->io_bytes / (1024 * 1024) / secs[0];
+	*shifted_MBps = (double)ALIGN_PENALTY_READS * ad->io_bytes / (1024 * 1024) / secs[1];
+	return 0;
+}
+
+static void print_row (struct align_dev *ad, const char *name, __u64 offset, const char *block,
+			const char *phys_status, const char *opt_status, const char *penalty)
+{
+	char start[24] = "?";
+
+	if (!ad->have_header) {
+		printf("\t%-32s %14s %6s  %-9s %-11s %s\n", "layer", "start byte", "block", "physical", "optimal I/O", "penalty");
+		ad->have_header = 1;
+	}
+	if (offset != ALIGN_UNKNOWN)
+		sprintf(start, "%llu", offset);
+	printf("\t%-32s %14s %6s  %-9s %-11s %s\n", name, start, block, phys_status, opt_status, penalty);
+}
+
+/*
+ * One row of the report: a layer starting at offset bytes into the drive
+ * (bytes long, for the penalty measurement), or a filesystem of blksize blocks.
+ */
+static void print_layer (struct align_dev *ad, const char *name, __u64 offset, __u64 bytes, unsigned int blksize)
+{
+	char phys[16], opt[16], block[16] = "-", penalty[16] = "-";
+	const char *phys_status, *opt_status = "-";
+	int misaligned;
+
+	if (blksize) {
+		sprintf(block, "%u", blksize);
+		phys_status = (blksize % ad->physical) ? "small" : "ok";
+		misaligned  = blksize % ad->physical;
+	} else {
+		unsigned int shift = misaligned_by(offset, ad->io_bytes, ad->boundary);
+		double aligned, shifted;
+
+		phys_status = align_status(phys, offset, ad->physical, ad->boundary);
+		opt_status  = align_status(opt,  offset, ad->optimal,  ad->boundary);
+		misaligned  = misaligned_by(offset, ad->physical, ad->boundary)
+			   || misaligned_by(offset, ad->optimal,  ad->boundary);
+		if (ad->dfd != -1 && misaligned && shift && bytes
+		 && !measure_penalty(ad, offset - shift, bytes, shift, &aligned, &shifted)) {
+			sprintf(penalty, "%.1f%%", (aligned - shifted) * 100.0 / aligned);
+			if (verbose)
+				printf("\t%s: %.2f MB/sec on boundaries, %.2f MB/sec at +%u\n", name, aligned, shifted, shift);
+		}
+	}
+	print_row(ad, name, offset, block, phys_status, opt_status, penalty);
+	++ad->nlayers;
+	if (misaligned)
+		++ad->nmisaligned;
+}
+
+/*
+ * Find the first mount of device "maj:min" in /proc/self/mountinfo.
+ */
+static int find_mount (const char *majmin, char *mnt, char *fstype)
+{
+	char line[PATH_MAX * 2], dev[32], *sep, *s, *d;
+	FILE *fp = fopen("/proc/self/mountinfo", "r");
+	int found = 0;
+
+	if (!fp)
+		return 0;
+	while (!found && fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%*u %*u %31s %*s %4095s", dev, mnt) != 2 || strcmp(dev, majmin))
+			continue;
+		if (!(sep = strstr(line, " - ")) || sscanf(sep + 3, "%31s", fstype) != 1)
+			continue;
+		/* mount points have blanks etc. escaped as \ooo */
+		for (s = d = mnt; *s; ++d) {
+			if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' && s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+				*d = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) | (s[3] - '0');
+				s += 4;
+			} else {
+				*d = *s++;
+			}
+		}
+		*d = '\0';
+		found = 1;
+	}
+	fclose(fp);
+	return found;
+}
+
+static void check_filesystem (struct align_dev *ad, const char *dir, const char *name, __u64 offset)
+{
+	char majmin[32], mnt[PATH_MAX], fstype[32], label[PATH_MAX + 64];
+	struct statvfs sv;
+
+	if (sysfs_get_path_attr(dir, "dev", "%31s", majmin, NULL, 0) || !find_mount(majmin, mnt, fstype))
+		return;
+	if (statvfs(mnt, &sv)) {
+		if (verbose)
+			perror(mnt);
+		return;
+	}
+	snprintf(label, sizeof(label), "%s on %s (%s)", fstype, mnt, name);
+	print_layer(ad, label, offset, 0, sv.f_bsize);
+}
+
+/*
+ * The layers stacked on a partition (or whole drive) at offset bytes:
+ * its filesystem, md arrays using it (whose data starts further in),
+ * and anything else holding it, such as device-mapper.
+ */
+static void check_stack (struct align_dev *ad, const char *dir, const char *name, __u64 offset)
+{
+	char path[PATH_MAX], label[NAME_MAX * 2 + 32];
+	struct dirent *entry;
+	DIR *dp;
+
+	check_filesystem(ad, dir, name, offset);
+	snprintf(path, sizeof(path), "%s/holders", dir);
+	if (!(dp = opendir(path)))
+		return;
+	while ((entry = readdir(dp)) != NULL) {
+		__u64 data_offset, data_kb;
+		char attr[NAME_MAX + 32];
+
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/holders/%s", dir, entry->d_name);
+		snprintf(attr, sizeof(attr), "md/dev-%s/offset", name);
+		if (0 == sysfs_get_path_attr(path, attr, "%llu", &data_offset, NULL, 0)) {
+			snprintf(attr, sizeof(attr), "md/dev-%s/size", name);
+			if (sysfs_get_path_attr(path, attr, "%llu", &data_kb, NULL, 0))
+				data_kb = 0;
+			data_offset = offset + data_offset * 512;
+			snprintf(label, sizeof(label), "%s data on %s", entry->d_name, name);
+			print_layer(ad, label, data_offset, data_kb * 1024, 0);
+		} else {
+			/* eg. device-mapper: where its data starts is not in sysfs */
+			data_offset = ALIGN_UNKNOWN;
+			snprintf(label, sizeof(label), "%s on %s", entry->d_name, name);
+			print_row(ad, label, data_offset, "-", "unknown", "unknown", "-");
+		}
+		check_filesystem(ad, path, entry->d_name, data_offset);
+	}
+	closedir(dp);
+}
+
+static int compare_part_start (const void *a, const void *b)
+{
+	const struct align_part *pa = a, *pb = b;
+
+	return (pa->start > pb->start) - (pa->start < pb->start);
+}
+
+/*
+ * Partitions of the drive at dir, in on-disk order.
+ */
+static int find_partitions (const char *dir, struct align_part **partsp, unsigned int *nparts)
+{
+	struct align_part *parts = NULL;
+	unsigned int n = 0, max = 0, partno;
+	struct dirent *entry;
+	char path[PATH_MAX];
+	DIR *dp;
+
+	*partsp = NULL;
+	*nparts = 0;
+	if (!(dp = opendir(dir))) {
+		int err = errno;
+		perror(dir);
+		return err;
+	}
+	while ((entry = readdir(dp)) != NULL) {
+		struct align_part *p;
+
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if (sysfs_get_path_attr(path, "partition", "%u", &partno, NULL, 0))
+			continue;
+		if (n == max) {
+			struct align_part *new = realloc(parts, (max + 16) * sizeof(*parts));
+			if (!new) {
+				perror("realloc()");
+				free(parts);
+				closedir(dp);
+				return ENOMEM;
+			}
+			parts = new;
+			max += 16;
+		}
+		p = &parts[n];
+		strcpy(p->name, entry->d_name);
+		if (sysfs_get_path_attr(path, "start", "%llu", &p->start, NULL, 0)
+		 || sysfs_get_path_attr(path, "size",  "%llu", &p->size,  NULL, 0))
+			continue;
+		p->start *= 512;	/* sysfs always counts 512-byte units */
+		p->size  *= 512;
+		++n;
+	}
+	closedir(dp);
+	qsort(parts, n, sizeof(*parts), compare_part_start);
+	*partsp = parts;
+	*nparts = n;
+	return 0;
+}
+
+/*
+ * Sector sizes and alignment as the drive itself reports them:
+ * word 209 gives the offset of LBA 0 within the first physical sector.
+ */
+static int identify_geometry (int fd, unsigned int *logical, unsigned int *physical, unsigned int *boundary)
+{
+	struct hdparm_identity ident;
+	__u16 *idw = get_identify_words(fd, 0);
+
+	if (!idw)
+		return EIO;
+	decode_identify(idw, &ident);
+	*logical  = ident.logical_sector_bytes;
+	*physical = ident.physical_sector_bytes;
+	*boundary = 0;
+	if ((idw[106] & 0xc000) == 0x4000 && (idw[209] & 0xc000) == 0x4000)
+		*boundary = (*physical - ((idw[209] & 0x1fff) * *logical) % *physical) % *physical;
+	return 0;
+}
+
+/*
+ * Only ask drives which can answer IDENTIFY: libata disks, and USB bridges
+ * (most of which pass ATA commands through), rather than eg. NVMe or virtio.
+ */
+static int drive_speaks_ata (const char *dir)
+{
+	char vendor[16], path[PATH_MAX], real[PATH_MAX];
+
+	if (0 == sysfs_get_path_attr(dir, "device/vendor", "%15s", vendor, NULL, 0) && 0 == strcmp(vendor, "ATA"))
+		return 1;
+	snprintf(path, sizeof(path), "%s/device", dir);
+	return realpath(path, real) && strstr(real, "/usb");
+}
+
+int do_alignment_check (int fd, const char *devname, int measure)
+{
+	struct align_dev ad;
+	struct align_part *parts = NULL;
+	struct dev_context *ctx = get_dev_context(fd);
+	char disk_dir[PATH_MAX], *name;
+	unsigned int nparts = 0, partno, i, logical, physical, boundary;
+	int have_sysfs = 0, is_partition = 0, err = 0;
+	off_t end;
+
+	memset(&ad, 0, sizeof(ad));
+	ad.dfd  = -1;
+	ad.seed = 0x9e3779b97f4a7c15ULL;
+	end = lseek(fd, 0, SEEK_END);
+	ad.fd_bytes = (end == (off_t)-1) ? 0 : end;
+
+	/* an --emulate image file has no sysfs entry of its own */
+	if (!emu_is_emulated(fd) && 0 == sysfs_get_attr(fd, "dev", "%31s", disk_dir, NULL, 0) && ctx && ctx->sysfs_path) {
+		have_sysfs = 1;
+		strcpy(disk_dir, ctx->sysfs_path);
+		if (0 == sysfs_get_attr(fd, "partition", "%u", &partno, NULL, 0)) {
+			is_partition = 1;
+			if (sysfs_get_attr(fd, "start", "%llu", &ad.fd_base, NULL, 0))
+				ad.fd_base = 0;
+			ad.fd_base *= 512;
+			*strrchr(disk_dir, '/') = '\0';
+		}
+		if (sysfs_get_path_attr(disk_dir, "queue/logical_block_size",  "%u", &ad.logical,  NULL, 0)
+		 || sysfs_get_path_attr(disk_dir, "queue/physical_block_size", "%u", &ad.physical, NULL, 0))
+			have_sysfs = 0;
+		if (sysfs_get_path_attr(disk_dir, "queue/optimal_io_size", "%u", &ad.optimal, NULL, 0))
+			ad.optimal = 0;
+		if (sysfs_get_path_attr(disk_dir, "alignment_offset", "%u", &ad.boundary, NULL, 0))
+			ad.boundary = 0;
+	}
+	if (!have_sysfs || drive_speaks_ata(disk_dir)) {
+		if (identify_geometry(fd, &logical, &physical, &boundary)) {
+			if (!have_sysfs) {
+				fprintf(stderr, " unable to determine the sector sizes\n");
+				return EIO;
+			}
+		} else if (!have_sysfs) {
+			ad.logical  = logical;
+			ad.physical = physical;
+			ad.boundary = boundary;
+		} else if (physical != ad.physical || boundary != ad.boundary) {
+			printf(" drive reports %u-byte physical sectors from byte %u, kernel says %u from byte %u: using the drive's\n",
+				physical, boundary, ad.physical, ad.boundary);
+			ad.physical = physical;
+			ad.boundary = boundary;
+		}
+	}
+	if (!ad.logical || !ad.physical) {
+		fprintf(stderr, " invalid sector sizes (logical %u, physical %u)\n", ad.logical, ad.physical);
+		return EINVAL;
+	}
+	ad.io_bytes = (ad.physical > ALIGN_MIN_IO_BYTES) ? ad.physical : ALIGN_MIN_IO_BYTES;
+	if (ad.io_bytes > TIMING_BUF_BYTES)
+		ad.io_bytes = TIMING_BUF_BYTES;
+
+	printf(" alignment: logical sector %u bytes, physical sector %u bytes from byte %u, optimal I/O ",
+		ad.logical, ad.physical, ad.boundary);
+	if (ad.optimal)
+		printf("%u bytes\n", ad.optimal);
+	else
+		printf("not reported\n");
+
+	if (measure) {
+		/* reads must come from the drive, not the page cache */
+		ad.dfd = emu_is_emulated(fd) ? fd : open(devname, O_RDONLY|O_DIRECT);
+		if (ad.dfd == -1) {
+			err = errno;
+			perror(devname);
+			return err;
+		}
+		ad.buf = prepare_timing_buf(TIMING_BUF_BYTES);
+		if (!ad.buf) {
+			err = ENOMEM;
+			goto quit;
+		}
+	}
+
+	if (have_sysfs) {
+		name = strrchr(ctx->sysfs_path, '/') + 1;
+		if (is_partition) {
+			char label[NAME_MAX + 16];
+			snprintf(label, sizeof(label), "partition %s", name);
+			print_layer(&ad, label, ad.fd_base, ad.fd_bytes, 0);
+		} else if ((err = find_partitions(disk_dir, &parts, &nparts))) {
+			goto quit;
+		}
+		check_stack(&ad, ctx->sysfs_path, name, ad.fd_base);
+		for (i = 0; i < nparts; ++i) {
+			char label[NAME_MAX + 16], path[PATH_MAX + NAME_MAX + 1];
+			snprintf(label, sizeof(label), "partition %s", parts[i].name);
+			print_layer(&ad, label, parts[i].start, parts[i].size, 0);
+			snprintf(path, sizeof(path), "%s/%s", disk_dir, parts[i].name);
+			check_stack(&ad, path, parts[i].name, parts[i].start);
+		}
+	}
+	if (!ad.nlayers)
+		printf(" no partitions, md members or filesystems found\n");
+	else if (ad.nmisaligned)
+		printf(" %u of %u layers misaligned\n", ad.nmisaligned, ad.nlayers);
+	else
+		printf(" all %u layers aligned\n", ad.nlayers);
+
+	if (ad.dfd != -1 && ad.logical < ad.io_bytes) {
+		double aligned, shifted;
+		if (!measure_penalty(&ad, ad.fd_base, ad.fd_bytes, ad.logical, &aligned, &shifted))
+			printf(" O_DIRECT random %ukB reads: %.2f MB/sec on boundaries, %.2f MB/sec %u bytes off (%.1f%% slower)\n",
+				ad.io_bytes / 1024, aligned, shifted, ad.logical, (aligned - shifted) * 100.0 / aligned);
+	}
+quit:
+	free(parts);
+	if (ad.buf) {
+		munlockall();
+		munmap(ad.buf, TIMING_BUF_BYTES);
+	}
+	if (ad.dfd != -1 && ad.dfd != fd)
+		close(ad.dfd);
+	return err;
+}
@@ -58,10 +58,23 @@ struct apt_data_struct {
 	};
 };
 
-static struct apt_data_struct apt_data;
+/*
+ * Bridge state is per-device, hung off the device context.
+ */
+static struct apt_data_struct *apt_get_data (int fd)
+{
+	struct dev_context *ctx = get_dev_context(fd);
+
+	if (!ctx)
+		return NULL;
+	if (!ctx->apt)
+		ctx->apt = calloc(1, sizeof(*ctx->apt));
+	return ctx->apt;
+}
 
 const char apt_ds_jmicron[] = "jmicron";
 const char apt_ds_unsup[]   = "unsupported";
+const char apt_ds_none[]    = "none";
 
 const struct apt_usb_id_entry apt_usb_id_map[] = {
 	{0x152d, 0x2329, 0x0100, apt_ds_jmicron,
@@ -74,75 +87,104 @@ const struct apt_usb_id_entry apt_usb_id_map[] = {
 	    apt_jmicron_int_init, apt_jmicron_sg16}  /* JMicron JM20339 (USB->SATA) */
 };
 
-int apt_detect (int fd, int verbose)
+static int apt_probe (int fd, int verbose)
 {
+	struct apt_data_struct *ad = apt_get_data(fd);
 	int err;
 	unsigned int i;
 
-	apt_data.is_apt = 0;
+	if (!ad)
+		return 0;
+	ad->is_apt = 0;
 
-	err = sysfs_get_attr_recursive(fd, "idVendor", "%x", &apt_data.id.vendor_id, NULL, verbose);
+	err = sysfs_get_attr_recursive(fd, "idVendor", "%x", &ad->id.vendor_id, NULL, verbose);
 	if (err) {
 		if (verbose) printf("APT: No idVendor found -> not USB bridge device\n");
 		return 0;
 	}
 
-	err = sysfs_get_attr_recursive(fd, "idProduct", "%x", &apt_data.id.product_id, NULL, verbose);
+	err = sysfs_get_attr_recursive(fd, "idProduct", "%x", &ad->id.product_id, NULL, verbose);
 	if (err) return 0;
 
-	err = sysfs_get_attr_recursive(fd, "bcdDevice", "%x", &apt_data.id.version, NULL, verbose);
+	err = sysfs_get_attr_recursive(fd, "bcdDevice", "%x", &ad->id.version, NULL, verbose);
 	if (err) return 0;
 
 	if (verbose)
-		printf("APT: USB ID = 0x%04x:0x%04x (0x%03x)\n", apt_data.id.vendor_id, apt_data.id.product_id,
-		  apt_data.id.version);
+		printf("APT: USB ID = 0x%04x:0x%04x (0x%03x)\n", ad->id.vendor_id, ad->id.product_id,
+		  ad->id.version);
 
 	/* We have all needed informations, let's find if we support that device*/
 	for (i = 0; i <	sizeof(apt_usb_id_map)/sizeof(*apt_usb_id_map); i++) {
-		if (apt_data.id.vendor_id == apt_usb_id_map[i].vendor_id &&
-		    apt_data.id.product_id == apt_usb_id_map[i].product_id) {
+		if (ad->id.vendor_id == apt_usb_id_map[i].vendor_id &&
+		    ad->id.product_id == apt_usb_id_map[i].product_id) {
 			/* Maybe two devices with same vendor and product id -> use version*/
-			if (apt_usb_id_map[i].version > 0 && apt_data.id.type &&
-			    apt_usb_id_map[i].version == apt_data.id.version) {
-				apt_data.id.type = apt_usb_id_map[i].type;
-				apt_data.id.init_func = apt_usb_id_map[i].init_func;
-				apt_data.id.sg16_func = apt_usb_id_map[i].sg16_func;
+			if (apt_usb_id_map[i].version > 0 && ad->id.type &&
+			    apt_usb_id_map[i].version == ad->id.version) {
+				ad->id.type = apt_usb_id_map[i].type;
+				ad->id.init_func = apt_usb_id_map[i].init_func;
+				ad->id.sg16_func = apt_usb_id_map[i].sg16_func;
 			}
 
 			/* We don't have type -> set it (don't care about version) */
-			if (!apt_data.id.type) {
-				apt_data.id.type = apt_usb_id_map[i].type;
-				apt_data.id.init_func = apt_usb_id_map[i].init_func;
-				apt_data.id.sg16_func = apt_usb_id_map[i].sg16_func;
+			if (!ad->id.type) {
+				ad->id.type = apt_usb_id_map[i].type;
+				ad->id.init_func = apt_usb_id_map[i].init_func;
+				ad->id.sg16_func = apt_usb_id_map[i].sg16_func;
 			}
 		}
 	}
 
-	if (!apt_data.id.type || apt_data.id.type == apt_ds_unsup) {
+	if (!ad->id.type || ad->id.type == apt_ds_unsup) {
 		if (verbose)
 			printf("APT: Unsupported device\n");
 
 		return 0;
 	}
 
-	apt_data.is_apt = 1;
+	ad->is_apt = 1;
 	if (verbose)
-		printf("APT: Found supported device %s\n", apt_data.id.type);
+		printf("APT: Found supported device %s\n", ad->id.type);
 
-	apt_data.verbose = verbose;
+	ad->verbose = verbose;
 
-	return (apt_data.id.init_func(fd));
+	return (ad->id.init_func(fd));
 }
 
-int apt_is_apt (void)
+/*
+ * The sysfs walk is only done once per device: a device found not to be
+ * a supported bridge is remembered in its transport profile.  Supported
+ * bridges are re-probed, since their init_func() sets up per-open state.
+ */
+int apt_detect (int fd, int verbose)
 {
-	return apt_data.is_apt;
+	struct dev_context *ctx = get_dev_context(fd);
+	int rc;
+
+	if (ctx && ctx->transport.bridge == apt_ds_none)
+		return 0;
+	rc = apt_probe(fd, verbose);
+	if (ctx && ctx->apt)
+		ctx->transport.bridge = ctx->apt->is_apt ? ctx->apt->id.type : apt_ds_none;
+	return rc;
+}
+
+int apt_is_apt (int fd)
+{
+	struct dev_context *ctx = get_dev_context(fd);
+
+	return ctx && ctx->apt && ctx->apt->is_apt;
 }
 
 int apt_sg16(int fd, int rw, int dma, struct ata_tf *tf,
 	    void *data, unsigned int data_bytes, unsigned int timeout_secs)
 {
-	return apt_data.id.sg16_func(fd, rw, dma, tf, data, data_bytes, timeout_secs);
+	struct apt_data_struct *ad = apt_get_data(fd);
+
+	if (!ad) {
+		errno = ENOMEM;
+		return -1;
+	}
+	return ad->id.sg16_func(fd, rw, dma, tf, data, data_bytes, timeout_secs);
 }
 
 static void dump_bytes (const char *prefix, unsigned char *p, int len)
@@ -161,14 +203,19 @@ static int apt_jmicron_int_sg(int fd, int rw, int dma, struct ata_tf *tf,
         void *data, unsigned int data_bytes, unsigned int timeout_secs,
         int port)
 {
+	struct apt_data_struct *ad = apt_get_data(fd);
 	unsigned char cdb[12];
 	struct scsi_sg_io_hdr io_hdr;
 
-	if (dma && apt_data.verbose)
+	if (!ad) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (dma && ad->verbose)
 		printf("APT: JMicron doesn't support DMA\n");
 
 	if (tf->is_lba48) {
-		if (apt_data.verbose)
+		if (ad->verbose)
 			fprintf(stderr, "APT: JMicron doesn't support 48-bit ATA commands\n");
                 errno = EBADE;
                 return -1;
@@ -188,7 +235,7 @@ static int apt_jmicron_int_sg(int fd, int rw, int dma, struct ata_tf *tf,
 	cdb[ 7] = tf->lob.lbal;
 	cdb[ 8] = tf->lob.lbam;
 	cdb[ 9] = tf->lob.lbah;
-	cdb[10] = (port ? port : apt_data.jmicron.port);
+	cdb[10] = (port ? port : ad->jmicron.port);
 	cdb[11] =  tf->command;
 
 	io_hdr.interface_id	= 'S';
@@ -201,14 +248,14 @@ static int apt_jmicron_int_sg(int fd, int rw, int dma, struct ata_tf *tf,
 	io_hdr.timeout		= (timeout_secs ? timeout_secs : 5) * 1000; /* msecs */
 	io_hdr.cmd_len 		= sizeof(cdb);
 
-	if (apt_data.verbose)
+	if (ad->verbose)
 		dump_bytes("outgoing cdb", cdb, sizeof(cdb));
 	if (ioctl(fd, SG_IO, &io_hdr) == -1) {
-		if (apt_data.verbose)
+		if (ad->verbose)
 			perror("ioctl(fd,SG_IO)");
 		return -1;      /* SG_IO not supported */
         }
-	if (apt_data.verbose)
+	if (ad->verbose)
 		fprintf(stderr, "SG_IO: ATA_%u status=0x%x, host_status=0x%x, driver_status=0x%x\n",
 		    io_hdr.cmd_len, io_hdr.status, io_hdr.host_status, io_hdr.driver_status);
 
@@ -239,25 +286,30 @@ static int apt_jmicron_int_get_registers(int fd, unsigned short addr,
 
 static int apt_jmicron_int_init(int fd)
 {
+	struct apt_data_struct *ad = apt_get_data(fd);
 	unsigned char regbuf = 0;
 	int res;
 
+	if (!ad) {
+		errno = ENOMEM;
+		return -1;
+	}
 	if ((res = apt_jmicron_int_get_registers(fd, 0x720F, &regbuf, 1)) == -1) {
 		return res;
 	}
 
 	if (regbuf & 0x04) {
-		apt_data.jmicron.port = 0xa0;
+		ad->jmicron.port = 0xa0;
 	} else if (regbuf & 0x40) {
-		apt_data.jmicron.port = 0xb0;
+		ad->jmicron.port = 0xb0;
 	} else {
 		perror("APT: No JMicron device connected");
 		errno = ENODEV;
 		return -1;
 	}
 
-	if (apt_data.verbose)
-		printf("APT: JMicron Port: 0x%X\n", apt_data.jmicron.port);
+	if (ad->verbose)
+		printf("APT: JMicron Port: 0x%X\n", ad->jmicron.port);
 	return 0;
 }
 
@@ -277,8 +329,9 @@ int apt_detect (int fd, int verbose)
 	return 0;
 }
 
-int apt_is_apt (void)
+int apt_is_apt (int fd)
 {
+	(void)fd;
 	return 0;
 }
 
@@ -0,0 +1,197 @@
+/*
+ * Saved timing baselines, for detecting drives which have slowed down.
+ *
+ * The baseline file is plain text, one line per drive:
+ *
+ *	model/serial <TAB> cached=MB/s <TAB> buffered=MB/s <TAB> p50=ms <TAB> p99=ms <TAB> max=ms <TAB> zones=MB/s,MB/s,...
+ *
+ * Fields which were not measured are simply omitted.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+#define BASELINE_LINE_MAX	1024
+
+static void parse_baseline (char *line, struct timing_results *r)
+{
+	char *field, *save = NULL;
+
+	memset(r, 0, sizeof(*r));
+	strtok_r(line, "\t\n", &save);	/* skip the key */
+	while ((field = strtok_r(NULL, "\t\n", &save))) {
+		if (1 == sscanf(field, "cached=%lf", &r->cached_MBps)) {
+			r->have_cached = 1;
+		} else if (1 == sscanf(field, "buffered=%lf", &r->buffered_MBps)) {
+			r->have_buffered = 1;
+		} else if (1 == sscanf(field, "p50=%lf", &r->lat_p50_ms)) {
+		} else if (1 == sscanf(field, "p99=%lf", &r->lat_p99_ms)) {
+		} else if (1 == sscanf(field, "max=%lf", &r->lat_max_ms)) {
+		} else if (0 == strncmp(field, "zones=", 6)) {
+			char *z = field + 6, *end;
+			while (r->nzones < BASELINE_ZONES) {
+				r->zone_MBps[r->nzones] = strtod(z, &end);
+				if (end == z)
+					break;
+				++r->nzones;
+				if (*end != ',')
+					break;
+				z = end + 1;
+			}
+		}
+	}
+}
+
+static int line_has_key (const char *line, const char *key)
+{
+	size_t len = strlen(key);
+
+	return 0 == strncmp(line, key, len) && line[len] == '\t';
+}
+
+/*
+ * Find the saved baseline for this drive, if any.
+ */
+static int find_baseline (const char *path, const char *key, struct timing_results *r)
+{
+	char line[BASELINE_LINE_MAX];
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return errno;
+	while (fgets(line, sizeof(line), fp)) {
+		if (line_has_key(line, key)) {
+			parse_baseline(line, r);
+			fclose(fp);
+			return 0;
+		}
+	}
+	fclose(fp);
+	return ENOENT;
+}
+
+int baseline_save_results (const char *path, const char *key, struct timing_results *r)
+{
+	char line[BASELINE_LINE_MAX], *tmp;
+	struct timing_results old;
+	FILE *in, *out;
+	unsigned int z;
+	int err = 0;
+
+	/* keep previously saved values for anything not measured this time */
+	if (!find_baseline(path, key, &old)) {
+		if (!r->have_cached && old.have_cached) {
+			r->have_cached = 1;
+			r->cached_MBps = old.cached_MBps;
+		}
+		if (!r->have_buffered && old.have_buffered) {
+			r->have_buffered = 1;
+			r->buffered_MBps = old.buffered_MBps;
+			r->lat_p50_ms = old.lat_p50_ms;
+			r->lat_p99_ms = old.lat_p99_ms;
+			r->lat_max_ms = old.lat_max_ms;
+		}
+		if (!r->nzones) {
+			r->nzones = old.nzones;
+			memcpy(r->zone_MBps, old.zone_MBps, sizeof(r->zone_MBps));
+		}
+	}
+	tmp = malloc(strlen(path) + 5);
+	if (!tmp)
+		return ENOMEM;
+	sprintf(tmp, "%s.tmp", path);
+	out = fopen(tmp, "w");
+	if (!out) {
+		err = errno;
+		perror(tmp);
+		free(tmp);
+		return err;
+	}
+	in = fopen(path, "r");
+	if (in) {
+		while (fgets(line, sizeof(line), in)) {
+			if (!line_has_key(line, key))
+				fputs(line, out);
+		}
+		fclose(in);
+	}
+	fprintf(out, "%s", key);
+	if (r->have_cached)
+		fprintf(out, "\tcached=%.2f", r->cached_MBps);
+	if (r->have_buffered)
+		fprintf(out, "\tbuffered=%.2f\tp50=%.3f\tp99=%.3f\tmax=%.3f",
+			r->buffered_MBps, r->lat_p50_ms, r->lat_p99_ms, r->lat_max_ms);
+	if (r->nzones) {
+		fprintf(out, "\tzones=");
+		for (z = 0; z < r->nzones; ++z)
+			fprintf(out, "%s%.2f", z ? "," : "", r->zone_MBps[z]);
+	}
+	fputc('\n', out);
+	if (fclose(out) || rename(tmp, path)) {
+		err = errno;
+		perror(path);
+		unlink(tmp);
+	} else {
+		printf(" Saved baseline for %s to %s\n", key, path);
+	}
+	free(tmp);
+	return err;
+}
+
+static int check_one (const char *what, double now, double base, double fraction, int higher_is_better)
+{
+	double ratio = base ? now / base : 1;
+	int bad = higher_is_better ? (ratio < fraction) : (base && ratio > 1 / fraction);
+
+	printf("\t%-22s %10.2f, baseline %10.2f (%6.1f%%)  %s\n", what, now, base, ratio * 100, bad ? "REGRESSED" : "ok");
+	return bad;
+}
+
+int baseline_check_results (const char *path, const char *key, struct timing_results *r, double fraction)
+{
+	struct timing_results b;
+	unsigned int z, bad = 0, checked = 0;
+	char what[32];
+	int err;
+
+	err = find_baseline(path, key, &b);
+	if (err) {
+		fprintf(stderr, " %s: no baseline for %s: %s\n", path, key, strerror(err));
+		return err;
+	}
+	printf(" Baseline check for %s (threshold %.0f%%):\n", key, fraction * 100);
+	if (r->have_cached && b.have_cached) {
+		bad += check_one("cached reads (MB/s)", r->cached_MBps, b.cached_MBps, fraction, 1);
+		++checked;
+	}
+	if (r->have_buffered && b.have_buffered) {
+		bad += check_one("disk reads (MB/s)", r->buffered_MBps, b.buffered_MBps, fraction, 1);
+		bad += check_one("read latency p99 (ms)", r->lat_p99_ms, b.lat_p99_ms, fraction, 0);
+		checked += 2;
+	}
+	for (z = 0; z < r->nzones && z < b.nzones; ++z) {
+		sprintf(what, "zone %u/%u (MB/s)", z + 1, b.nzones);
+		bad += check_one(what, r->zone_MBps[z], b.zone_MBps[z], fraction, 1);
+		++checked;
+	}
+	if (!checked) {
+		printf(" FAILED: nothing to compare: the baseline has none of the timings made now\n");
+		return ENODATA;
+	}
+	if (bad) {
+		printf(" FAILED: %u result(s) regressed from the baseline\n", bad);
+		return EIO;
+	}
+	printf(" PASSED\n");
+	return 0;
+}
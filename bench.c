@@ -0,0 +1,261 @@
+/*
+ * bench.c - CPU-side microbenchmarks for hdparm's parsing and formatting paths:
+ * "lba:count" parsing for --trim-sector-ranges-stdin, --Istdin parsing,
+ * the IDENTIFY decode behind -I, --fibmap extent output, and the hex
+ * dumps of --Istdout and --read-sector.
+ *
+ * Built and run by "make bench", linked with the same objects as hdparm
+ * (textio.c holds the parsing and dump routines from hdparm.c).
+ * Their output goes to /dev/null; results are reported on stderr as
+ * nanoseconds per item, and as calls to malloc/calloc/realloc made from
+ * hdparm code per item (counted with ld --wrap; libc-internal ones are not).
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+#define BENCH_TRIM_RANGES	2000000
+#define BENCH_IDENTIFY_DUMPS	10000
+#define BENCH_EXTENTS		1000000
+#define BENCH_DUMP_SECTORS	65536
+
+static unsigned long nallocs;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t nmemb, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+void *__wrap_malloc (size_t size);
+void *__wrap_calloc (size_t nmemb, size_t size);
+void *__wrap_realloc (void *ptr, size_t size);
+
+void *__wrap_malloc (size_t size)
+{
+	++nallocs;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc (size_t nmemb, size_t size)
+{
+	++nallocs;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size)
+{
+	++nallocs;
+	return __real_realloc(ptr, size);
+}
+
+/* small fixed-seed generator, so that every run sees the same inputs */
+static __u64 bench_seed = 0x2545f4914f6cdd1dULL;
+
+static __u64 bench_rand (void)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 7;
+	bench_seed ^= bench_seed << 17;
+	return bench_seed;
+}
+
+struct bench_run {
+	const char	*name;
+	const char	*unit;
+	__u64		start_ns;
+	unsigned long	start_allocs;
+};
+
+static void bench_start (struct bench_run *r, const char *name, const char *unit)
+{
+	r->name = name;
+	r->unit = unit;
+	fflush(stdout);
+	r->start_allocs = nallocs;
+	r->start_ns = timing_now_ns();
+}
+
+static void bench_stop (struct bench_run *r, unsigned long items)
+{
+	__u64 ns = timing_now_ns() - r->start_ns;
+	unsigned long allocs = nallocs - r->start_allocs;
+
+	fflush(stdout);
+	fprintf(stderr, "%-38s %9lu %-9s %10.1f ns/%-9s %8.3f allocs/%s\n", r->name, items, r->unit,
+		items ? (double)ns / items : 0, r->unit, items ? (double)allocs / items : 0, r->unit);
+}
+
+static FILE *bench_tmpfile (void)
+{
+	FILE *fp = tmpfile();
+
+	if (!fp) {
+		perror("tmpfile()");
+		exit(errno);
+	}
+	return fp;
+}
+
+static void bench_trim_ranges (void)
+{
+	struct bench_run r;
+	struct trim_batch b;
+	unsigned int i;
+	FILE *fp = bench_tmpfile();
+
+	for (i = 0; i < BENCH_TRIM_RANGES; ++i)
+		fprintf(fp, "%llu:%llu\n", bench_rand() % 7814037168ULL, 1 + (bench_rand() % 0xffff));
+	rewind(fp);
+
+	memset(&b, 0, sizeof(b));
+	b.max_ranges = 128 * 512 / sizeof(*b.data);	/* the usual max_sectors_kb=64 payload */
+	b.data = malloc(b.max_ranges * sizeof(*b.data));
+	if (!b.data)
+		exit(ENOMEM);
+	bench_start(&r, "trim ranges (read_trim_batch)", "range");
+	while (!b.eof) {
+		if (read_trim_batch(fp, ~0ULL >> 16, &b))
+			exit(EINVAL);
+	}
+	bench_stop(&r, b.total_ranges);
+	free(b.data);
+	fclose(fp);
+}
+
+/*
+ * A plausible IDENTIFY DEVICE page (4KB-sector SATA SSD with TRIM/NCQ/48-bit),
+ * varied a little per dump by the serial number and capacity.
+ */
+static void bench_identify_words (__u16 *w, unsigned int n)
+{
+	static const char *model = "HDPARM BENCH SSD 1TB                    ";
+	char serial[21];
+	__u64 sectors = 1953525168ULL - n;
+	unsigned int i;
+	__u8 sum = 0;
+
+	memset(w, 0, 512);
+	sprintf(serial, "BENCH%015u", n);
+	for (i = 0; i < 20; ++i)
+		w[27 + i] = (model[2 * i] << 8) | model[2 * i + 1];
+	for (i = 0; i < 10; ++i)
+		w[10 + i] = (serial[2 * i] << 8) | serial[2 * i + 1];
+	w[23] = ('1' << 8) | '.'; w[24] = ('0' << 8) | ' '; w[25] = w[26] = 0x2020;
+	w[0]  = 0x0040; w[1] = 16383; w[3] = 16; w[6] = 63;
+	w[47] = 0x8010; w[49] = 0x2f00; w[50] = 0x4000; w[53] = 0x0007;
+	w[59] = 0x5110; w[60] = 0xffff; w[61] = 0x0fff; w[63] = 0x0407; w[64] = 0x0003;
+	w[65] = w[66] = w[67] = w[68] = 120;
+	w[75] = 31; w[76] = 0x850e; w[77] = 0x0006; w[78] = 0x004c; w[79] = 0x0044;
+	w[80] = 0x07f8; w[81] = 0x0000; w[82] = 0x746b; w[83] = 0x7d09; w[84] = 0x6163;
+	w[85] = 0x7469; w[86] = 0xbc09; w[87] = 0x6163; w[88] = 0x207f; w[93] = 0;
+	w[100] = sectors; w[101] = sectors >> 16; w[102] = sectors >> 32; w[103] = 0;
+	w[106] = 0x6003; w[119] = 0x415e; w[120] = 0x401c; w[169] = 0x0001; w[217] = 0x0001;
+	w[222] = 0x107f;
+	w[255] = 0x00a5;
+	for (i = 0; i < 511; ++i)
+		sum += ((__u8 *)w)[i];
+	w[255] |= (__u8)(0 - sum) << 8;
+}
+
+static void bench_identify (void)
+{
+	struct bench_run r;
+	__u16 w[256];
+	unsigned int n, i;
+	FILE *fp = bench_tmpfile();
+
+	/* in the --Istdout format */
+	for (n = 0; n < BENCH_IDENTIFY_DUMPS; ++n) {
+		bench_identify_words(w, n);
+		fprintf(fp, "\n/dev/sdx:\n");
+		for (i = 0; i < 256; i += 8)
+			fprintf(fp, "%04x %04x %04x %04x %04x %04x %04x %04x\n",
+				w[i], w[i+1], w[i+2], w[i+3], w[i+4], w[i+5], w[i+6], w[i+7]);
+	}
+	fflush(fp);
+	if (dup2(fileno(fp), 0) == -1) {
+		perror("dup2()");
+		exit(errno);
+	}
+	fseek(stdin, 0, SEEK_SET);
+
+	bench_start(&r, "--Istdin (identify_from_stdin)", "dump");
+	for (n = 0; n < BENCH_IDENTIFY_DUMPS; ++n)
+		identify_from_stdin();
+	bench_stop(&r, n);
+	fclose(fp);
+
+	bench_identify_words(w, 0);
+	bench_start(&r, "-I decode only (identify)", "dump");
+	for (n = 0; n < BENCH_IDENTIFY_DUMPS; ++n)
+		identify(-1, w);
+	bench_stop(&r, n);
+}
+
+static void bench_extents (void)
+{
+	struct bench_run r;
+	struct hdparm_extent e;
+	unsigned int i;
+
+	e.byte_offset = 0;
+	bench_start(&r, "--fibmap extents (print_file_extent)", "extent");
+	for (i = 0; i < BENCH_EXTENTS; ++i) {
+		/* a badly fragmented file: mostly short extents, some holes and unknowns */
+		switch (i % 8) {
+			case 6:	e.begin_lba = e.end_lba = 0; e.nsectors = 8 * (1 + (i % 5));	break;
+			case 7:	e.begin_lba = e.end_lba = e.nsectors = 0;			break;
+			default:
+				e.nsectors  = 8 * (1 + (bench_rand() % 64));
+				e.begin_lba = 2048 + (bench_rand() % 1953000000ULL);
+				e.end_lba   = e.begin_lba + e.nsectors - 1;
+		}
+		print_file_extent(&e, NULL);
+		e.byte_offset += (e.nsectors ? e.nsectors : 8) * 512;
+	}
+	bench_stop(&r, i);
+}
+
+static void bench_dump_sectors (void)
+{
+	struct bench_run r;
+	__u16 *w;
+	unsigned int i;
+
+	w = malloc(BENCH_DUMP_SECTORS * 512);
+	if (!w)
+		exit(ENOMEM);
+	for (i = 0; i < BENCH_DUMP_SECTORS * 256; ++i)
+		w[i] = bench_rand();
+
+	bench_start(&r, "--Istdout words (dump_sectors raw)", "sector");
+	dump_sectors(w, BENCH_DUMP_SECTORS, 1, 512);
+	bench_stop(&r, BENCH_DUMP_SECTORS);
+
+	bench_start(&r, "--read-sector bytes (dump_sectors)", "sector");
+	dump_sectors(w, BENCH_DUMP_SECTORS, 0, 512);
+	bench_stop(&r, BENCH_DUMP_SECTORS);
+	free(w);
+}
+
+int main (void)
+{
+	if (!freopen("/dev/null", "w", stdout)) {
+		perror("/dev/null");
+		exit(errno);
+	}
+	timing_init();
+	fprintf(stderr, "hdparm CPU benchmarks, using %s:\n", timing_clock_name());
+	bench_trim_ranges();
+	bench_identify();
+	bench_extents();
+	bench_dump_sectors();
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Per-device context registry.
+ *
+ * Every fd open on the same device (including dup()s kept by the monitor
+ * modes) maps to the same context, keyed by the device number and inode,
+ * in the same way the log and transport caches used to be.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+static struct dev_context *dev_contexts = NULL;
+
+static struct dev_context *find_dev_context (struct dev_context *head, dev_t dev, ino_t ino)
+{
+	struct dev_context *ctx;
+
+	for (ctx = head; ctx; ctx = ctx->next) {
+		if (ctx->dev == dev && ctx->ino == ino)
+			return ctx;
+	}
+	return NULL;
+}
+
+/*
+ * Contexts are never freed, so the list can be walked without locking;
+ * new ones are pushed with compare-and-swap, and a thread which loses
+ * the race for the same device uses the winner's context instead.
+ */
+struct dev_context *get_dev_context (int fd)
+{
+	struct dev_context *ctx, *head;
+	struct stat st;
+
+	if (fstat(fd, &st))
+		return NULL;
+	if (!S_ISBLK(st.st_mode) && !S_ISCHR(st.st_mode))
+		st.st_rdev = st.st_dev;
+	head = __atomic_load_n(&dev_contexts, __ATOMIC_ACQUIRE);
+	ctx  = find_dev_context(head, st.st_rdev, st.st_ino);
+	if (ctx)
+		return ctx;
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		perror("calloc()");
+		return NULL;
+	}
+	ctx->dev = st.st_rdev;
+	ctx->ino = st.st_ino;
+	do {
+		struct dev_context *found = find_dev_context(head, ctx->dev, ctx->ino);
+		if (found) {
+			free(ctx);
+			return found;
+		}
+		ctx->next = head;
+	} while (!__atomic_compare_exchange_n(&dev_contexts, &head, ctx, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+	return ctx;
+}
+
+struct transport_profile *get_transport_profile (int fd)
+{
+	struct dev_context *ctx = get_dev_context(fd);
+
+	return ctx ? &ctx->transport : NULL;
+}
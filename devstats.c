@@ -0,0 +1,244 @@
+/*
+ * Decoder for the ATA Device Statistics log (General Purpose Log 0x04).
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+#define DEVSTATS_LOG		0x04
+#define DEVSTATS_MAX_PAGES	8
+
+/* Flag bits in the top byte of each 64-bit statistic */
+#define DEVSTAT_SUPPORTED	(1ULL << 63)
+#define DEVSTAT_VALID		(1ULL << 62)
+#define DEVSTAT_NORMALIZED	(1ULL << 61)
+#define DEVSTAT_VALUE_MASK	((1ULL << 48) - 1)
+
+enum {
+	DEVSTAT_U32,		/* 32-bit counter */
+	DEVSTAT_U48,		/* 48-bit counter */
+	DEVSTAT_TEMP,		/* signed 8-bit degrees celsius */
+};
+
+struct devstat_desc {
+	__u8		page;
+	__u8		offset;
+	__u8		type;
+	const char	*name;
+};
+
+static const char *devstat_page_names[DEVSTATS_MAX_PAGES] = {
+	"List of Supported Pages",
+	"General Statistics",
+	"Free-Fall Statistics",
+	"Rotating Media Statistics",
+	"General Errors Statistics",
+	"Temperature Statistics",
+	"Transport Statistics",
+	"Solid State Device Statistics",
+};
+
+static const struct devstat_desc devstat_table[] = {
+	{ 1, 0x08, DEVSTAT_U32,  "Lifetime Power-On Resets" },
+	{ 1, 0x10, DEVSTAT_U32,  "Power-on Hours" },
+	{ 1, 0x18, DEVSTAT_U48,  "Logical Sectors Written" },
+	{ 1, 0x20, DEVSTAT_U48,  "Number of Write Commands" },
+	{ 1, 0x28, DEVSTAT_U48,  "Logical Sectors Read" },
+	{ 1, 0x30, DEVSTAT_U48,  "Number of Read Commands" },
+	{ 1, 0x38, DEVSTAT_U48,  "Date and Time TimeStamp (ms)" },
+	{ 1, 0x40, DEVSTAT_U32,  "Pending Error Count" },
+	{ 1, 0x48, DEVSTAT_U32,  "Workload Utilization" },
+	{ 1, 0x50, DEVSTAT_U48,  "Utilization Usage Rate" },
+	{ 2, 0x08, DEVSTAT_U32,  "Number of Free-Fall Events Detected" },
+	{ 2, 0x10, DEVSTAT_U32,  "Overlimit Shock Events" },
+	{ 3, 0x08, DEVSTAT_U32,  "Spindle Motor Power-on Hours" },
+	{ 3, 0x10, DEVSTAT_U32,  "Head Flying Hours" },
+	{ 3, 0x18, DEVSTAT_U32,  "Head Load Events" },
+	{ 3, 0x20, DEVSTAT_U32,  "Number of Reallocated Logical Sectors" },
+	{ 3, 0x28, DEVSTAT_U32,  "Read Recovery Attempts" },
+	{ 3, 0x30, DEVSTAT_U32,  "Number of Mechanical Start Failures" },
+	{ 3, 0x38, DEVSTAT_U32,  "Number of Realloc Candidate Logical Sectors" },
+	{ 3, 0x40, DEVSTAT_U32,  "Number of High Priority Unload Events" },
+	{ 4, 0x08, DEVSTAT_U32,  "Number of Reported Uncorrectable Errors" },
+	{ 4, 0x10, DEVSTAT_U32,  "Resets Between Command Acceptance and Completion" },
+	{ 5, 0x08, DEVSTAT_TEMP, "Current Temperature" },
+	{ 5, 0x10, DEVSTAT_TEMP, "Average Short Term Temperature" },
+	{ 5, 0x18, DEVSTAT_TEMP, "Average Long Term Temperature" },
+	{ 5, 0x20, DEVSTAT_TEMP, "Highest Temperature" },
+	{ 5, 0x28, DEVSTAT_TEMP, "Lowest Temperature" },
+	{ 5, 0x30, DEVSTAT_TEMP, "Highest Average Short Term Temperature" },
+	{ 5, 0x38, DEVSTAT_TEMP, "Lowest Average Short Term Temperature" },
+	{ 5, 0x40, DEVSTAT_TEMP, "Highest Average Long Term Temperature" },
+	{ 5, 0x48, DEVSTAT_TEMP, "Lowest Average Long Term Temperature" },
+	{ 5, 0x50, DEVSTAT_U32,  "Time in Over-Temperature (minutes)" },
+	{ 5, 0x58, DEVSTAT_TEMP, "Specified Maximum Operating Temperature" },
+	{ 5, 0x60, DEVSTAT_U32,  "Time in Under-Temperature (minutes)" },
+	{ 5, 0x68, DEVSTAT_TEMP, "Specified Minimum Operating Temperature" },
+	{ 6, 0x08, DEVSTAT_U32,  "Number of Hardware Resets" },
+	{ 6, 0x10, DEVSTAT_U32,  "Number of ASR Events" },
+	{ 6, 0x18, DEVSTAT_U32,  "Number of Interface CRC Errors" },
+	{ 7, 0x08, DEVSTAT_U32,  "Percentage Used Endurance Indicator" },
+	{ 0, 0, 0, NULL }
+};
+
+static __u64 devstat_qword (const __u8 *page, unsigned int offset)
+{
+	__u64 val = 0;
+	int i;
+
+	for (i = 7; i >= 0; --i)
+		val = (val << 8) | page[offset + i];
+	return val;
+}
+
+/*
+ * Read every page of the log in a single command.
+ * This always goes to the drive, since the counters change continuously.
+ */
+static __u8 *read_devstats (int fd, unsigned int *npages)
+{
+	static __u8 *buf = NULL;
+	static unsigned int buf_pages = 0;
+	unsigned int count = get_log_page_count(fd, DEVSTATS_LOG);
+	int err;
+
+	if (!count) {
+		fprintf(stderr, " Device Statistics log is not supported\n");
+		return NULL;
+	}
+	if (count > DEVSTATS_MAX_PAGES)
+		count = DEVSTATS_MAX_PAGES;	/* higher pages are vendor specific */
+	if (count > buf_pages) {
+		free(buf);
+		buf = malloc(count * 512);
+		if (!buf) {
+			perror("malloc()");
+			buf_pages = 0;
+			return NULL;
+		}
+		buf_pages = count;
+	}
+	err = read_log_ext(fd, DEVSTATS_LOG, 0, count, 0, buf);
+	if (err) {
+		fprintf(stderr, "READ_LOG_EXT(DEVICE_STATISTICS) failed: %s\n", strerror(err));
+		return NULL;
+	}
+	*npages = count;
+	return buf;
+}
+
+/*
+ * Look up a single statistic; returns 0 if it is not supported/valid.
+ */
+static int get_devstat (__u8 *log, unsigned int npages, unsigned int page, unsigned int offset, __u64 *val)
+{
+	__u64 q;
+
+	if (page >= npages || log[page * 512 + 2] != page)
+		return 0;
+	q = devstat_qword(log + page * 512, offset);
+	if ((q & (DEVSTAT_SUPPORTED | DEVSTAT_VALID)) != (DEVSTAT_SUPPORTED | DEVSTAT_VALID))
+		return 0;
+	*val = q & DEVSTAT_VALUE_MASK;
+	return 1;
+}
+
+static void print_devstats (__u8 *log, unsigned int npages)
+{
+	const struct devstat_desc *d;
+	unsigned int cur_page = 0;
+
+	printf(" Device Statistics:\n");
+	for (d = devstat_table; d->name; ++d) {
+		__u64 val;
+
+		if (!get_devstat(log, npages, d->page, d->offset, &val))
+			continue;
+		if (d->page != cur_page) {
+			cur_page = d->page;
+			printf("\t%s:\n", devstat_page_names[cur_page]);
+		}
+		printf("\t\t%-50s = ", d->name);
+		switch (d->type) {
+			case DEVSTAT_TEMP:
+				printf("%d C\n", (signed char)val);
+				break;
+			case DEVSTAT_U32:
+				printf("%u\n", (unsigned int)val);
+				break;
+			default:
+				printf("%llu\n", val);
+				break;
+		}
+	}
+}
+
+/*
+ * Print the statistics once, or (with an interval) repeatedly print
+ * the drive's own view of the host read/write rates between samples.
+ */
+int do_device_stats (int fd, unsigned int interval, unsigned int count)
+{
+	__u64 prev_rd_sects = 0, prev_wr_sects = 0, prev_rd_cmds = 0, prev_wr_cmds = 0;
+	struct timeval start, prev_tv, tv;
+	unsigned int npages, sample, sector_bytes = get_current_sector_size(fd);
+	__u8 *log;
+
+	log = read_devstats(fd, &npages);
+	if (!log)
+		return EIO;
+	if (!interval) {
+		print_devstats(log, npages);
+		return 0;
+	}
+	gettimeofday(&start, NULL);
+	prev_tv = start;
+	get_devstat(log, npages, 1, 0x28, &prev_rd_sects);
+	get_devstat(log, npages, 1, 0x18, &prev_wr_sects);
+	get_devstat(log, npages, 1, 0x30, &prev_rd_cmds);
+	get_devstat(log, npages, 1, 0x20, &prev_wr_cmds);
+	printf(" %8s %12s %12s %10s %10s %6s\n", "seconds", "read MB/s", "write MB/s", "read/s", "write/s", "temp");
+	for (sample = 1; !count || sample <= count; ++sample) {
+		__u64 rd_sects = 0, wr_sects = 0, rd_cmds = 0, wr_cmds = 0, temp;
+		double secs;
+		char temp_str[16];
+
+		sleep(interval);
+		log = read_devstats(fd, &npages);
+		if (!log)
+			return EIO;
+		gettimeofday(&tv, NULL);
+		secs = (tv.tv_sec - prev_tv.tv_sec) + ((tv.tv_usec - prev_tv.tv_usec) / 1000000.0);
+		get_devstat(log, npages, 1, 0x28, &rd_sects);
+		get_devstat(log, npages, 1, 0x18, &wr_sects);
+		get_devstat(log, npages, 1, 0x30, &rd_cmds);
+		get_devstat(log, npages, 1, 0x20, &wr_cmds);
+		if (get_devstat(log, npages, 5, 0x08, &temp))
+			sprintf(temp_str, "%dC", (signed char)temp);
+		else
+			strcpy(temp_str, "-");
+		printf(" %8.1f %12.2f %12.2f %10.1f %10.1f %6s\n",
+			(tv.tv_sec - start.tv_sec) + ((tv.tv_usec - start.tv_usec) / 1000000.0),
+			(rd_sects - prev_rd_sects) * sector_bytes / secs / 1000000.0,
+			(wr_sects - prev_wr_sects) * sector_bytes / secs / 1000000.0,
+			(rd_cmds  - prev_rd_cmds)  / secs,
+			(wr_cmds  - prev_wr_cmds)  / secs, temp_str);
+		fflush(stdout);
+		prev_tv = tv;
+		prev_rd_sects = rd_sects;
+		prev_wr_sects = wr_sects;
+		prev_rd_cmds  = rd_cmds;
+		prev_wr_cmds  = wr_cmds;
+	}
+	return 0;
+}
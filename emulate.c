@@ -0,0 +1,843 @@
+/*
+ * Emulated ATA device, backed by a regular file (--emulate).
+ *
+ * This sits underneath sg16(), in the same way as the APT bridge support,
+ * so every passthrough command (and everything built on do_drive_cmd() and
+ * do_taskfile_cmd()) can be exercised, timed, and fault-tested without
+ * real hardware.  The image file holds the media contents; everything else
+ * (power state, HPA, sanitize progress, logs, bad sectors) lives in memory
+ * for the life of the process.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <linux/types.h>
+#include <linux/falloc.h>
+
+#include "sgio.h"
+#include "hdparm.h"
+
+#define EMU_SECTOR_BYTES	512
+#define EMU_SANITIZE_STEPS	16	/* sanitize completes after this many status polls */
+#define EMU_TEMPERATURE		35
+
+/* ATA status and error register bits */
+enum {
+	EMU_STAT_DRDY		= 0x40,
+	EMU_STAT_DSC		= 0x10,
+	EMU_ERR_UNC		= 0x40,
+	EMU_ERR_IDNF		= 0x10,
+	EMU_ERR_ABRT		= 0x04,
+};
+
+enum {
+	EMU_POWER_ACTIVE,
+	EMU_POWER_IDLE,
+	EMU_POWER_STANDBY,
+	EMU_POWER_SLEEP,
+};
+
+struct emu_range {
+	__u64		lba;
+	__u64		count;
+};
+
+struct emu_dev {
+	ino_t		ino;		/* of the image, for the serial number */
+	int		bfd;		/* our own (read-write if possible) descriptor for the image */
+	int		read_only;
+	__u64		native_sectors;
+	__u64		max_sectors;	/* visible capacity, after SET MAX (HPA) */
+	__u16		id[256];
+	int		power;
+	int		write_cache, look_ahead;
+	unsigned int	latency_us;	/* --emulate-latency */
+	int		verbose;
+
+	/* error injection */
+	struct emu_range *bad;
+	unsigned int	nbad, bad_alloc;
+	unsigned int	abort_every, ncommands;
+
+	/* sanitize */
+	int		sanitize_running, sanitize_succeeded, sanitize_frozen, sanitize_antifreeze;
+	__u16		sanitize_feature;
+	__u32		sanitize_pattern;
+	unsigned int	sanitize_step;
+
+	/* statistics, for the Device Statistics and Phy Event Counter logs */
+	__u64		sectors_read, sectors_written, read_cmds, write_cmds;
+	__u32		injected_errors, reported_uncs;
+};
+
+static int		emu_active = 0;	/* set (atomically) once any image is attached */
+
+static void put_string (__u16 *w, unsigned int nwords, const char *s)
+{
+	unsigned int i, len = strlen(s);
+
+	for (i = 0; i < nwords * 2; ++i) {
+		__u8 c = (i < len) ? s[i] : ' ';
+		if (i & 1)
+			w[i / 2] |= c;
+		else
+			w[i / 2] = c << 8;
+	}
+}
+
+/*
+ * IDENTIFY DEVICE data for a SATA SSD supporting LBA48, DMA, NCQ, TRIM,
+ * SMART/SCT, General Purpose Logging, WRITE UNCORRECTABLE and SANITIZE.
+ */
+static void emu_build_identify (struct emu_dev *d)
+{
+	__u16 *id = d->id;
+	__u64 lba28 = d->max_sectors > 0x0fffffff ? 0x0fffffff : d->max_sectors;
+	char serial[24];
+	__u8 sum = 0;
+	int i;
+
+	memset(id, 0, sizeof(d->id));
+	sprintf(serial, "EMU%08lX", (unsigned long)d->ino);
+	id[  0] = 0x0040;			/* fixed device */
+	put_string(&id[10], 10, serial);
+	put_string(&id[23],  4, "EMU1");
+	put_string(&id[27], 20, "hdparm emulated disk");
+	id[ 47] = 0x8010;			/* 16 sectors per READ/WRITE MULTIPLE */
+	id[ 49] = 0x0300;			/* LBA, DMA */
+	id[ 53] = 0x0006;			/* words 64-70 and 88 are valid */
+	id[ 59] = 0xf110;			/* sanitize: block erase, overwrite, crypto; multiple = 16 */
+	id[ 60] = lba28;
+	id[ 61] = lba28 >> 16;
+	id[ 63] = 0x0007;
+	id[ 64] = 0x0003;
+	id[ 65] = id[66] = id[67] = id[68] = 120;
+	id[ 69] = 0x4020;			/* deterministic, zeroed data after TRIM */
+	id[ 75] = 31;				/* NCQ depth - 1 */
+	id[ 76] = 0x0106;			/* SATA Gen1/Gen2, NCQ */
+	id[ 80] = 0x07f0;			/* ATA/ATAPI-4 .. ACS-3 */
+	id[ 82] = 0x4069;			/* SMART, power management, write cache, look-ahead */
+	id[ 83] = 0x7400;			/* LBA48, FLUSH CACHE (EXT) */
+	id[ 84] = 0x4020;			/* General Purpose Logging */
+	id[ 85] = 0x4009 | (d->write_cache ? 0x0020 : 0) | (d->look_ahead ? 0x0040 : 0);
+	id[ 86] = 0xb400;
+	id[ 87] = 0x4020;
+	id[ 88] = 0x407f;			/* UDMA 0-6, UDMA6 selected */
+	id[100] = d->max_sectors;
+	id[101] = d->max_sectors >> 16;
+	id[102] = d->max_sectors >> 32;
+	id[103] = d->max_sectors >> 48;
+	id[106] = 0x4000;			/* 512-byte logical and physical sectors */
+	id[119] = 0x400c;			/* READ LOG DMA EXT, WRITE UNCORRECTABLE EXT */
+	id[120] = 0x400c;
+	id[169] = 0x0001;			/* DSM TRIM */
+	id[206] = 0x0001;			/* SCT Command Transport */
+	id[217] = 0x0001;			/* non-rotating media */
+	id[255] = 0x00a5;
+	for (i = 0; i < 511; ++i)
+		sum += ((__u8 *)id)[i ^ (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)];
+	id[255] |= (__u8)(-sum) << 8;
+}
+
+static int emu_add_bad (struct emu_dev *d, __u64 lba, __u64 count)
+{
+	if (d->nbad == d->bad_alloc) {
+		unsigned int n = d->bad_alloc ? d->bad_alloc * 2 : 16;
+		struct emu_range *b = realloc(d->bad, n * sizeof(*b));
+		if (!b)
+			return ENOMEM;
+		d->bad = b;
+		d->bad_alloc = n;
+	}
+	d->bad[d->nbad].lba   = lba;
+	d->bad[d->nbad].count = count;
+	++d->nbad;
+	return 0;
+}
+
+/*
+ * Writing to an unreadable sector "repairs" it, just as a real drive
+ * reallocates or rewrites the sector.
+ */
+static void emu_clear_bad (struct emu_dev *d, __u64 lba, __u64 count)
+{
+	unsigned int i;
+
+	for (i = 0; i < d->nbad; ) {
+		struct emu_range *b = &d->bad[i];
+		__u64 end = b->lba + b->count;
+
+		if (end <= lba || b->lba >= lba + count) {
+			++i;
+		} else if (b->lba >= lba && end <= lba + count) {
+			*b = d->bad[--d->nbad];
+		} else if (b->lba < lba && end > lba + count) {
+			b->count = lba - b->lba;
+			if (emu_add_bad(d, lba + count, end - (lba + count)))
+				return;
+			++i;
+		} else if (b->lba < lba) {
+			b->count = lba - b->lba;
+			++i;
+		} else {
+			b->count = end - (lba + count);
+			b->lba   = lba + count;
+			++i;
+		}
+	}
+}
+
+static int emu_first_bad (struct emu_dev *d, __u64 lba, __u64 count, __u64 *bad_lba)
+{
+	unsigned int i;
+	int found = 0;
+
+	for (i = 0; i < d->nbad; ++i) {
+		struct emu_range *b = &d->bad[i];
+		if (b->lba + b->count > lba && b->lba < lba + count) {
+			__u64 first = (b->lba > lba) ? b->lba : lba;
+			if (!found || first < *bad_lba)
+				*bad_lba = first;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+/*
+ * SPEC is a comma separated list of LBA or LBA:COUNT unreadable sector ranges,
+ * and/or "abort=N" to fail every Nth command with ABRT (as a link error would).
+ */
+static int emu_parse_errors (struct emu_dev *d, const char *spec)
+{
+	const char *p = spec;
+	char *end;
+
+	while (p && *p) {
+		if (0 == strncmp(p, "abort=", 6)) {
+			d->abort_every = strtoul(p + 6, &end, 0);
+		} else {
+			__u64 lba = strtoull(p, &end, 0), count = 1;
+			if (end == p)
+				goto bad;
+			if (*end == ':') {
+				p = end + 1;
+				count = strtoull(p, &end, 0);
+				if (end == p || !count)
+					goto bad;
+			}
+			if (emu_add_bad(d, lba, count))
+				return ENOMEM;
+		}
+		if (*end && *end != ',')
+			goto bad;
+		p = *end ? end + 1 : end;
+	}
+	return 0;
+bad:
+	fprintf(stderr, "--emulate-errors: bad error specification: %s\n", p);
+	return EINVAL;
+}
+
+static struct emu_dev *emu_lookup (int fd)
+{
+	struct dev_context *ctx;
+
+	if (!__atomic_load_n(&emu_active, __ATOMIC_ACQUIRE) || !(ctx = get_dev_context(fd)))
+		return NULL;
+	return ctx->emu;
+}
+
+int emu_is_emulated (int fd)
+{
+	return emu_lookup(fd) != NULL;
+}
+
+int emu_attach (int fd, const char *devname, unsigned int latency_us, const char *errors, int verbose)
+{
+	struct dev_context *ctx;
+	struct emu_dev *d;
+	struct stat st;
+	int err;
+
+	if (fstat(fd, &st)) {
+		err = errno;
+		perror(devname);
+		return err;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		fprintf(stderr, "%s: --emulate requires a regular (image) file\n", devname);
+		return EINVAL;
+	}
+	if (st.st_size < EMU_SECTOR_BYTES) {
+		fprintf(stderr, "%s: image file is too small\n", devname);
+		return EINVAL;
+	}
+	ctx = get_dev_context(fd);
+	if (!ctx)
+		return ENOMEM;
+	if (ctx->emu)
+		return 0;	/* same image listed twice */
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		err = errno;
+		perror("calloc()");
+		return err;
+	}
+	d->bfd = open(devname, O_RDWR);
+	if (d->bfd == -1) {
+		d->bfd = open(devname, O_RDONLY);
+		d->read_only = 1;
+	}
+	if (d->bfd == -1) {
+		err = errno;
+		perror(devname);
+		free(d);
+		return err;
+	}
+	d->ino = st.st_ino;
+	d->native_sectors = d->max_sectors = st.st_size / EMU_SECTOR_BYTES;
+	d->write_cache = d->look_ahead = 1;
+	d->power = EMU_POWER_ACTIVE;
+	d->latency_us = latency_us;
+	d->verbose = verbose;
+	if (errors && (err = emu_parse_errors(d, errors))) {
+		close(d->bfd);
+		free(d->bad);
+		free(d);
+		return err;
+	}
+	emu_build_identify(d);
+	ctx->emu = d;
+	ctx->transport.method = TRANSPORT_EMULATED;
+	ctx->transport.emulate = emu_sg16;
+	__atomic_store_n(&emu_active, 1, __ATOMIC_RELEASE);
+	if (verbose)
+		printf("EMU: %s: %llu sectors%s, %u bad range(s), latency %u usecs\n", devname,
+			d->native_sectors, d->read_only ? " (read-only)" : "", d->nbad, latency_us);
+	return 0;
+}
+
+static void emu_set_lba (struct ata_tf *tf, __u64 lba)
+{
+	tf->lob.lbal = lba;
+	tf->lob.lbam = lba >>  8;
+	tf->lob.lbah = lba >> 16;
+	if (tf->is_lba48) {
+		tf->hob.lbal = lba >> 24;
+		tf->hob.lbam = lba >> 32;
+		tf->hob.lbah = lba >> 40;
+	} else {
+		tf->dev = (tf->dev & 0xf0) | ((lba >> 24) & 0x0f);
+	}
+}
+
+static int emu_fail (struct ata_tf *tf, __u8 error)
+{
+	tf->status = EMU_STAT_DRDY | ATA_STAT_ERR;
+	tf->error  = error;
+	errno = EIO;
+	return -1;
+}
+
+static int emu_media_error (struct emu_dev *d, struct ata_tf *tf, __u64 lba)
+{
+	++d->reported_uncs;
+	emu_set_lba(tf, lba);
+	return emu_fail(tf, EMU_ERR_UNC);
+}
+
+static int emu_rw_sectors (struct emu_dev *d, int write, __u8 *data, __u64 lba, __u64 nsect)
+{
+	off_t off = lba * EMU_SECTOR_BYTES;
+	size_t len = nsect * EMU_SECTOR_BYTES, done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		if (write)
+			n = pwrite(d->bfd, data + done, len - done, off + done);
+		else
+			n = pread(d->bfd, data + done, len - done, off + done);
+		if (n <= 0) {
+			if (n == 0 && !write) {	/* short image file: reads as zeros */
+				memset(data + done, 0, len - done);
+				break;
+			}
+			return -1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+static int emu_zero_sectors (struct emu_dev *d, __u64 lba, __u64 nsect)
+{
+	static __u8 zeros[64 * 1024];
+	__u64 chunk = sizeof(zeros) / EMU_SECTOR_BYTES;
+
+	if (0 == fallocate(d->bfd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				lba * EMU_SECTOR_BYTES, nsect * EMU_SECTOR_BYTES))
+		return 0;
+	while (nsect) {
+		if (chunk > nsect)
+			chunk = nsect;
+		if (emu_rw_sectors(d, 1, zeros, lba, chunk))
+			return -1;
+		lba   += chunk;
+		nsect -= chunk;
+	}
+	return 0;
+}
+
+static int emu_read_write (struct emu_dev *d, int write, int verify, struct ata_tf *tf, void *data, unsigned int data_bytes)
+{
+	__u64 lba = tf_to_lba(tf), nsect, bad_lba = 0;
+
+	nsect = tf->lob.nsect | (tf->is_lba48 ? (tf->hob.nsect << 8) : 0);
+	if (!nsect)
+		nsect = tf->is_lba48 ? 65536 : 256;
+	if (lba + nsect > d->max_sectors) {
+		emu_set_lba(tf, lba);
+		return emu_fail(tf, EMU_ERR_IDNF);
+	}
+	if (!verify && (!data || data_bytes < nsect * EMU_SECTOR_BYTES))
+		return emu_fail(tf, EMU_ERR_ABRT);
+	if (write) {
+		if (d->read_only || emu_rw_sectors(d, 1, data, lba, nsect))
+			return emu_fail(tf, EMU_ERR_ABRT);
+		emu_clear_bad(d, lba, nsect);
+		d->sectors_written += nsect;
+		++d->write_cmds;
+		return 0;
+	}
+	++d->read_cmds;
+	if (emu_first_bad(d, lba, nsect, &bad_lba)) {
+		/* transfer what precedes the bad sector, as a drive would */
+		if (!verify && bad_lba > lba)
+			emu_rw_sectors(d, 0, data, lba, bad_lba - lba);
+		d->sectors_read += bad_lba - lba;
+		return emu_media_error(d, tf, bad_lba);
+	}
+	if (!verify && emu_rw_sectors(d, 0, data, lba, nsect))
+		return emu_fail(tf, EMU_ERR_ABRT);
+	d->sectors_read += nsect;
+	return 0;
+}
+
+static void emu_put_qword (__u8 *p, __u64 val)
+{
+	int i;
+
+	for (i = 0; i < 8; ++i)
+		p[i] = val >> (8 * i);
+}
+
+static void emu_devstat (__u8 *page, unsigned int offset, __u64 val)
+{
+	emu_put_qword(page + offset, val | (3ULL << 62));	/* supported, valid */
+}
+
+/*
+ * Device Statistics (log 0x04): the list of pages, plus the
+ * general, temperature and transport statistics pages.
+ */
+static void emu_build_devstats (struct emu_dev *d, unsigned int pagenr, __u8 *page)
+{
+	static const __u8 pages[] = { 0x00, 0x01, 0x05, 0x06 };
+	unsigned int i;
+
+	page[0] = 1;		/* revision */
+	page[2] = pagenr;
+	switch (pagenr) {
+	case 0:
+		page[8] = sizeof(pages);
+		for (i = 0; i < sizeof(pages); ++i)
+			page[9 + i] = pages[i];
+		break;
+	case 1:
+		emu_devstat(page, 0x08, 1);
+		emu_devstat(page, 0x18, d->sectors_written);
+		emu_devstat(page, 0x20, d->write_cmds);
+		emu_devstat(page, 0x28, d->sectors_read);
+		emu_devstat(page, 0x30, d->read_cmds);
+		emu_devstat(page, 0x40, d->nbad);
+		break;
+	case 5:
+		for (i = 0x08; i <= 0x48; i += 8)
+			emu_devstat(page, i, EMU_TEMPERATURE);
+		emu_devstat(page, 0x58, 70);
+		emu_devstat(page, 0x68, 0);
+		break;
+	case 6:
+		emu_devstat(page, 0x08, 1);
+		emu_devstat(page, 0x18, d->injected_errors);
+		break;
+	default:
+		page[2] = 0;	/* not supported */
+		break;
+	}
+}
+
+static void emu_build_phy_events (struct emu_dev *d, __u8 *page)
+{
+	static const __u16 counters[] = { 0x001, 0x00a, 0x00b };
+	unsigned int i, off = 4;
+	__u8 sum = 0;
+
+	page[0] = 1;
+	for (i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+		__u16 idw = counters[i] | (2 << 12);	/* 32-bit values */
+		__u32 val = 0;
+
+		if (counters[i] == 0x001 || counters[i] == 0x00b)
+			val = d->injected_errors;
+		else if (counters[i] == 0x00a)
+			val = 1;
+		page[off++] = idw;
+		page[off++] = idw >> 8;
+		page[off++] = val;
+		page[off++] = val >> 8;
+		page[off++] = val >> 16;
+		page[off++] = val >> 24;
+	}
+	for (i = 0; i < 511; ++i)
+		sum += page[i];
+	page[511] = -sum;
+}
+
+static int emu_read_log (struct emu_dev *d, struct ata_tf *tf, __u8 *data, unsigned int data_bytes)
+{
+	__u8 log = tf->lob.lbal;
+	unsigned int pagenr = tf->lob.lbam | (tf->hob.lbam << 8);
+	unsigned int npages = tf->lob.nsect | (tf->hob.nsect << 8), i;
+	__u16 feat = tf->lob.feat | (tf->hob.feat << 8);
+
+	if (!npages || data_bytes < npages * EMU_SECTOR_BYTES)
+		return emu_fail(tf, EMU_ERR_ABRT);
+	for (i = 0; i < npages; ++i, ++pagenr) {
+		__u8 *page = data + i * EMU_SECTOR_BYTES;
+
+		switch (log) {
+		case 0x00:	/* log directory */
+			if (pagenr)
+				return emu_fail(tf, EMU_ERR_ABRT);
+			page[0] = 1;
+			page[0x04 * 2] = 8;
+			page[0x11 * 2] = 1;
+			break;
+		case 0x04:
+			if (pagenr >= 8)
+				return emu_fail(tf, EMU_ERR_ABRT);
+			emu_build_devstats(d, pagenr, page);
+			break;
+		case 0x11:
+			if (pagenr)
+				return emu_fail(tf, EMU_ERR_ABRT);
+			emu_build_phy_events(d, page);
+			if (feat & 1)
+				d->injected_errors = 0;
+			break;
+		default:
+			return emu_fail(tf, EMU_ERR_ABRT);
+		}
+	}
+	return 0;
+}
+
+static int emu_dsm_trim (struct emu_dev *d, struct ata_tf *tf, __u8 *data, unsigned int data_bytes)
+{
+	unsigned int nblocks = tf->lob.nsect | (tf->hob.nsect << 8), i;
+
+	if (!(tf->lob.feat & 1) || !nblocks || data_bytes < nblocks * EMU_SECTOR_BYTES || d->read_only)
+		return emu_fail(tf, EMU_ERR_ABRT);
+	for (i = 0; i < nblocks * EMU_SECTOR_BYTES; i += 8) {
+		__u64 range = 0, lba, count;
+		int b;
+
+		for (b = 7; b >= 0; --b)
+			range = (range << 8) | data[i + b];
+		lba   = range & 0xffffffffffffULL;
+		count = range >> 48;
+		if (!count)
+			continue;
+		if (lba + count > d->max_sectors)
+			return emu_fail(tf, EMU_ERR_IDNF);
+		if (emu_zero_sectors(d, lba, count))
+			return emu_fail(tf, EMU_ERR_ABRT);
+		emu_clear_bad(d, lba, count);
+	}
+	return 0;
+}
+
+static void emu_sanitize_step (struct emu_dev *d)
+{
+	__u64 per_step = (d->native_sectors + EMU_SANITIZE_STEPS - 1) / EMU_SANITIZE_STEPS;
+	__u64 lba = per_step * d->sanitize_step, n;
+
+	if (lba < d->native_sectors) {
+		n = (lba + per_step > d->native_sectors) ? d->native_sectors - lba : per_step;
+		if (d->sanitize_feature == SANITIZE_OVERWRITE_EXT) {
+			__u8 buf[EMU_SECTOR_BYTES];
+			unsigned int i;
+
+			for (i = 0; i < sizeof(buf); i += 4)
+				memcpy(buf + i, &d->sanitize_pattern, 4);
+			for (; n; --n, ++lba)
+				emu_rw_sectors(d, 1, buf, lba, 1);
+		} else {
+			emu_zero_sectors(d, lba, n);
+		}
+	}
+	if (++d->sanitize_step >= EMU_SANITIZE_STEPS) {
+		d->sanitize_running   = 0;
+		d->sanitize_succeeded = 1;
+		d->nbad = 0;
+		fdatasync(d->bfd);
+	}
+}
+
+static int emu_sanitize_fail (struct ata_tf *tf, __u8 reason)
+{
+	tf->lob.lbal = reason;
+	return emu_fail(tf, EMU_ERR_ABRT);
+}
+
+static int emu_sanitize (struct emu_dev *d, struct ata_tf *tf)
+{
+	__u16 feature = tf->lob.feat | (tf->hob.feat << 8);
+	__u64 lba = tf_to_lba(tf);
+	__u32 key = lba;
+	__u16 progress;
+
+	tf->is_lba48 = 1;
+	switch (feature) {
+	case SANITIZE_STATUS_EXT:
+		if (d->sanitize_running)
+			emu_sanitize_step(d);
+		break;
+	case SANITIZE_FREEZE_LOCK_EXT:
+		if (key != SANITIZE_FREEZE_LOCK_KEY)
+			return emu_sanitize_fail(tf, SANITIZE_ERR_CMD_UNSUCCESSFUL);
+		if (d->sanitize_antifreeze)
+			return emu_sanitize_fail(tf, SANITIZE_ERR_ANTIFREEZE_LOCK);
+		d->sanitize_frozen = 1;
+		break;
+	case SANITIZE_ANTIFREEZE_LOCK_EXT:
+		if (key != SANITIZE_ANTIFREEZE_LOCK_KEY)
+			return emu_sanitize_fail(tf, SANITIZE_ERR_CMD_UNSUCCESSFUL);
+		d->sanitize_antifreeze = 1;
+		break;
+	case SANITIZE_CRYPTO_SCRAMBLE_EXT:
+	case SANITIZE_BLOCK_ERASE_EXT:
+	case SANITIZE_OVERWRITE_EXT:
+		if (d->sanitize_frozen)
+			return emu_sanitize_fail(tf, SANITIZE_ERR_DEVICE_IN_FROZEN);
+		if ((feature == SANITIZE_CRYPTO_SCRAMBLE_EXT && key != SANITIZE_CRYPTO_SCRAMBLE_KEY)
+		 || (feature == SANITIZE_BLOCK_ERASE_EXT     && key != SANITIZE_BLOCK_ERASE_KEY)
+		 || (feature == SANITIZE_OVERWRITE_EXT       && (lba >> 32) != SANITIZE_OVERWRITE_KEY)
+		 || d->read_only || d->sanitize_running)
+			return emu_sanitize_fail(tf, SANITIZE_ERR_CMD_UNSUCCESSFUL);
+		d->sanitize_running   = 1;
+		d->sanitize_succeeded = 0;
+		d->sanitize_feature   = feature;
+		d->sanitize_pattern   = key;
+		d->sanitize_step      = 0;
+		break;
+	default:
+		return emu_sanitize_fail(tf, SANITIZE_ERR_CMD_UNSUPPORTED);
+	}
+	progress = d->sanitize_running ? (0xffff * d->sanitize_step) / EMU_SANITIZE_STEPS : 0xffff;
+	tf->lob.lbal  = progress;
+	tf->lob.lbam  = progress >> 8;
+	tf->hob.nsect = (d->sanitize_running    ? SANITIZE_FLAG_OPERATION_IN_PROGRESS : 0)
+		      | (d->sanitize_succeeded  ? SANITIZE_FLAG_OPERATION_SUCCEEDED   : 0)
+		      | (d->sanitize_frozen     ? SANITIZE_FLAG_DEVICE_IN_FROZEN      : 0)
+		      | (d->sanitize_antifreeze ? SANITIZE_FLAG_ANTIFREEZE_BIT        : 0);
+	return 0;
+}
+
+/*
+ * SMART: just enough for RETURN STATUS and the SCT status page (temperature).
+ */
+static int emu_smart (struct ata_tf *tf, int rw, __u8 *data, unsigned int data_bytes)
+{
+	switch (tf->lob.feat) {
+	case 0xd8:	/* ENABLE OPERATIONS */
+	case 0xda:	/* RETURN STATUS */
+		tf->lob.lbam = 0x4f;
+		tf->lob.lbah = 0xc2;
+		return 0;
+	case 0xd5:	/* READ LOG */
+		if (rw || tf->lob.lbal != 0xe0 || !data || data_bytes < EMU_SECTOR_BYTES)
+			break;
+		data[0]   = 3;	/* SCT status format version */
+		data[200] = EMU_TEMPERATURE;
+		data[201] = EMU_TEMPERATURE - 5;
+		data[202] = EMU_TEMPERATURE + 5;
+		data[203] = EMU_TEMPERATURE - 10;
+		data[204] = EMU_TEMPERATURE + 10;
+		return 0;
+	}
+	return emu_fail(tf, EMU_ERR_ABRT);
+}
+
+static int emu_command (struct emu_dev *d, int rw, struct ata_tf *tf, void *data, unsigned int data_bytes)
+{
+	__u64 lba, nsect;
+
+	if (d->sanitize_running && tf->command != ATA_OP_SANITIZE && tf->command != ATA_OP_IDENTIFY
+	 && tf->command != ATA_OP_CHECKPOWERMODE1 && tf->command != ATA_OP_CHECKPOWERMODE2)
+		return emu_fail(tf, EMU_ERR_ABRT);
+
+	switch (tf->command) {
+	case ATA_OP_IDENTIFY:
+		if (!data || data_bytes < EMU_SECTOR_BYTES)
+			break;
+		emu_build_identify(d);
+		memcpy(data, d->id, EMU_SECTOR_BYTES);
+		if (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__) {
+			__u16 *w = data;
+			unsigned int i;
+			for (i = 0; i < 256; ++i)
+				w[i] = __builtin_bswap16(w[i]);
+		}
+		return 0;
+	case ATA_OP_READ_PIO:
+	case ATA_OP_READ_PIO_ONCE:
+	case ATA_OP_READ_PIO_EXT:
+	case ATA_OP_READ_DMA:
+	case ATA_OP_READ_DMA_EXT:
+		d->power = EMU_POWER_ACTIVE;
+		return emu_read_write(d, 0, 0, tf, data, data_bytes);
+	case ATA_OP_WRITE_PIO:
+	case ATA_OP_WRITE_PIO_EXT:
+	case ATA_OP_WRITE_DMA:
+	case ATA_OP_WRITE_DMA_EXT:
+		d->power = EMU_POWER_ACTIVE;
+		return emu_read_write(d, 1, 0, tf, data, data_bytes);
+	case ATA_OP_READ_VERIFY:
+	case ATA_OP_READ_VERIFY_ONCE:
+	case ATA_OP_READ_VERIFY_EXT:
+		d->power = EMU_POWER_ACTIVE;
+		return emu_read_write(d, 0, 1, tf, NULL, 0);
+	case ATA_OP_WRITE_UNC_EXT:
+		lba   = tf_to_lba(tf);
+		nsect = tf->lob.nsect | (tf->hob.nsect << 8);
+		if (!nsect)
+			nsect = 65536;
+		if (lba + nsect > d->max_sectors)
+			return emu_fail(tf, EMU_ERR_IDNF);
+		if (emu_add_bad(d, lba, nsect))
+			break;
+		return 0;
+	case ATA_OP_READ_LOG_EXT:
+	case ATA_OP_READ_LOG_DMA_EXT:
+		return emu_read_log(d, tf, data, data_bytes);
+	case ATA_OP_DSM:
+		return emu_dsm_trim(d, tf, data, data_bytes);
+	case ATA_OP_SANITIZE:
+		return emu_sanitize(d, tf);
+	case ATA_OP_SMART:
+		return emu_smart(tf, rw, data, data_bytes);
+	case ATA_OP_READ_NATIVE_MAX:
+	case ATA_OP_READ_NATIVE_MAX_EXT:
+		tf->is_lba48 = (tf->command == ATA_OP_READ_NATIVE_MAX_EXT);
+		emu_set_lba(tf, d->native_sectors - 1);
+		return 0;
+	case ATA_OP_SET_MAX_EXT:
+		lba = tf_to_lba(tf);
+		if (lba >= d->native_sectors)
+			return emu_fail(tf, EMU_ERR_IDNF);
+		d->max_sectors = lba + 1;
+		emu_build_identify(d);
+		return 0;
+	case ATA_OP_CHECKPOWERMODE1:
+	case ATA_OP_CHECKPOWERMODE2:
+		tf->lob.nsect = (d->power == EMU_POWER_ACTIVE) ? 0xff : (d->power == EMU_POWER_IDLE) ? 0x80 : 0x00;
+		return 0;
+	case ATA_OP_IDLEIMMEDIATE:
+	case ATA_OP_SETIDLE:
+		d->power = EMU_POWER_IDLE;
+		return 0;
+	case ATA_OP_STANDBYNOW1:
+	case ATA_OP_STANDBYNOW2:
+		d->power = EMU_POWER_STANDBY;
+		return 0;
+	case ATA_OP_SLEEPNOW1:
+	case ATA_OP_SLEEPNOW2:
+		d->power = EMU_POWER_SLEEP;
+		return 0;
+	case ATA_OP_FLUSHCACHE:
+	case ATA_OP_FLUSHCACHE_EXT:
+		if (!d->read_only)
+			fdatasync(d->bfd);
+		return 0;
+	case ATA_OP_SETFEATURES:
+		switch (tf->lob.feat) {
+		case 0x02: d->write_cache = 1; return 0;
+		case 0x82: d->write_cache = 0; return 0;
+		case 0xaa: d->look_ahead  = 1; return 0;
+		case 0x55: d->look_ahead  = 0; return 0;
+		case 0x03: return 0;	/* set transfer mode */
+		}
+		break;
+	case ATA_OP_SET_MULTIPLE:
+		return 0;
+	}
+	return emu_fail(tf, EMU_ERR_ABRT);
+}
+
+static void emu_delay (struct emu_dev *d)
+{
+	struct timespec ts;
+
+	if (!d->latency_us)
+		return;
+	ts.tv_sec  = d->latency_us / 1000000;
+	ts.tv_nsec = (d->latency_us % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+int emu_sg16 (int fd, int rw, int dma, struct ata_tf *tf,
+	void *data, unsigned int data_bytes, unsigned int timeout_secs)
+{
+	struct emu_dev *d = emu_lookup(fd);
+	int rc;
+
+	(void)dma;
+	(void)timeout_secs;
+	if (!d) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (data && data_bytes && !rw)
+		memset(data, 0, data_bytes);
+	if (d->verbose)
+		fprintf(stderr, "EMU: ata_op=0x%02x feat=0x%02x nsect=%u lba=%llu bytes=%u\n",
+			tf->command, tf->lob.feat, tf->lob.nsect | (tf->is_lba48 ? tf->hob.nsect << 8 : 0),
+			tf_to_lba(tf), data_bytes);
+	emu_delay(d);
+
+	tf->status = EMU_STAT_DRDY | EMU_STAT_DSC;
+	tf->error  = 0;
+	if (d->abort_every && (++d->ncommands % d->abort_every) == 0) {
+		++d->injected_errors;
+		rc = emu_fail(tf, EMU_ERR_ABRT);
+	} else {
+		rc = emu_command(d, rw, tf, data, data_bytes);
+	}
+	if (d->verbose && rc)
+		fprintf(stderr, "EMU: ata_op=0x%02x failed: status=0x%02x error=0x%02x\n", tf->command, tf->status, tf->error);
+	return rc;
+}
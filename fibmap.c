@@ -29,31 +29,48 @@ struct file_extent {
 	__u64 block_count;
 };
 
-static void handle_extent (struct file_extent ext, unsigned int sectors_per_block, __u64 start_lba)
+struct extent_walk {
+	hdparm_extent_fn	fn;
+	void			*arg;
+	unsigned int		sectors_per_block;
+	__u64			start_lba;
+	int			stopped;	/* non-zero return from fn */
+};
+
+static int handle_extent (struct extent_walk *w, struct file_extent ext)
 {
-	char lba_info[64], len_info[32];
-	__u64 begin_lba, end_lba;
-	__u64 nsectors = ext.block_count * sectors_per_block;
+	struct hdparm_extent e;
 
+	e.byte_offset = ext.byte_offset;
+	e.nsectors    = ext.block_count * w->sectors_per_block;
 	if (ext.first_block) {
-		begin_lba = start_lba + ( ext.first_block     * sectors_per_block);
-		end_lba   = start_lba + ((ext.last_block + 1) * sectors_per_block) - 1;
+		e.begin_lba = w->start_lba + ( ext.first_block     * w->sectors_per_block);
+		e.end_lba   = w->start_lba + ((ext.last_block + 1) * w->sectors_per_block) - 1;
 	} else {
-		begin_lba = end_lba = 0;
+		e.begin_lba = e.end_lba = 0;
 	}
+	w->stopped = w->fn(&e, w->arg);
+	return w->stopped;
+}
 
-	if (ext.first_block)
-		sprintf(lba_info, "%10llu %10llu", begin_lba, end_lba);
+int print_file_extent (const struct hdparm_extent *e, void *arg)
+{
+	char lba_info[64], len_info[32];
+
+	arg = arg;	/* unused */
+	if (e->begin_lba)
+		sprintf(lba_info, "%10llu %10llu", e->begin_lba, e->end_lba);
 	else
 		strcpy(lba_info, "      -          -   ");
-	if (!ext.first_block && !nsectors)
+	if (!e->begin_lba && !e->nsectors)
 		strcpy(len_info, "      -   ");
 	else
-		sprintf(len_info, "%10llu", nsectors);
-	printf("%12llu %s %s\n", ext.byte_offset, lba_info, len_info);
+		sprintf(len_info, "%10llu", e->nsectors);
+	printf("%12llu %s %s\n", e->byte_offset, lba_info, len_info);
+	return 0;
 }
 
-static int walk_fibmap (int fd, struct stat *st, unsigned int blksize, unsigned int sectors_per_block, __u64 start_lba)
+static int walk_fibmap (int fd, struct stat *st, unsigned int blksize, struct extent_walk *w)
 {
 	struct file_extent ext;
 	unsigned long num_blocks;
@@ -105,16 +122,15 @@ static int walk_fibmap (int fd, struct stat *st, unsigned int blksize, unsigned
 			/*
 			 * New extent: print previous extent (if any), and re-init the extent record.
 			 */
-			if (blk_idx)
-				handle_extent(ext, sectors_per_block, start_lba);
+			if (blk_idx && handle_extent(w, ext))
+				return w->stopped;
 			ext.first_block = blknum64;
 			ext.last_block  = blknum64 ? blknum64 : hole;
 			ext.block_count = 1;
 			ext.byte_offset = blk_idx * blksize;
 		}
 	}
-	handle_extent(ext, sectors_per_block, start_lba);
-	return 0;
+	return handle_extent(w, ext);
 }
 
 #define FE_COUNT	8000
@@ -150,10 +166,9 @@ struct fs_s {
 
 #define FIEMAP	_IOWR('f', 11, struct fm_s)
 
-static int walk_fiemap (int fd, unsigned int sectors_per_block, __u64 start_lba, unsigned int sector_bytes)
+static int walk_fiemap (int fd, unsigned int blksize, struct extent_walk *w)
 {
 	unsigned int i, done = 0;
-	unsigned int blksize = sectors_per_block * sector_bytes;
 	struct fs_s fs;
 
 	memset(&fs, 0, sizeof(fs));
@@ -192,7 +207,8 @@ static int walk_fiemap (int fd, unsigned int sectors_per_block, __u64 start_lba,
 					ext.last_block  = phy_blk + ext_len - 1;
 					ext.block_count = ext_len;
 				}
-				handle_extent(ext, sectors_per_block, start_lba);
+				if (handle_extent(w, ext))
+					return w->stopped;
 
 				if (fs.fe[i].flags & FE_FLAG_LAST) {
 					/*
@@ -215,64 +231,103 @@ static int walk_fiemap (int fd, unsigned int sectors_per_block, __u64 start_lba,
 	return 0;
 }
 
-int do_filemap (const char *file_name)
+/*
+ * Open a regular file, and find where its filesystem begins on the device.
+ * Returns the fd, or -1 with the error in *err.
+ */
+static int open_file_map (const char *file_name, struct hdparm_file_map *map, struct stat *st, int *err)
 {
-	int fd, err;
-	struct stat st;
-	__u64 start_lba = 0;
-	unsigned int sectors_per_block, blksize, sector_bytes;
+	int fd;
 
 	if ((fd = open(file_name, O_RDONLY)) == -1) {
-		err = errno;
+		*err = errno;
 		perror(file_name);
-		return err;
+		return -1;
 	}
-	if (fstat(fd, &st) == -1) {
-		err = errno;
+	if (fstat(fd, st) == -1) {
+		*err = errno;
 		perror(file_name);
-		return err;
+		goto fail;
 	}
-	if (!S_ISREG(st.st_mode)) {
+	if (!S_ISREG(st->st_mode)) {
 		fprintf(stderr, "%s: not a regular file\n", file_name);
-		close(fd);
-		return EINVAL;
+		*err = EINVAL;
+		goto fail;
 	}
 
 	/*
 	 * Get the filesystem starting LBA:
 	 */
-	err = get_dev_t_geometry(st.st_dev, NULL, NULL, NULL, &start_lba, NULL, &sector_bytes);
-	if (err) {
-		close(fd);
-		return err;
-	}
-	if (start_lba == START_LBA_UNKNOWN) {
+	map->start_lba = 0;
+	*err = get_dev_t_geometry(st->st_dev, NULL, NULL, NULL, &map->start_lba, NULL, &map->sector_bytes);
+	if (*err)
+		goto fail;
+	if (map->start_lba == START_LBA_UNKNOWN) {
 		fprintf(stderr, "Unable to determine start offset LBA for device, aborting.\n");
-		close(fd);
-		return EIO;
+		*err = EIO;
+		goto fail;
 	}
-	if((err=ioctl(fd,FIGETBSZ,&blksize))){
+	if((*err=ioctl(fd,FIGETBSZ,&map->blksize))){
 		fprintf(stderr, "Unable to determine block size, aborting.\n");
-		close(fd);
-		return err;
+		goto fail;
 	};
-	sectors_per_block = blksize / sector_bytes;
-	printf("\n%s:\n filesystem blocksize %u, begins at LBA %llu;"
-	       " assuming %u byte sectors.\n",
-	       file_name, blksize, start_lba, sector_bytes);
-	printf("%12s %10s %10s %10s\n", "byte_offset", "begin_LBA", "end_LBA", "sectors");
+	return fd;
+fail:
+	close(fd);
+	return -1;
+}
+
+static int walk_file_map (int fd, struct stat *st, struct hdparm_file_map *map, hdparm_extent_fn fn, void *arg)
+{
+	struct extent_walk w;
+	int err;
 
-	if (st.st_size == 0) {
+	w.fn = fn;
+	w.arg = arg;
+	w.sectors_per_block = map->blksize / map->sector_bytes;
+	w.start_lba = map->start_lba;
+	w.stopped = 0;
+
+	if (st->st_size == 0) {
 		struct file_extent ext;
 		memset(&ext, 0, sizeof(ext));
-		handle_extent(ext, sectors_per_block, start_lba);
-		close(fd);
-		return 0;
+		return handle_extent(&w, ext);
 	}
 
-	err = walk_fiemap(fd, sectors_per_block, start_lba, sector_bytes);
-	if (err)
-		err = walk_fibmap(fd, &st, blksize, sectors_per_block, start_lba);
+	err = walk_fiemap(fd, map->blksize, &w);
+	if (err && !w.stopped)
+		err = walk_fibmap(fd, st, map->blksize, &w);
+	return err;
+}
+
+int hdparm_map_file (const char *path, struct hdparm_file_map *map, hdparm_extent_fn fn, void *arg)
+{
+	struct stat st;
+	int fd, err = 0;
+
+	fd = open_file_map(path, map, &st, &err);
+	if (fd == -1)
+		return err;
+	err = walk_file_map(fd, &st, map, fn, arg);
+	close(fd);
+	return err;
+}
+
+int do_filemap (const char *file_name)
+{
+	struct hdparm_file_map map;
+	struct stat st;
+	int fd, err = 0;
+
+	fd = open_file_map(file_name, &map, &st, &err);
+	if (fd == -1)
+		return err;
+	printf("\n%s:\n filesystem blocksize %u, begins at LBA %llu;"
+	       " assuming %u byte sectors.\n",
+	       file_name, map.blksize, map.start_lba, map.sector_bytes);
+	printf("%12s %10s %10s %10s\n", "byte_offset", "begin_LBA", "end_LBA", "sectors");
+
+	walk_file_map(fd, &st, &map, print_file_extent, NULL);
 	close (fd);
 	return 0;
 }
@@ -50,16 +50,18 @@ static int get_driver_major (const char *driver, unsigned int *major)
 	return err;
 }
 
+/*
+ * The same for every device, so it is looked up once per process;
+ * threads which race to do so just store the same value.
+ */
 static unsigned int md_major (void)
 {
 	static unsigned int maj = 0;
+	unsigned int val = __atomic_load_n(&maj, __ATOMIC_RELAXED);
 
-	if (!maj) {
-		unsigned int val;
-		if (0 == get_driver_major("md", &val))
-			maj = val;
-	}
-	return maj;
+	if (!val && 0 == get_driver_major("md", &val))
+		__atomic_store_n(&maj, val, __ATOMIC_RELAXED);
+	return val;
 }
 
 int fd_is_raid (int fd)
@@ -80,7 +82,13 @@ static int get_sector_count (int fd, __u64 *nsectors)
 	int		err;
 	unsigned int	nsects32 = 0;
 	__u64		nbytes64 = 0;
+	struct stat	st;
 
+	/* an image file (eg. with --emulate): sysfs would describe the disk holding it */
+	if (0 == fstat(fd, &st) && S_ISREG(st.st_mode)) {
+		*nsectors = st.st_size / 512;
+		return 0;
+	}
 	if (0 == sysfs_get_attr(fd, "size", "%llu", nsectors, NULL, 0))
 		return 0;
 #ifdef BLKGETSIZE64
@@ -143,8 +151,8 @@ static int get_raid1_start_lba (int fd, __u64 *start_lba)
 int get_dev_geometry (int fd, __u32 *cyls, __u32 *heads, __u32 *sects,
 				__u64 *start_lba, __u64 *nsectors)
 {
-	static struct local_hd_geometry      g;
-	static struct local_hd_big_geometry bg;
+	struct local_hd_geometry      g;
+	struct local_hd_big_geometry bg;
 	int err = 0, try_getgeo_big_first = 1;
 	int sector_bytes = get_current_sector_size(fd);
 
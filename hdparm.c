@@ -14,6 +14,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
 #include <endian.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -21,6 +24,7 @@
 #include <sys/time.h>
 #include <sys/times.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <sys/mount.h>
 #include <sys/mman.h>
 #include <sys/user.h>
@@ -48,13 +52,25 @@ extern const char *minor_str[];
 #define CDROM_SELECT_SPEED	0x5322
 #endif
 
-#define TIMING_BUF_MB		2
-#define TIMING_BUF_BYTES	(TIMING_BUF_MB * 1024 * 1024)
-
 char *progname;
-int verbose = 0;
-int prefer_ata12 = 0;
+extern int verbose;		/* libhdparm.c */
+extern int prefer_ata12;	/* libhdparm.c */
 static int do_defaults = 0, do_flush = 0, do_ctimings, do_timings = 0;
+static int do_write_timings = 0, do_random_write_timings = 0;
+static int do_tune_readahead = 0, apply_tuned_readahead = 0;
+static int do_short_stroke = 0, apply_short_stroke = 0;
+static double short_stroke_MBps = 0, short_stroke_p99_ms = 0;
+static int check_alignment = 0, measure_alignment_penalty = 0;
+static int do_zones = 0, do_zone_timings = 0, zone_mgmt_op = -1, zone_mgmt_all = 0;
+static __u64 zone_timings_count = 32, zone_mgmt_lba = 0;
+static char *baseline_path = NULL;
+static int baseline_save = 0;
+static __u64 baseline_threshold = 90;
+static int timing_per_node = 0;
+static __u64 timing_cpu = ~0ULL, timing_node = ~0ULL;
+static __u64 timings_duration = 0, timings_iterations = 0;
+static __u64 timings_repeat = 0, timings_warmup = ~0ULL;	/* ~0: not given, 1 warm-up run */
+static double timings_until_stable = 0;
 static int do_identity = 0, get_geom = 0, noisy = 1, quiet = 0;
 static int do_flush_wcache = 0;
 
@@ -95,11 +111,19 @@ static int set_security   = 0;
 static int do_dco_freeze = 0, do_dco_restore = 0, do_dco_identify = 0, do_dco_setmax = 0;
 static unsigned int security_command = ATA_OP_SECURITY_UNLOCK;
 
-static char security_password[33], *fwpath, *raw_identify_path;
+static char security_password[33], *fwpath, *raw_identify_path, *query_fields;
 
 static int do_sanitize = 0;
 static __u16 sanitize_feature = 0;
 static __u32 ow_pattern = 0;
+static int erase_monitor = 0;
+static int hpa_audit = 0;
+static __u64 hpa_audit_timeout = 30;
+static int set_monitor_interval = 0;
+static __u64 monitor_interval = 10, monitor_count = 0;
+static int get_device_stats = 0;
+static int get_sct_temp = 0;
+static int get_phy_events = 0, reset_phy_events = 0;
 static const char *sanitize_states_str[SANITIZE_STATE_NUMBER] = {
 	"SD0 Sanitize Idle",
 	"SD1 Sanitize Frozen",
@@ -136,9 +160,17 @@ static int   erase_sectors = 0;
 static __u64 erase_sectors_addr = ~0ULL;
 #endif
 
-static struct sector_range_s *trim_sector_ranges = NULL;
+static struct hdparm_lba_range *trim_sector_ranges = NULL;
 static int   trim_sector_ranges_count = 0;
 static int   trim_from_stdin = 0;
+static int   repair_from_stdin = 0, repair_reverify = 0;
+static char *replay_path = NULL;
+static int   replay_writes = 0;
+static double replay_speedup = 1.0;
+static __u64 replay_qdepth = 1;
+static int   emulate = 0;
+static __u64 emulate_latency = 0;
+static char *emulate_errors = NULL;
 static int   do_set_sector_size = 0;
 static __u64 new_sector_size = 0;
 #define SET_SECTOR_SIZE "set-sector-size"
@@ -148,6 +180,8 @@ static __u64 write_sector_addr = ~0ULL;
 
 static int   read_sector = 0;
 static __u64 read_sector_addr = ~0ULL;
+static int   read_sectors = 0, read_sectors_hex = 0;
+static __u64 read_sectors_addr = 0, read_sectors_count = 0;
 
 static int   set_max_sectors = 0, set_max_permanent, get_native_max_sectors = 0;
 static __u64 set_max_addr = 0;
@@ -182,7 +216,6 @@ const char *cfg_str[] =
 };
 
 const char *SlowMedFast[]	= {"slow", "medium", "fast", "eide", "ata"};
-const char *BuffType[4]		= {"unknown", "1Sect", "DualPort", "DualPortCache"};
 
 #define YN(b)	(((b)==0)?"no":"yes")
 
@@ -223,7 +256,9 @@ static void flush_buffer_cache (int fd)
 	fsync(fd);				/* flush buffers */
 	fdatasync(fd);				/* flush buffers */
 	sync();
-	if (ioctl(fd, BLKFLSBUF, NULL))		/* do it again, big time */
+	if (emu_is_emulated(fd))		/* --emulate: drop the image file's cached pages */
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	else if (ioctl(fd, BLKFLSBUF, NULL))	/* do it again, big time */
 		perror("BLKFLSBUF failed");
 	else
 		do_drive_cmd(fd, NULL, 0);	/* IDE: await completion */
@@ -239,137 +274,188 @@ static int seek_to_zero (int fd)
 	return 0;
 }
 
-static int read_big_block (int fd, char *buf)
+static void print_timing_result (double total_MB, double elapsed)
 {
-	int i, rc;
-	if ((rc = read(fd, buf, TIMING_BUF_BYTES)) != TIMING_BUF_BYTES) {
-		if (rc) {
-			if (rc == -1)
-				perror("read() failed");
-			else
-				fprintf(stderr, "read(%u) returned %u bytes\n", TIMING_BUF_BYTES, rc);
-		} else {
-			fputs ("read() hit EOF - device too small\n", stderr);
+	if ((total_MB / elapsed) > 1.0)  /* more than 1MB/s */
+		printf("%3.0f MB in %5.2f seconds = %6.2f MB/sec\n",
+			total_MB, elapsed, total_MB / elapsed);
+	else
+		printf("%3.0f MB in %5.2f seconds = %6.2f kB/sec\n",
+			total_MB, elapsed, total_MB / elapsed * 1024);
+}
+
+/*
+ * Decide whether a timing loop should keep going: --iterations and
+ * --duration override the default run time of each mode.
+ */
+static int timing_continue (double elapsed, unsigned int iterations, double default_secs)
+{
+	if (timings_iterations && iterations >= timings_iterations)
+		return 0;
+	if (timings_duration)
+		return elapsed < timings_duration;
+	if (timings_iterations)
+		return 1;
+	return elapsed < default_secs;
+}
+
+/*
+ * Run a timing function once, or with --repeat/--until-stable repeatedly
+ * (after --warmup discarded runs), and summarize the results.
+ * The timing buffer is allocated and settled just once for all of the runs.
+ */
+#define MAX_TIMING_RUNS	1000
+#define UNTIL_STABLE_MAX_RUNS	20	/* --until-stable without --repeat */
+
+typedef int (*timing_run_fn) (int fd, char *buf, double *MBps);
+
+static int repeat_timings (int fd, char *buf, const char *label, timing_run_fn run, int flush_between, double *result)
+{
+	static double results[MAX_TIMING_RUNS];
+	unsigned int n = 0, w, max_runs, warmup;
+	struct run_stats st;
+	double MBps;
+	int err;
+
+	if (!timings_repeat && !timings_until_stable) {
+		printf("%s", label);
+		fflush(stdout);
+		err = run(fd, buf, &MBps);
+		*result = MBps;
+		return err;
+	}
+	max_runs = timings_repeat ? timings_repeat : UNTIL_STABLE_MAX_RUNS;
+	if (max_runs > MAX_TIMING_RUNS)
+		max_runs = MAX_TIMING_RUNS;
+	warmup = (timings_warmup == ~0ULL) ? 1 : timings_warmup;
+	for (w = 0; w < warmup + max_runs; ++w) {
+		if (w && flush_between)
+			flush_buffer_cache(fd);
+		printf("%s", label);
+		if (w < warmup)
+			printf("(warm-up) ");
+		fflush(stdout);
+		if ((err = run(fd, buf, &MBps)))
+			return err;
+		if (w < warmup)
+			continue;
+		results[n++] = MBps;
+		if (timings_until_stable && n >= 3) {
+			compute_run_stats(results, n, &st);
+			if (st.cv * 100 <= timings_until_stable)
+				break;
 		}
-		return EIO;
 	}
-	/* access all sectors of buf to ensure the read fully completed */
-	for (i = 0; i < TIMING_BUF_BYTES; i += 512)
-		buf[i] &= 1;
+	compute_run_stats(results, n, &st);
+	printf(" Summary of %u runs", n);
+	if (warmup)
+		printf(" (%u warm-up discarded)", warmup);
+	printf(": median %.2f MB/sec, mean %.2f, stddev %.2f (CV %.1f%%), 95%% CI %.2f .. %.2f MB/sec\n",
+		st.median, st.mean, st.stddev, st.cv * 100, st.mean - st.ci95, st.mean + st.ci95);
+	if (timings_until_stable && st.cv * 100 > timings_until_stable)
+		printf(" Results did not converge below %.1f%% CV within %u runs\n", timings_until_stable, n);
+	*result = st.median;
 	return 0;
 }
 
-static void *prepare_timing_buf (unsigned int len)
+/*
+ * Time limit for one libhdparm timing run: --duration if given,
+ * otherwise none with --iterations, otherwise the mode's default.
+ */
+static double timing_secs (double default_secs)
 {
-	unsigned int i;
-	__u8 *buf;
+	if (timings_duration)
+		return timings_duration;
+	return timings_iterations ? 0 : default_secs;
+}
 
-	buf = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
-	if (buf == MAP_FAILED) {
-		perror("could not allocate timing buf");
-		return NULL;
-	}
-	for (i = 0; i < len; i += 4096)
-		buf[i] = 0; /* guarantee memory is present/assigned */
-	if (-1 == mlock(buf, len)) {
-		perror("mlock() failed on timing buf");
-		munmap(buf, len);
-		return NULL;
-	}
-	mlockall(MCL_CURRENT|MCL_FUTURE); // don't care if this fails on low-memory machines
-	sync();
+static int time_cache_run (int fd, char *buf, double *MBps)
+{
+	struct hdparm_timing t;
+	int err;
 
-	/* give time for I/O to settle */
-	sleep(3);
-	return buf;
+	err = hdparm_time_cached_reads(fd, buf, timing_secs(2.0), timings_iterations, &t);
+	if (err)
+		return err;
+	print_timing_result(t.reads * TIMING_BUF_MB, t.seconds);
+	*MBps = t.MBps;
+	return 0;
 }
 
-static void time_cache (int fd)
+static struct timing_results timing_results;
+
+static int time_cache (int fd)
 {
-	char *buf;
-	struct itimerval e1, e2;
-	double elapsed, elapsed2;
-	unsigned int iterations, total_MB;
+	char *buf, label[64];
+	int err;
 
 	buf = prepare_timing_buf(TIMING_BUF_BYTES);
 	if (!buf)
-		return;
+		return ENOMEM;
 
-	/*
-	 * getitimer() is used rather than gettimeofday() because
-	 * it is much more consistent (on my machine, at least).
-	 */
-	setitimer(ITIMER_REAL, &(struct itimerval){{1000,0},{1000,0}}, NULL);
-	if (seek_to_zero (fd)) return;
-	if (read_big_block (fd, buf)) return;
-	printf(" Timing %scached reads:   ", (open_flags & O_DIRECT) ? "O_DIRECT " : "");
-	fflush(stdout);
+	if (seek_to_zero (fd)) {
+		err = EIO;
+		goto quit;
+	}
+	if ((err = read_big_block (fd, buf)))
+		goto quit;
+	if (numa_num_nodes() > 1)
+		sprintf(label, " Timing %scached reads (node %d): ", (open_flags & O_DIRECT) ? "O_DIRECT " : "", numa_node_of(buf));
+	else
+		sprintf(label, " Timing %scached reads:   ", (open_flags & O_DIRECT) ? "O_DIRECT " : "");
 
 	/* Clear out the device request queues & give them time to complete */
 	flush_buffer_cache(fd);
 	sleep(1);
 
-	/* Now do the timing */
-	iterations = 0;
-	getitimer(ITIMER_REAL, &e1);
-	do {
-		++iterations;
-		if (seek_to_zero (fd) || read_big_block (fd, buf))
-			goto quit;
-		getitimer(ITIMER_REAL, &e2);
-		elapsed = (e1.it_value.tv_sec - e2.it_value.tv_sec)
-		 + ((e1.it_value.tv_usec - e2.it_value.tv_usec) / 1000000.0);
-	} while (elapsed < 2.0);
-	total_MB = iterations * TIMING_BUF_MB;
-
-	elapsed = (e1.it_value.tv_sec - e2.it_value.tv_sec)
-	 + ((e1.it_value.tv_usec - e2.it_value.tv_usec) / 1000000.0);
+	err = repeat_timings(fd, buf, label, time_cache_run, 0, &timing_results.cached_MBps);
+	if (!err) {
+		timing_results.have_cached = 1;
+		flush_buffer_cache(fd);
+		sleep(1);
+	}
+quit:
+	munlockall();
+	munmap(buf, TIMING_BUF_BYTES);
+	return err;
+}
 
-	/* Now remove the lseek() and getitimer() overheads from the elapsed time */
-	getitimer(ITIMER_REAL, &e1);
-	do {
-		if (seek_to_zero (fd))
-			goto quit;
-		getitimer(ITIMER_REAL, &e2);
-		elapsed2 = (e1.it_value.tv_sec - e2.it_value.tv_sec)
-		 + ((e1.it_value.tv_usec - e2.it_value.tv_usec) / 1000000.0);
-	} while (--iterations);
+static unsigned int device_max_iterations;
 
-	elapsed -= elapsed2;
+/* the latest time_device() run, for the read latencies used by --baseline-* */
+static struct hdparm_timing device_timing;
 
-	if (total_MB >= elapsed)  /* more than 1MB/s */
-		printf("%3u MB in %5.2f seconds = %6.2f MB/sec\n",
-			total_MB, elapsed,
-			total_MB / elapsed);
-	else
-		printf("%3u MB in %5.2f seconds = %6.2f kB/sec\n",
-			total_MB, elapsed,
-			total_MB / elapsed * 1024);
+static int time_device_run (int fd, char *buf, double *MBps)
+{
+	unsigned int max_reads = device_max_iterations ? device_max_iterations : 1;
+	int err;
 
-	flush_buffer_cache(fd);
-	sleep(1);
-quit:
-	munlockall();
-	munmap(buf, TIMING_BUF_BYTES);
+	if (timings_iterations && timings_iterations < max_reads)
+		max_reads = timings_iterations;
+	err = hdparm_time_device_reads(fd, buf, set_timings_offset ? timings_offset : 0,
+					timing_secs(3.0), max_reads, &device_timing);
+	if (err)
+		return err;
+	print_timing_result(device_timing.reads * TIMING_BUF_MB, device_timing.seconds);
+	*MBps = device_timing.MBps;
+	return 0;
 }
 
 static int time_device (int fd)
 {
-	char *buf;
-	double elapsed;
-	struct itimerval e1, e2;
+	char *buf, label[64];
 	int err = 0;
-	unsigned int max_iterations = 1024, total_MB, iterations;
 
 	/*
 	 * get device size
 	 */
+	device_max_iterations = 1024;
 	if (do_ctimings || do_timings) {
 		__u64 nsectors;
 		do_flush = 1;
 		err = get_dev_geometry(fd, NULL, NULL, NULL, NULL, &nsectors);
 		if (!err)
-			max_iterations = nsectors / (2 * 1024) / TIMING_BUF_MB;
+			device_max_iterations = nsectors / (2 * 1024) / TIMING_BUF_MB;
 	}
 	buf = prepare_timing_buf(TIMING_BUF_BYTES);
 	if (!buf)
@@ -377,47 +463,371 @@ static int time_device (int fd)
 	if (err)
 		goto quit;
 
-	printf(" Timing %s disk reads", (open_flags & O_DIRECT) ? "O_DIRECT" : "buffered");
 	if (set_timings_offset)
-		printf(" (offset %llu GB)", timings_offset / 0x40000000ULL);
-	printf(": ");
+		sprintf(label, " Timing %s disk reads (offset %llu GB): ", (open_flags & O_DIRECT) ? "O_DIRECT" : "buffered",
+			timings_offset / 0x40000000ULL);
+	else
+		sprintf(label, " Timing %s disk reads: ", (open_flags & O_DIRECT) ? "O_DIRECT" : "buffered");
+
+	/* buffered reads must not be satisfied from the page cache filled by the previous run */
+	err = repeat_timings(fd, buf, label, time_device_run, !(open_flags & O_DIRECT), &timing_results.buffered_MBps);
+	if (!err) {
+		timing_results.have_buffered = 1;
+		timing_results.lat_p50_ms = device_timing.lat_p50_ms;
+		timing_results.lat_p99_ms = device_timing.lat_p99_ms;
+		timing_results.lat_max_ms = device_timing.lat_max_ms;
+	}
+quit:
+	munlockall();
+	if (buf)
+		munmap(buf, TIMING_BUF_BYTES);
+	return err;
+}
+
+/*
+ * Sequential read timings of individual zones of a zoned device, using
+ * the same reads as -t, from the start of each zone up to its write pointer
+ * (host-managed drives fail reads beyond it).  An evenly spaced sample of
+ * the readable zones is timed, or all of them with --zone-timings 0.
+ */
+#define ZONE_TIMING_READS	8	/* at most, per zone */
+
+static int time_zones (int fd)
+{
+	struct hd_zone *zones;
+	struct hdparm_timing t;
+	struct run_stats st;
+	unsigned int nzones, nreadable = 0, nsample, i, n = 0, *readable = NULL, lba_sectors;
+	double *MBps = NULL;
+	char *buf = NULL;
+	int sector_bytes = 0, err;
+
+	err = zone_report(fd, &zones, &nzones);
+	if (err)
+		return err;
+	if (ioctl(fd, BLKSSZGET, &sector_bytes) || sector_bytes < 512)
+		sector_bytes = 512;
+	lba_sectors = sector_bytes / 512;
+	readable = malloc(nzones * sizeof(*readable));
+	MBps = malloc(nzones * sizeof(*MBps));
+	if (!readable || !MBps) {
+		err = errno;
+		perror("malloc()");
+		goto quit;
+	}
+	for (i = 0; i < nzones; ++i) {
+		if (zone_readable_sectors(&zones[i]) * 512 >= TIMING_BUF_BYTES)
+			readable[nreadable++] = i;
+	}
+	if (!nreadable) {
+		printf(" no zones hold enough data to time (%u MB)\n", TIMING_BUF_MB);
+		goto quit;
+	}
+	nsample = (zone_timings_count && zone_timings_count < nreadable) ? zone_timings_count : nreadable;
+
+	buf = prepare_timing_buf(TIMING_BUF_BYTES);
+	if (!buf) {
+		err = ENOMEM;
+		goto quit;
+	}
+	flush_buffer_cache(fd);
+	printf(" Timing %s reads of %u of %u readable zones (up to %u MB each):\n",
+		(open_flags & O_DIRECT) ? "O_DIRECT" : "buffered", nsample, nreadable, ZONE_TIMING_READS * TIMING_BUF_MB);
+	printf("\t%8s %14s  %-9s %10s %8s %8s\n", "zone", "start LBA", "type", "MB/sec", "p50 ms", "p99 ms");
+	for (n = 0; n < nsample; ++n) {
+		struct hd_zone *z = &zones[readable[(__u64)n * nreadable / nsample]];
+		unsigned int max_reads = zone_readable_sectors(z) * 512 / TIMING_BUF_BYTES;
+
+		if (max_reads > ZONE_TIMING_READS)
+			max_reads = ZONE_TIMING_READS;
+		if ((err = hdparm_time_device_reads(fd, buf, z->start * 512, 0, max_reads, &t)))
+			goto quit;
+		MBps[n] = t.MBps;
+		printf("\t%8u %14llu  %-9s %10.2f %8.3f %8.3f\n", (unsigned int)(z - zones), z->start / lba_sectors,
+			zone_type_name(z->type), t.MBps, t.lat_p50_ms, t.lat_p99_ms);
+		fflush(stdout);
+	}
+	compute_run_stats(MBps, n, &st);
+	printf(" Zone read throughput: min %.2f, median %.2f, max %.2f MB/sec\n", st.min, st.median, st.max);
+quit:
+	if (buf) {
+		munlockall();
+		munmap(buf, TIMING_BUF_BYTES);
+	}
+	free(MBps);
+	free(readable);
+	free(zones);
+	return err;
+}
+
+/*
+ * Throughput at evenly spaced points across the device (outer to inner zones
+ * on rotating media), for comparison against a saved baseline.
+ * A single read per zone is at the mercy of any other I/O, so each zone
+ * is timed several times from the media, and the median is kept.
+ */
+#define ZONE_MAP_READS		4	/* TIMING_BUF_BYTES reads per sample */
+#define ZONE_MAP_SAMPLES	5
+
+static int measure_zone_map (int fd, struct timing_results *r)
+{
+	__u64 nsectors, dev_bytes, offset;
+	double samples[ZONE_MAP_SAMPLES];
+	struct hdparm_timer t;
+	struct run_stats st;
+	unsigned int z, n, i;
+	char *buf;
+	int err;
+
+	if ((err = get_dev_geometry(fd, NULL, NULL, NULL, NULL, &nsectors)))
+		return err;
+	dev_bytes = nsectors * 512;
+	if (dev_bytes < (__u64)BASELINE_ZONES * ZONE_MAP_READS * TIMING_BUF_BYTES)
+		return 0;	/* too small to be worth it */
+	buf = prepare_timing_buf(TIMING_BUF_BYTES);
+	if (!buf)
+		return ENOMEM;
+	printf(" Timing zone map:");
 	fflush(stdout);
+	for (z = 0; z < BASELINE_ZONES; ++z) {
+		offset = (dev_bytes - (__u64)ZONE_MAP_READS * TIMING_BUF_BYTES) / (BASELINE_ZONES - 1) * z;
+		offset &= ~((__u64)TIMING_BUF_BYTES - 1);
+		for (n = 0; n < ZONE_MAP_SAMPLES; ++n) {
+			flush_buffer_cache(fd);	/* each sample from the media, not the previous one's pages */
+			if (lseek64(fd, offset, SEEK_SET) == (off64_t)-1) {
+				err = errno;
+				perror("lseek() failed");
+				goto quit;
+			}
+			timer_start(&t);
+			for (i = 0; i < ZONE_MAP_READS; ++i) {
+				if ((err = read_big_block(fd, buf)))
+					goto quit;
+			}
+			samples[n] = (double)ZONE_MAP_READS * TIMING_BUF_MB / timer_stop(&t);
+		}
+		compute_run_stats(samples, ZONE_MAP_SAMPLES, &st);
+		r->zone_MBps[z] = st.median;
+		printf(" %.0f", r->zone_MBps[z]);
+		fflush(stdout);
+	}
+	r->nzones = z;
+	printf(" MB/sec\n");
+quit:
+	munlockall();
+	munmap(buf, TIMING_BUF_BYTES);
+	return err;
+}
+
+/*
+ * Sweep the fs readahead (BLKRASET) over a range of sizes, timing buffered
+ * sequential reads of a typical application size at each, with the page cache
+ * dropped in between.  The "knee" is the smallest readahead which gets within
+ * 5% of the best throughput; larger values just waste page cache.
+ */
+#define TUNE_RA_READ_BYTES	(16 * 1024)
+
+static int time_readahead_step (int fd, char *buf, __u64 max_bytes, double *MBps)
+{
+	struct hdparm_timer t;
+	double elapsed;
+	__u64 bytes = 0;
+	unsigned int reads = 0;
+	ssize_t n;
+	int err;
 
-	if (set_timings_offset && lseek64(fd, timings_offset, SEEK_SET) == (off64_t)-1) {
+	flush_buffer_cache(fd);
+	if (lseek64(fd, set_timings_offset ? timings_offset : 0, SEEK_SET) == (off64_t)-1) {
 		err = errno;
 		perror("lseek() failed");
+		return err;
+	}
+	timer_start(&t);
+	do {
+		n = read(fd, buf, TUNE_RA_READ_BYTES);
+		if (n <= 0) {
+			if (n == 0)
+				break;	/* EOF: report what we have */
+			err = errno;
+			perror("read() failed");
+			return err;
+		}
+		bytes += n;
+		++reads;
+		elapsed = timer_stop(&t);
+	} while (timing_continue(elapsed, reads, 3.0) && bytes < max_bytes);
+	elapsed = timer_stop(&t);
+	*MBps = bytes / elapsed / (1024 * 1024);
+	return 0;
+}
+
+static int tune_readahead (int fd, int apply)
+{
+	static const unsigned int ra_sizes[] = {0, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192};
+	const unsigned int nsizes = sizeof(ra_sizes) / sizeof(ra_sizes[0]);
+	double MBps[sizeof(ra_sizes) / sizeof(ra_sizes[0])], best = 0;
+	unsigned int i, knee = 0;
+	long orig_ra;
+	__u64 dev_bytes;
+	char *buf;
+	int err = 0;
+
+	if (open_flags & O_DIRECT) {
+		fprintf(stderr, " --tune-readahead cannot be used with --direct\n");
+		return EINVAL;
+	}
+	if (ioctl(fd, BLKRAGET, &orig_ra)) {
+		err = errno;
+		perror(" BLKRAGET failed");
+		return err;
+	}
+	if (ioctl(fd, BLKGETSIZE64, &dev_bytes)) {
+		err = errno;
+		perror(" BLKGETSIZE64 failed");
+		return err;
+	}
+	buf = prepare_timing_buf(TIMING_BUF_BYTES);
+	if (!buf)
+		return ENOMEM;
+
+	printf(" Tuning fs readahead with %ukB sequential reads (currently %ld sectors):\n", TUNE_RA_READ_BYTES / 1024, orig_ra);
+	for (i = 0; i < nsizes; ++i) {
+		if (ioctl(fd, BLKRASET, ra_sizes[i])) {
+			err = errno;
+			perror(" BLKRASET failed");
+			break;
+		}
+		printf("\treadahead %5u sectors (%5ukB): ", ra_sizes[i], ra_sizes[i] / 2);
+		fflush(stdout);
+		if ((err = time_readahead_step(fd, buf, dev_bytes, &MBps[i])))
+			break;
+		printf("%8.2f MB/sec\n", MBps[i]);
+		if (MBps[i] > best)
+			best = MBps[i];
+	}
+	munlockall();
+	munmap(buf, TIMING_BUF_BYTES);
+
+	if (!err) {
+		while (MBps[knee] < 0.95 * best)
+			++knee;
+		printf(" Knee of the curve: readahead = %u sectors (%ukB), %.2f MB/sec (best %.2f MB/sec)\n",
+			ra_sizes[knee], ra_sizes[knee] / 2, MBps[knee], best);
+	}
+	if (!err && apply) {
+		unsigned int ra_kb = ra_sizes[knee] / 2;
+
+		printf(" setting fs readahead to %u\n", ra_sizes[knee]);
+		if (ioctl(fd, BLKRASET, ra_sizes[knee]) && sysfs_set_attr(fd, "queue/read_ahead_kb", "%u", &ra_kb, 1)) {
+			err = EIO;
+			fprintf(stderr, " failed to set readahead\n");
+		}
+	} else if (ioctl(fd, BLKRASET, orig_ra)) {
+		int err2 = errno;
+		perror(" BLKRASET failed to restore readahead");
+		if (!err)
+			err = err2;
+	}
+	return err;
+}
+
+/*
+ * Sustained O_DIRECT write timing, sequential or random (4KiB at random aligned
+ * offsets), in the span from --offset to the end of the device; sequential writes
+ * wrap back to --offset.  Throughput is sampled every second, which shows
+ * where an SSD falls off its write cache onto native NAND speed.
+ * The buffer is filled with pseudo-random data, to defeat compressing controllers.
+ */
+static int time_device_writes (const char *devname, int random_writes)
+{
+	unsigned int i, block = random_writes ? 4096 : TIMING_BUF_BYTES;
+	__u64 dev_bytes, base = 0, pos, blocks = 0, sample_blocks = 0, seed = 0x9e3779b97f4a7c15ULL;
+	double elapsed, sample_start = 0, duration = timings_duration ? timings_duration : 30;
+	struct hdparm_timer t;
+	__u32 *buf;
+	int fd, err = 0;
+
+	fd = open(devname, O_WRONLY|O_DIRECT);
+	if (fd == -1) {
+		err = errno;
+		perror(devname);
+		return err;
+	}
+	if (ioctl(fd, BLKGETSIZE64, &dev_bytes)) {
+		err = errno;
+		perror(" BLKGETSIZE64 failed");
+		goto quit;
+	}
+	if (dev_bytes < TIMING_BUF_BYTES) {
+		fputs(" device too small for write timings\n", stderr);
+		err = EINVAL;
+		goto quit;
+	}
+	buf = prepare_timing_buf(TIMING_BUF_BYTES);
+	if (!buf) {
+		err = ENOMEM;
 		goto quit;
 	}
+	for (i = 0; i < TIMING_BUF_BYTES / sizeof(*buf); ++i) {
+		seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+		buf[i] = seed;
+	}
+	if (set_timings_offset)
+		base = (timings_offset / block) * block;
+	if (base + block > dev_bytes)
+		base = 0;
+	pos = base;
 
-	/*
-	 * getitimer() is used rather than gettimeofday() because
-	 * it is much more consistent (on my machine, at least).
-	 */
-	setitimer(ITIMER_REAL, &(struct itimerval){{1000,0},{1000,0}}, NULL);
+	printf(" Timing O_DIRECT %s disk writes", random_writes ? "random 4kB" : "sequential");
+	if (set_timings_offset)
+		printf(" (offset %llu GB)", base / 0x40000000ULL);
+	printf(" for %.0f seconds:\n", duration);
+	fflush(stdout);
 
-	/* Now do the timings for real */
-	iterations = 0;
-	getitimer(ITIMER_REAL, &e1);
+	timer_start(&t);
 	do {
-		++iterations;
-		if ((err = read_big_block(fd, buf)))
-			goto quit;
-		getitimer(ITIMER_REAL, &e2);
-		elapsed = (e1.it_value.tv_sec - e2.it_value.tv_sec)
-		 + ((e1.it_value.tv_usec - e2.it_value.tv_usec) / 1000000.0);
-	} while (elapsed < 3.0 && iterations < max_iterations);
+		if (random_writes) {
+			seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+			pos = base + (seed % ((dev_bytes - base) / block)) * block;
+		} else if (pos + block > dev_bytes) {
+			pos = base;
+		}
+		if (pwrite64(fd, buf, block, pos) != (ssize_t)block) {
+			err = errno ? errno : EIO;
+			perror(" write() failed");
+			break;
+		}
+		if (!random_writes)
+			pos += block;
+		++blocks;
+		++sample_blocks;
+		elapsed = timer_stop(&t);
+		if (elapsed - sample_start >= 1.0) {
+			double MB = (double)sample_blocks * block / (1024 * 1024), secs = timer_lap(&t);
+			printf("\t%5.0f s: %8.2f MB/sec", elapsed, MB / secs);
+			if (random_writes)
+				printf(", %8.0f IOPS", sample_blocks / secs);
+			putchar('\n');
+			fflush(stdout);
+			sample_start = elapsed;
+			sample_blocks = 0;
+		}
+	} while (timing_continue(elapsed, blocks, duration));
 
-	total_MB = iterations * TIMING_BUF_MB;
-	if ((total_MB / elapsed) > 1.0)  /* more than 1MB/s */
-		printf("%3u MB in %5.2f seconds = %6.2f MB/sec\n",
-			total_MB, elapsed, total_MB / elapsed);
-	else
-		printf("%3u MB in %5.2f seconds = %6.2f kB/sec\n",
-			total_MB, elapsed, total_MB / elapsed * 1024);
-quit:
+	/* include the time to drain the drive's write cache */
+	if (!err && fdatasync(fd))
+		err = errno;
+	if (!err) {
+		elapsed = timer_stop(&t);
+		printf(" Timing O_DIRECT disk writes: ");
+		print_timing_result((double)blocks * block / (1024 * 1024), elapsed);
+		if (random_writes)
+			printf(" %.0f IOPS\n", blocks / elapsed);
+	}
 	munlockall();
-	if (buf)
-		munmap(buf, TIMING_BUF_BYTES);
+	munmap(buf, TIMING_BUF_BYTES);
+quit:
+	close(fd);
 	return err;
 }
 
@@ -429,26 +839,42 @@ static void dmpstr (const char *prefix, unsigned int i, const char *s[], unsigne
 		printf("%s%s", prefix, s[i]);
 }
 
-static __u16 *id;
-
 #define SUPPORTS_ACS3(id) ((id)[80] & 0x400)
 #define SUPPORTS_AMAX_ADDR(id) (SUPPORTS_ACS3(id) && ((id)[119] & (1u << 8)))
 #define SUPPORTS_48BIT_ADDR(id) ((((id)[83] & 0xc400) == 0x4400) && ((id)[86] & 0x0400))
 
-static void get_identify_data (int fd);
+static __u16 *get_identify_data (int fd);
 
-static __u64 get_lba_capacity (__u16 *idw)
+/*
+ * Baselines are keyed by "model/serial", so they follow the drive between hosts/ports;
+ * devices without IDENTIFY data fall back to the device name.
+ */
+static void get_baseline_key (int fd, const char *devname, char *key, unsigned int keylen)
 {
-	__u64 nsects = ((__u32)idw[58] << 16) | idw[57];
+	__u16 *id;
+	char model[41], serial[21];
 
-	if (idw[49] & 0x200) {
-		nsects = ((__u32)idw[61] << 16) | idw[60];
-		if ((idw[83] & 0xc000) == 0x4000 && (idw[86] & 0x0400)) {
-			nsects = (__u64)idw[103] << 48 | (__u64)idw[102] << 32 |
-			         (__u64)idw[101] << 16 | idw[100];
-		}
+	id = get_identify_data(fd);
+	if (!id) {
+		snprintf(key, keylen, "%s", devname);
+		return;
 	}
-	return nsects;
+	id_to_string(&id[27], 20, model);
+	id_to_string(&id[10], 10, serial);
+	snprintf(key, keylen, "%s/%s", model, serial);
+}
+
+static int do_baseline (int fd, const char *devname)
+{
+	char key[80];
+	int err;
+
+	get_baseline_key(fd, devname, key, sizeof(key));
+	if (timing_results.have_buffered && (err = measure_zone_map(fd, &timing_results)))
+		return err;
+	if (baseline_save)
+		return baseline_save_results(baseline_path, key, &timing_results);
+	return baseline_check_results(baseline_path, key, &timing_results, baseline_threshold / 100.0);
 }
 
 static char *strip (char *s)
@@ -753,7 +1179,7 @@ static void interpret_xfermode (unsigned int xfermode)
 static unsigned int get_erase_timeout_secs (int fd, int enhanced)
 {
 	// Grab ID Data
-	get_identify_data(fd);
+	__u16 *id = get_identify_data(fd);
 
 	if (id == NULL) {
 		// ID pointer is invalid, return a default of twelve hours
@@ -826,18 +1252,51 @@ sanitize_error_output(struct hdio_taskfile * r)
 		fprintf(stderr, "Drive in %s state\n", sanitize_states_str[SANITIZE_OPERATION_FAILED_SD3]);
 }
 
-static void
+static int
+issue_sanitize (int fd, __u16 feature, __u64 lba, struct hdio_taskfile *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->cmd_req = TASKFILE_CMD_REQ_NODATA;
+	r->dphase  = TASKFILE_DPHASE_NONE;
+
+	r->oflags.bits.lob.command = 1;
+	r->oflags.bits.lob.feat    = 1;
+	r->oflags.bits.lob.lbal    = 1;
+	r->oflags.bits.lob.lbam    = 1;
+	r->oflags.bits.lob.lbah    = 1;
+	r->oflags.bits.hob.lbal    = 1;
+	r->oflags.bits.hob.lbam    = 1;
+	r->oflags.bits.hob.lbah    = 1;
+
+	r->lob.command = ATA_OP_SANITIZE;
+	r->lob.feat    = feature;
+	r->lob.lbal    = lba;
+	r->lob.lbam    = lba >>  8;
+	r->lob.lbah    = lba >> 16;
+	r->hob.lbal    = lba >> 24;
+	r->hob.lbam    = lba >> 32;
+	r->hob.lbah    = lba >> 40;
+
+	r->iflags.bits.lob.lbal    = 1;
+	r->iflags.bits.lob.lbam    = 1;
+	r->iflags.bits.hob.nsect   = 1;
+
+	return do_taskfile_cmd(fd, r, 10);
+}
+
+static int
 do_sanitize_cmd (int fd)
 {
+	__u16 *id;
 	int err = 0;
 	__u64 lba = 0;
 	const char *description;
 	int sanitize_state;
 	struct hdio_taskfile r;
 
-	get_identify_data(fd);
+	id = get_identify_data(fd);
 	if (!id)
-		exit(EIO);
+		return EIO;
 	if (id[59] & 0x1000) {
 
 		switch (sanitize_feature) {
@@ -866,37 +1325,11 @@ do_sanitize_cmd (int fd)
 				break;
 			default:
 				fprintf(stderr, "BUG in do_sanitize_cmd(), feat=0x%x\n", sanitize_feature);
-				exit(EINVAL);
+				return EINVAL;
 		}
 
-		memset(&r, 0, sizeof(r));
-		r.cmd_req = TASKFILE_CMD_REQ_NODATA;
-		r.dphase  = TASKFILE_DPHASE_NONE;
-
-		r.oflags.bits.lob.command = 1;
-		r.oflags.bits.lob.feat    = 1;
-		r.oflags.bits.lob.lbal    = 1;
-		r.oflags.bits.lob.lbam    = 1;
-		r.oflags.bits.lob.lbah    = 1;
-		r.oflags.bits.hob.lbal    = 1;
-		r.oflags.bits.hob.lbam    = 1;
-		r.oflags.bits.hob.lbah    = 1;
-
-		r.lob.command = ATA_OP_SANITIZE;
-		r.lob.feat    = sanitize_feature;
-		r.lob.lbal    = lba;
-		r.lob.lbam    = lba >>  8;
-		r.lob.lbah    = lba >> 16;
-		r.hob.lbal    = lba >> 24;
-		r.hob.lbam    = lba >> 32;
-		r.hob.lbah    = lba >> 40;
-
-		r.iflags.bits.lob.lbal    = 1;
-		r.iflags.bits.lob.lbam    = 1;
-		r.iflags.bits.hob.nsect   = 1;
-
 		printf("Issuing %s command\n", description);
-		if (do_taskfile_cmd(fd, &r, 10)) {
+		if (issue_sanitize(fd, sanitize_feature, lba, &r)) {
 			err = errno;
 			perror("SANITIZE failed");
 			sanitize_error_output(&r);
@@ -912,7 +1345,8 @@ do_sanitize_cmd (int fd)
 				case SANITIZE_OVERWRITE_EXT:
 				case SANITIZE_CRYPTO_SCRAMBLE_EXT:
 					printf("Operation started in background\n");
-					printf("You may use `--sanitize-status` to check progress\n");
+					if (!erase_monitor)
+						printf("You may use `--sanitize-status` to check progress\n");
 					break;
 				default:
 					//nothing here
@@ -921,15 +1355,189 @@ do_sanitize_cmd (int fd)
 		}
 	} else {
 		fprintf(stderr, "SANITIZE feature set is not supported\n");
-		exit(EINVAL);
+		err = EINVAL;
 	}
-	if (err)
-		exit(err);
+	return err;
 }
 
-static void
+/*
+ * Support for --erase-monitor: sanitize and security-erase operations are
+ * started on every listed drive, and then all of them are polled together
+ * until they finish, rather than one drive at a time.
+ */
+enum {
+	ERASE_JOB_RUNNING,
+	ERASE_JOB_SUCCEEDED,
+	ERASE_JOB_FAILED,
+};
+
+struct erase_job {
+	struct erase_job	*next;
+	const char		*devname;
+	const char		*op;
+	int			fd;
+	pid_t			pid;		/* security erase child, or 0 for sanitize */
+	int			state;
+	double			progress;	/* 0.0 .. 1.0 */
+	__u64			bytes;		/* device capacity */
+	unsigned int		estimate_secs;	/* security erase only */
+	struct timeval		start;
+	double			elapsed;
+};
+
+static struct erase_job *erase_jobs = NULL;
+
+/*
+ * Best guess at how long a security erase will really take, for progress reporting:
+ * the drive's own estimate when it gives one, else 1 second per 30MB of capacity.
+ */
+static unsigned int get_erase_estimate_secs (__u16 *idw, int enhanced)
+{
+	unsigned int t = idw[enhanced ? 90 : 89];
+
+	t &= (t & (1 << 15)) ? 0x7fff : 0x00ff;
+	if (t)
+		return t * 2 * 60;
+	return (get_lba_capacity(idw) / 2048ULL) / 30ULL;
+}
+
+static const char *sanitize_op_name (__u16 feature)
+{
+	switch (feature) {
+		case SANITIZE_BLOCK_ERASE_EXT:		return "block-erase";
+		case SANITIZE_OVERWRITE_EXT:		return "overwrite";
+		case SANITIZE_CRYPTO_SCRAMBLE_EXT:	return "crypto-scramble";
+	}
+	return "sanitize";
+}
+
+static struct erase_job *add_erase_job (int fd, const char *devname, const char *op, pid_t pid, unsigned int estimate_secs)
+{
+	struct dev_context *ctx = get_dev_context(fd);
+	struct erase_job *job, **tail;
+
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		int err = errno;
+		perror("calloc()");
+		exit(err);
+	}
+	job->devname = strdup(devname);
+	job->op = op;
+	job->pid = pid;
+	job->fd = pid ? -1 : dup(fd);	/* process_dev() closes the original */
+	job->state = ERASE_JOB_RUNNING;
+	job->estimate_secs = estimate_secs;
+	if (ctx && ctx->have_identify)
+		job->bytes = get_lba_capacity(ctx->identify) * get_current_sector_size(fd);
+	gettimeofday(&job->start, NULL);
+	for (tail = &erase_jobs; *tail; tail = &(*tail)->next);
+	*tail = job;
+	return job;
+}
+
+static void poll_sanitize_job (struct erase_job *job)
+{
+	struct hdio_taskfile r;
+
+	if (issue_sanitize(job->fd, SANITIZE_STATUS_EXT, 0, &r)) {
+		if (r.lob.lbal == SANITIZE_ERR_CMD_UNSUCCESSFUL)
+			job->state = ERASE_JOB_FAILED;
+		return;	/* otherwise a transient failure: try again next time */
+	}
+	if (get_sanitize_state(r.hob.nsect) == SANITIZE_OPERATION_IN_PROGRESS_SD2) {
+		unsigned int progress = (r.lob.lbam << 8) | r.lob.lbal;
+		job->progress = (progress + 1) / 65536.0;
+	} else if (r.hob.nsect & SANITIZE_FLAG_OPERATION_SUCCEEDED) {
+		job->state = ERASE_JOB_SUCCEEDED;
+		job->progress = 1.0;
+	} else {
+		job->state = ERASE_JOB_FAILED;
+	}
+}
+
+static void poll_security_erase_job (struct erase_job *job)
+{
+	int status;
+
+	if (waitpid(job->pid, &status, WNOHANG) == job->pid) {
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+			job->state = ERASE_JOB_SUCCEEDED;
+			job->progress = 1.0;
+		} else {
+			job->state = ERASE_JOB_FAILED;
+		}
+	} else if (job->estimate_secs) {
+		/* SECURITY ERASE UNIT reports no progress: extrapolate from the drive's estimate */
+		job->progress = job->elapsed / job->estimate_secs;
+		if (job->progress > 0.99)
+			job->progress = 0.99;
+	}
+}
+
+static void print_erase_jobs (void)
+{
+	struct erase_job *job;
+
+	if (isatty(1))
+		printf("\033[H\033[2J");	/* redraw the table in place */
+	printf("%-16s %-16s %-10s %7s %10s %10s %10s\n",
+		"device", "operation", "state", "done", "elapsed", "MB/sec", "ETA");
+	for (job = erase_jobs; job; job = job->next) {
+		static const char *states[] = {"running", "succeeded", "FAILED"};
+		char eta[32];
+		double mbps = 0;
+
+		if (job->state == ERASE_JOB_RUNNING && job->progress > 0) {
+			unsigned int secs = job->elapsed * (1.0 - job->progress) / job->progress;
+			sprintf(eta, "%u:%02u:%02u", secs / 3600, (secs / 60) % 60, secs % 60);
+		} else {
+			strcpy(eta, "-");
+		}
+		if (job->elapsed > 0)
+			mbps = (job->progress * job->bytes) / job->elapsed / 1000000.0;
+		printf("%-16s %-16s %-10s %6.2f%% %8.0fs %10.2f %10s\n",
+			job->devname, job->op, states[job->state], job->progress * 100.0,
+			job->elapsed, mbps, eta);
+	}
+	fflush(stdout);
+}
+
+static int run_erase_monitor (void)
+{
+	struct erase_job *job;
+	int running, failed;
+
+	do {
+		struct timeval now;
+
+		running = failed = 0;
+		gettimeofday(&now, NULL);
+		for (job = erase_jobs; job; job = job->next) {
+			if (job->state != ERASE_JOB_RUNNING)
+				continue;
+			job->elapsed = (now.tv_sec - job->start.tv_sec)
+				+ ((now.tv_usec - job->start.tv_usec) / 1000000.0);
+			if (job->pid)
+				poll_security_erase_job(job);
+			else
+				poll_sanitize_job(job);
+		}
+		for (job = erase_jobs; job; job = job->next) {
+			running += (job->state == ERASE_JOB_RUNNING);
+			failed  += (job->state == ERASE_JOB_FAILED);
+		}
+		print_erase_jobs();
+		if (running)
+			sleep(monitor_interval);
+	} while (running);
+	return failed ? EIO : 0;
+}
+
+static void
 do_set_security (int fd)
 {
+	__u16 *id;
 	int err = 0;
 	const char *description;
 	struct hdio_taskfile *r;
@@ -973,7 +1581,7 @@ do_set_security (int fd)
 			if (security_master) {
 				/* increment master-password revision-code */
 				__u16 revcode;
-				get_identify_data(fd);
+				id = get_identify_data(fd);
 				if (!id)
 					exit(EIO);
 				revcode = id[92];
@@ -1054,87 +1662,21 @@ do_set_security (int fd)
 		exit(err);
 }
 
-static __u8 last_identify_op = 0;
-
-static void get_identify_data (int fd)
+/*
+ * IDENTIFY data, kept in the device context: the drive is asked again only
+ * after invalidate_identify_data(), once something may have changed it.
+ */
+static __u16 *get_identify_data (int fd)
 {
-	static __u8 args[4+512];
-	int i;
-
-	if (id)
-		return;
-	memset(args, 0, sizeof(args));
-	last_identify_op = ATA_OP_IDENTIFY;
-	args[0] = last_identify_op;
-	args[3] = 1;	/* sector count */
-	if (do_drive_cmd(fd, args, 0)) {
-		prefer_ata12 = 0;
-		memset(args, 0, sizeof(args));
-		last_identify_op = ATA_OP_PIDENTIFY;
-		args[0] = last_identify_op;
-		args[3] = 1;	/* sector count */
-		if (do_drive_cmd(fd, args, 0)) {
-			perror(" HDIO_DRIVE_CMD(identify) failed");
-			return;
-		}
-	}
-	/* byte-swap the little-endian IDENTIFY data to match byte-order on host CPU */
-	id = (void *)(args + 4);
-	for (i = 0; i < 0x100; ++i) {
-		unsigned char *b = (unsigned char *)&id[i];
-		id[i] = b[0] | (b[1] << 8);	/* le16_to_cpu() */
-	}
+	return get_identify_words(fd, 0);
 }
 
-static int do_read_log (int fd, __u8 log_address, __u8 pagenr, void *buf)
+static void invalidate_identify_data (int fd)
 {
-	struct hdio_taskfile *r;
-	int err = 0;
+	struct dev_context *ctx = get_dev_context(fd);
 
-	r = malloc(sizeof(struct hdio_taskfile) + 512);
-	if (!r) {
-		err = errno;
-		perror("malloc()");
-		return err;
-	}
-
-	init_hdio_taskfile(r, ATA_OP_READ_LOG_EXT, RW_READ, LBA48_FORCE, log_address + (pagenr << 8), 1, 512);
-	if (do_taskfile_cmd(fd, r, timeout_15secs)) {
-		err = errno;
-	} else {
-		memcpy(buf, r->data, 512);
-	}
-	free(r);
-	return err;
-}
-
-
-int get_log_page_data (int fd, __u8 log_address, __u8 pagenr, __u8 *buf)
-{
-	static __u16 *page0 = NULL, page0_buf[512] = {0,};
-	int err;
-
-	get_identify_data(fd);
-	if (!id)
-		exit(EIO);
-	if ((id[84] && (1<<5)) == 0)
-		return -ENOENT;  /* READ_LOG_EXT not supported */
-	if (!page0) {
-		err = do_read_log(fd, 0, 0, page0_buf);
-		if (err) {
-			fprintf(stderr, "READ_LOG_EXT(0,0) failed: %s\n", strerror(err));
-			return -ENOENT;
-		}
-		page0 = page0_buf;
-	}
-	if (page0[log_address] <= pagenr)
-		return -ENOENT;
-	err = do_read_log(fd, log_address, pagenr, buf);
-	if (err) {
-		fprintf(stderr, "READ_LOG_EXT(0x%02x, %u) failed: %s\n", log_address, pagenr, strerror(err));
-		return -ENOENT;
-	}
-	return 0;
+	if (ctx)
+		ctx->have_identify = 0;
 }
 
 static void confirm_i_know_what_i_am_doing (const char *opt, const char *explanation)
@@ -1159,10 +1701,11 @@ static void confirm_please_destroy_my_drive (const char *opt, const char *explan
 
 static int flush_wcache (int fd)
 {
+	__u16 *id;
 	__u8 args[4] = {ATA_OP_FLUSHCACHE,0,0,0};
 	int err = 0;
 
-	get_identify_data(fd);
+	id = get_identify_data(fd);
 	if (id && (id[83] & 0xe000) == 0x6000)
 		args[0] = ATA_OP_FLUSHCACHE_EXT;
 	if (do_drive_cmd(fd, args, timeout_60secs)) {
@@ -1172,26 +1715,6 @@ static int flush_wcache (int fd)
 	return err;
 }
 
-static void dump_sectors (__u16 *w, unsigned int count, int raw, unsigned int sector_bytes)
-{
-	unsigned int i;
-
-	for (i = 0; i < (count*(sector_bytes/2)/8); ++i) {
-		if (raw) {
-			printf("%04x %04x %04x %04x %04x %04x %04x %04x\n",
-				w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7]);
-			w += 8;
-		} else {
-			int word;
-			for (word = 0; word < 8; ++word) {
-				unsigned char *b = (unsigned char *)w++;
-				printf("%02x%02x", b[0], b[1]);
-				putchar(word == 7 ? '\n' : ' ');
-			}
-		}
-	}
-}
-
 static int abort_if_not_full_device (int fd, __u64 lba, const char *devname, const char *msg)
 {
 	struct stat stat;
@@ -1201,6 +1724,8 @@ static int abort_if_not_full_device (int fd, __u64 lba, const char *devname, con
 
 	if (0 == fstat(fd, &stat) && S_ISCHR(stat.st_mode))
 		return 0; /* skip geometry test for character (non-block) devices; eg. /dev/sg* */
+	if (emu_is_emulated(fd))
+		return 0; /* --emulate: an image file is always a whole disk */
 	err = get_dev_geometry(fd, NULL, NULL, NULL, &start_lba, NULL);
 	if (err)
 		exit(err);
@@ -1230,7 +1755,7 @@ static int abort_if_not_full_device (int fd, __u64 lba, const char *devname, con
 
 static __u16 *get_dco_identify_data (int fd, int quietly)
 {
-	static __u8 args[4+512];
+	static __thread __u8 args[4+512];	/* per thread, for --hpa-audit */
 	__u16 *dco = (void *)(args + 4);
 	int i;
 	
@@ -1318,11 +1843,12 @@ do_dco_setmax_cmd (int fd)
 
 static __u64 do_get_native_max_sectors (int fd)
 {
+	__u16 *id;
 	int err = 0;
 	__u64 max = 0;
 	struct hdio_taskfile r;
 
-	get_identify_data(fd);
+	id = get_identify_data(fd);
 	if (!id)
 		exit(EIO);
 	memset(&r, 0, sizeof(r));
@@ -1390,8 +1916,228 @@ static __u64 do_get_native_max_sectors (int fd)
 	
 }
 
+/*
+ * --hpa-audit: compare the current, native and DCO max sectors of every
+ * device given, to find capacity hidden by an HPA, ACCESSIBLE MAX ADDRESS
+ * or DCO.  Each device is queried by its own thread, so that many are done
+ * at once, and a stuck device (or bridge) costs only its own timeout:
+ * its thread is abandoned, though hdparm may still have to wait in the
+ * kernel for the stuck command to time out before it can exit.
+ */
+#define HPA_AUDIT_MAX_THREADS	64
+
+enum { HPA_AUDIT_QUEUED, HPA_AUDIT_RUNNING, HPA_AUDIT_DONE, HPA_AUDIT_FAILED, HPA_AUDIT_TIMEOUT };
+
+struct hpa_audit_result {		/* written by the thread, read once it is DONE/FAILED */
+	int		err;
+	const char	*step;		/* the query which failed */
+	int		amax;		/* ACCESSIBLE MAX ADDRESS rather than HPA */
+	unsigned int	sector_bytes;
+	__u64		current, native, dco;	/* dco is zero if unavailable */
+};
+
+struct hpa_audit_job {
+	struct hpa_audit_job	*next;
+	const char		*devname;
+	pthread_t		thread;
+	int			active;	/* thread not yet joined (or detached) */
+	int			state;	/* RUNNING -> DONE/FAILED (thread) or TIMEOUT (us), atomically */
+	struct timeval		start;
+	struct hpa_audit_result	r;
+};
+
+static struct hpa_audit_job *hpa_audit_jobs = NULL;
+
+static void add_hpa_audit_job (const char *devname)
+{
+	struct hpa_audit_job *job, **tail;
+
+	for (tail = &hpa_audit_jobs; *tail; tail = &(*tail)->next) {
+		if (!strcmp((*tail)->devname, devname))
+			return;	/* listed twice: it would share its device context with itself */
+	}
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		int err = errno;
+		perror("calloc()");
+		exit(err);
+	}
+	job->devname = devname;
+	job->state = HPA_AUDIT_QUEUED;
+	*tail = job;
+}
+
+static int hpa_audit_query (const char *devname, struct hpa_audit_result *r)
+{
+	__u16 *id, *dco;
+	int fd;
+
+	r->step = "open";
+	fd = open(devname, open_flags);
+	if (fd == -1 || apt_detect(fd, verbose) == -1) {
+		r->err = errno;
+		if (fd != -1)
+			close(fd);
+		return 1;
+	}
+	r->step = "emulate";
+	if (emulate && (r->err = emu_attach(fd, devname, emulate_latency, emulate_errors, verbose)))
+		goto quit;
+	r->step = "identify";
+	id = get_identify_data(fd);
+	if (!id) {
+		r->err = EIO;
+		goto quit;
+	}
+	r->current = get_lba_capacity(id);
+	r->amax = SUPPORTS_AMAX_ADDR(id);
+	r->sector_bytes = get_current_sector_size(fd);
+	r->step = "native max";
+	r->native = do_get_native_max_sectors(fd);
+	if (!r->native) {
+		r->err = errno ? errno : EIO;
+		goto quit;
+	}
+	dco = get_dco_identify_data(fd, 1);	/* optional: often absent or frozen */
+	if (dco)
+		r->dco = ((((__u64)dco[5]) << 32) | ((__u64)dco[4] << 16) | dco[3]) + 1;
+	r->step = NULL;
+quit:
+	close(fd);
+	return r->step != NULL;
+}
+
+static void *hpa_audit_thread (void *arg)
+{
+	struct hpa_audit_job *job = arg;
+	int running = HPA_AUDIT_RUNNING;
+	int state = hpa_audit_query(job->devname, &job->r) ? HPA_AUDIT_FAILED : HPA_AUDIT_DONE;
+
+	/* fails if we were already given up on: the result is then never looked at */
+	__atomic_compare_exchange_n(&job->state, &running, state, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static void print_hpa_audit_job (struct hpa_audit_job *job)
+{
+	struct hpa_audit_result *r = &job->r;
+	__u64 hpa = 0, dco = 0;
+	char status[128];
+
+	if (job->state == HPA_AUDIT_TIMEOUT) {
+		snprintf(status, sizeof(status), "TIMEOUT after %llus", hpa_audit_timeout);
+	} else if (job->state == HPA_AUDIT_FAILED) {
+		snprintf(status, sizeof(status), "FAILED: %s: %s", r->step ? r->step : "thread",
+			r->err ? strerror(r->err) : "killed");
+	} else if (r->current > r->native) {
+		snprintf(status, sizeof(status), "INVALID: current max exceeds native max");
+	} else {
+		hpa = r->native - r->current;
+		if (r->dco > r->native)
+			dco = r->dco - r->native;
+		if (!hpa && !dco) {
+			if (quiet)
+				return;
+			strcpy(status, "ok");
+		} else {
+			int n = 0;
+			if (hpa)
+				n += snprintf(status + n, sizeof(status) - n, "%s hides %llu sectors, ",
+					r->amax ? "AMAX" : "HPA", hpa);
+			if (dco)
+				n += snprintf(status + n, sizeof(status) - n, "DCO hides %llu sectors, ", dco);
+			snprintf(status + n, sizeof(status) - n, "%.1f GB in all",
+				(double)(hpa + dco) * r->sector_bytes / 1e9);
+		}
+	}
+	if (job->state == HPA_AUDIT_DONE) {
+		char dco_max[24] = "-";
+		if (r->dco)
+			sprintf(dco_max, "%llu", r->dco);
+		printf("%-20s %14llu %14llu %14s  %s\n", job->devname, r->current, r->native, dco_max, status);
+	} else {
+		printf("%-20s %14s %14s %14s  %s\n", job->devname, "-", "-", "-", status);
+	}
+}
+
+static int run_hpa_audit (void)
+{
+	struct hpa_audit_job *job, *next = hpa_audit_jobs;
+	unsigned int running = 0;
+	int err = 0, saved_stderr = -1;
+
+	fflush(stdout);
+	fflush(stderr);
+	/* the failing step is reported in the table, rather than interleaved on stderr */
+	if (!verbose) {
+		int null_fd = open("/dev/null", O_WRONLY);
+		if (null_fd != -1) {
+			saved_stderr = dup(2);
+			dup2(null_fd, 2);
+			close(null_fd);
+		}
+	}
+
+	do {
+		struct timeval now;
+
+		while (next && running < HPA_AUDIT_MAX_THREADS) {
+			job = next;
+			next = job->next;
+			gettimeofday(&job->start, NULL);
+			job->state = HPA_AUDIT_RUNNING;
+			if ((job->r.err = pthread_create(&job->thread, NULL, hpa_audit_thread, job))) {
+				job->r.step = "thread";
+				job->state  = HPA_AUDIT_FAILED;
+			} else {
+				job->active = 1;
+				++running;
+			}
+		}
+		gettimeofday(&now, NULL);
+		for (job = hpa_audit_jobs; job; job = job->next) {
+			int state = HPA_AUDIT_RUNNING;
+			double elapsed;
+
+			if (!job->active)
+				continue;
+			if (__atomic_load_n(&job->state, __ATOMIC_ACQUIRE) == HPA_AUDIT_RUNNING) {
+				elapsed = (now.tv_sec - job->start.tv_sec) + ((now.tv_usec - job->start.tv_usec) / 1000000.0);
+				if (elapsed < hpa_audit_timeout)
+					continue;
+				if (__atomic_compare_exchange_n(&job->state, &state, HPA_AUDIT_TIMEOUT, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+					/* not waited for: it may be stuck in the kernel until the command times out */
+					pthread_detach(job->thread);
+					job->active = 0;
+					--running;
+					continue;
+				}
+			}
+			pthread_join(job->thread, NULL);
+			job->active = 0;
+			--running;
+		}
+		if (running)
+			usleep(10000);
+	} while (running || next);
+
+	printf("%-20s %14s %14s %14s  %s\n", "device", "current max", "native max", "DCO max", "status");
+	for (job = hpa_audit_jobs; job; job = job->next) {
+		print_hpa_audit_job(job);
+		if (job->state != HPA_AUDIT_DONE)
+			err = EIO;
+	}
+	fflush(stdout);
+	if (saved_stderr != -1) {
+		dup2(saved_stderr, 2);
+		close(saved_stderr);
+	}
+	return err;
+}
+
 static int do_make_bad_sector (int fd, __u64 lba, const char *devname)
 {
+	__u16 *id;
 	int err = 0, has_write_unc = 0;
 	struct hdio_taskfile *r;
 	const char *flagged;
@@ -1404,7 +2150,7 @@ static int do_make_bad_sector (int fd, __u64 lba, const char *devname)
 		return err;
 	}
 
-	get_identify_data(fd);
+	id = get_identify_data(fd);
 	if (id)
 		has_write_unc = (id[ 83] & 0xc000) == 0x4000 && (id[ 86] & 0x8000) == 0x8000
 			     && (id[119] & 0xc004) == 0x4004 && (id[120] & 0xc000) == 0x4000;
@@ -1500,110 +2246,40 @@ static int do_erase_sectors (int fd, __u64 lba, const char *devname)
 }
 #endif /* FORMAT_AND_ERASE */
 
-struct sector_range_s {
-	__u64	lba;
-	__u64	nsectors;
-};
-
-static int trim_sectors (int fd, const char *devname, int nranges, void *data, __u64 nsectors)
+static void trim_starting (int fd, const char *devname, int nranges, __u64 nsectors)
 {
-	struct ata_tf tf;
-	int err = 0;
-	unsigned int data_bytes = nranges * sizeof(__u64);
-	unsigned int data_sects = (data_bytes + 511) / 512;
-
-	data_bytes = data_sects * 512;
-
 	abort_if_not_full_device(fd, 0, devname, NULL);
 	printf("trimming %llu sectors from %d ranges\n", nsectors, nranges);
 	fflush(stdout);
 
 	// Try and ensure that the system doesn't have the to-be-trimmed sectors in cache:
 	flush_buffer_cache(fd);
-
-	tf_init(&tf, ATA_OP_DSM, 0, data_sects);
-	tf.lob.feat = 0x01;	/* DSM/TRIM */
-
-	if (sg16(fd, SG_WRITE, SG_DMA, &tf, data, data_bytes, 300 /* seconds */)) {
-		err = errno;
-		perror("FAILED");
-	} else {
-		printf("succeeded\n");
-	}
-	return err;
-}
-
-static void do_trim_sector_ranges (int fd, const char *devname, int nranges, struct sector_range_s *sr)
-{
-	__u64 range, *data, nsectors = 0;
-	unsigned int data_sects, data_bytes;
-	int i, err = 0;
-
-	abort_if_not_full_device(fd, 0, devname, NULL);
-
-	data_sects = ((nranges * sizeof(range)) + 511) / 512;
-	data_bytes = data_sects * 512;
-
-	data = mmap(NULL, data_bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-	if (data == MAP_FAILED) {
-		err = errno;
-		perror("mmap(MAP_ANONYMOUS)");
-		exit(err);
-	}
-	// FIXME: handle counts > 65535 here!
-	for (i = 0; i < nranges; ++i) {
-		nsectors += sr->nsectors;
-		range = sr->nsectors;
-		range = (range << 48) | sr->lba;
-		data[i] = __cpu_to_le64(range);
-		++sr;
-	}
-
-	err = trim_sectors(fd, devname, nranges, data, nsectors);
-	munmap(data, data_bytes);
-	exit(err);
 }
 
-static void
-extract_id_string (__u16 *idw, int words, char *dst)
+static int trim_done (int err)
 {
-	char *e;
-	int bytes = words * 2;
-
-	memcpy(dst, idw, bytes);
-	dst[bytes] = '\0';
-	for (e = dst + bytes; --e != dst;) {
-		if (*e && *e != ' ')
-			break;
-		*e = '\0';
-	}
+	if (err)
+		fprintf(stderr, "FAILED: %s\n", strerror(err));
+	else
+		printf("succeeded\n");
+	return err;
 }
 
-static int
-get_trim_dev_limit (void)
+static int trim_sectors (int fd, const char *devname, int nranges, void *data, __u64 nsectors)
 {
-	char model[41];
-
-	if (id[105] && id[105] != 0xffff)
-		return id[105];
-	extract_id_string(id + 27, 20, model);
-	if (0 == strcmp(model, "OCZ VERTEX-LE"))
-		return 8;
-	if (0 == strcmp(model, "OCZ-VERTEX"))
-		return 64;
-	return 1;  /* all other drives, including Intel SSDs */
+	trim_starting(fd, devname, nranges, nsectors);
+	return trim_done(trim_ranges_cmd(fd, data, nranges));
 }
 
-int get_current_sector_size (int fd)
+static void do_trim_sector_ranges (int fd, const char *devname, int nranges, struct hdparm_lba_range *sr)
 {
-	unsigned int words = 256;
+	__u64 nsectors = 0;
+	int i;
 
-	get_identify_data(fd);
-	if(id && (id[106] & 0xc000) == 0x4000) {
-		if (id[106] & (1<<12))
-			words = (id[118] << 16) | id[117];
-	}
-	return 2 * words;
+	for (i = 0; i < nranges; ++i)
+		nsectors += sr[i].nsectors;
+	trim_starting(fd, devname, nranges, nsectors);
+	exit(trim_done(hdparm_trim(fd, sr, nranges)));
 }
 
 static int
@@ -1673,70 +2349,191 @@ static int do_set_sector_size_cmd (int fd, const char *devname)
 static int
 do_trim_from_stdin (int fd, const char *devname)
 {
-	__u64 *data, range, nsectors = 0, lba_limit;
-	unsigned int max_kb, data_sects, data_bytes;
-	unsigned int total_ranges = 0, nranges = 0, max_ranges, dev_limit;
+	__u16 *id;
+	struct trim_batch b;
+	__u64 lba_limit;
+	unsigned int data_bytes;
 	int err = 0;
 
-	get_identify_data(fd);
+	id = get_identify_data(fd);
 	if (!id)
 		exit(EIO);
 	lba_limit = get_lba_capacity(id);
-	dev_limit = get_trim_dev_limit();
-
-	err = sysfs_get_attr(fd, "queue/max_sectors_kb", "%u", &max_kb, NULL, 0);
-	if (err || max_kb == 0)
-		data_sects = 128;	/* "safe" default for most controllers */
-	else
-		data_sects = max_kb * 2;
-	if (data_sects > dev_limit)
-		data_sects = dev_limit;
-	data_bytes = data_sects * 512;
+	data_bytes = get_trim_payload_sectors(fd, id) * 512;
 
-	data = mmap(NULL, data_bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-	if (data == MAP_FAILED) {
+	memset(&b, 0, sizeof(b));
+	b.data = mmap(NULL, data_bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (b.data == MAP_FAILED) {
 		err = errno;
 		perror("mmap(MAP_ANONYMOUS)");
 		exit(err);
 	}
-	memset(data, 0, data_bytes);
-	max_ranges = data_bytes / sizeof(range);
+	b.max_ranges = data_bytes / sizeof(*b.data);
+
+	do {
+		err = read_trim_batch(stdin, lba_limit, &b);
+		if (!err && b.nranges)
+			err = trim_sectors(fd, devname, b.nranges, b.data, b.nsectors);
+	} while (!err && !b.eof);
+	munmap(b.data, data_bytes);
+	return err;
+}
+
+static int do_write_sector (int fd, __u64 lba, const char *devname)
+{
+	int err = 0;
+	__u8 ata_op;
+	struct hdio_taskfile *r;
+	int sector_bytes = get_current_sector_size(fd);
+
+	abort_if_not_full_device(fd, lba, devname, NULL);
+	r = malloc(sizeof(struct hdio_taskfile) + sector_bytes);
+	if (!r) {
+		err = errno;
+		perror("malloc()");
+		return err;
+	}
+	ata_op = (lba >= lba28_limit) ? ATA_OP_WRITE_PIO_EXT : ATA_OP_WRITE_PIO;
+	init_hdio_taskfile(r, ata_op, RW_WRITE, LBA28_OK, lba, 1, sector_bytes);
+
+	printf("re-writing sector %llu: ", lba);
+	fflush(stdout);
+
+	// Try and ensure that the system doesn't have our sector in cache:
+	flush_buffer_cache(fd);
+
+	if (do_taskfile_cmd(fd, r, timeout_60secs)) {
+		err = errno;
+		perror("FAILED");
+	} else {
+		printf("succeeded\n");
+	}
+
+	free(r);
+	return err;
+}
+
+static int compare_lba (const void *a, const void *b)
+{
+	__u64 x = *(const __u64 *)a, y = *(const __u64 *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+static int verify_one_sector (int fd, __u64 lba)
+{
+	struct ata_tf tf;
+
+	tf_init(&tf, ATA_OP_READ_VERIFY_EXT, lba, 1);
+	return sg16(fd, SG_READ, SG_PIO, &tf, NULL, 0, timeout_60secs) ? errno : 0;
+}
+
+/*
+ * Read a list of LBAs from stdin, and rewrite (with zeros) only those
+ * which fail a READ VERIFY, so that the drive can reallocate them.
+ */
+static int
+do_repair_from_stdin (int fd, const char *devname, int reverify)
+{
+	__u16 *id;
+	__u64 *lbas = NULL, lba, lba_limit;
+	unsigned int nlbas = 0, max_lbas = 0, i, n, dups;
+	unsigned int readable = 0, rewritten = 0, write_failed = 0, still_bad = 0;
+	unsigned int sector_bytes = get_current_sector_size(fd);
+	void *buf;
+	int args, err = 0;
+
+	id = get_identify_data(fd);
+	if (!id)
+		exit(EIO);
+	lba_limit = get_lba_capacity(id);
+	abort_if_not_full_device(fd, 0, devname, NULL);
+
+	while ((args = scanf("%llu", &lba)) != EOF) {
+		if (args != 1 || lba >= lba_limit) {
+			err = (args == 1) ? ERANGE : EINVAL;
+			fprintf(stderr, "stdin: error at lba #%u: %s\n", nlbas + 1, strerror(err));
+			free(lbas);
+			return err;
+		}
+		if (nlbas == max_lbas) {
+			__u64 *p;
+			max_lbas = max_lbas ? max_lbas * 2 : 1024;
+			p = realloc(lbas, max_lbas * sizeof(*lbas));
+			if (!p) {
+				err = errno;
+				perror("realloc()");
+				free(lbas);
+				return err;
+			}
+			lbas = p;
+		}
+		lbas[nlbas++] = lba;
+	}
+	if (!nlbas)
+		return 0;
+	qsort(lbas, nlbas, sizeof(*lbas), compare_lba);
+	for (i = n = 1; i < nlbas; ++i) {
+		if (lbas[i] != lbas[n - 1])
+			lbas[n++] = lbas[i];
+	}
+	dups  = nlbas - n;
+	nlbas = n;
+
+	buf = mmap(NULL, sector_bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		err = errno;
+		perror("mmap(MAP_ANONYMOUS)");
+		free(lbas);
+		return err;
+	}
+	// Try and ensure that the system doesn't have our sectors in cache:
+	flush_buffer_cache(fd);
 
-	do {
-		__u64 lba, nsect;
-		int args;
-
-		if (nranges == 0)
-			memset(data, 0, data_bytes);
-		errno = EINVAL;
-		args = scanf("%llu:%llu", &lba, &nsect);
-		if (args == EOF)
+	for (i = 0; i < nlbas; ++i) {
+		struct ata_tf tf;
+
+		lba = lbas[i];
+		err = verify_one_sector(fd, lba);
+		if (!err) {
+			++readable;
+			continue;
+		}
+		if (err != EIO) {
+			fprintf(stderr, "READ_VERIFY_EXT(%llu) failed: %s\n", lba, strerror(err));
 			break;
-		if (args != 2 || nsect > 0xffff || lba >= lba_limit) {
-			if (args == 2)
-				errno = ERANGE;
-			err = errno;
-			fprintf(stderr, "stdin: error at lba:count pair #%d: %s\n", (total_ranges + 1), strerror(err));
+		}
+		err = 0;
+		printf("re-writing sector %llu: ", lba);
+		fflush(stdout);
+		tf_init(&tf, ATA_OP_WRITE_DMA_EXT, lba, 1);
+		if (sg16(fd, SG_WRITE, SG_DMA, &tf, buf, sector_bytes, timeout_60secs)) {
+			perror("FAILED");
+			++write_failed;
+			continue;
+		}
+		++rewritten;
+		if (reverify && verify_one_sector(fd, lba)) {
+			printf("succeeded, but still unreadable\n");
+			++still_bad;
 		} else {
-			range = (nsect << 48) | lba;
-			nsectors += nsect;
-			data[nranges++] = __cpu_to_le64(range);
-			if (nranges == max_ranges) {
-				err = trim_sectors(fd, devname, nranges, data, nsectors);
-				memset(data, 0, data_bytes);
-				nranges = 0;
-				nsectors = 0;
-			}
-			++total_ranges;
+			printf("succeeded\n");
 		}
-	} while (!err);
-	if (!err && nranges)
-		err = trim_sectors(fd, devname, nranges, data, nsectors);
-	munmap(data, data_bytes);
+	}
+	munmap(buf, sector_bytes);
+	free(lbas);
+
+	printf("%u sectors checked (%u duplicates dropped): %u readable, %u rewritten, %u write failures",
+		i, dups, readable, rewritten, write_failed);
+	if (reverify)
+		printf(", %u still unreadable", still_bad);
+	putchar('\n');
+	if (!err && (write_failed || still_bad))
+		err = EIO;
 	return err;
 }
 
-static int do_write_sector (int fd, __u64 lba, const char *devname)
+static int do_read_sector (int fd, __u64 lba, const char *devname)
 {
 	int err = 0;
 	__u8 ata_op;
@@ -1750,54 +2547,147 @@ static int do_write_sector (int fd, __u64 lba, const char *devname)
 		perror("malloc()");
 		return err;
 	}
-	ata_op = (lba >= lba28_limit) ? ATA_OP_WRITE_PIO_EXT : ATA_OP_WRITE_PIO;
-	init_hdio_taskfile(r, ata_op, RW_WRITE, LBA28_OK, lba, 1, sector_bytes);
+	ata_op = (lba >= lba28_limit) ? ATA_OP_READ_PIO_EXT : ATA_OP_READ_PIO;
+	init_hdio_taskfile(r, ata_op, RW_READ, LBA28_OK, lba, 1, sector_bytes);
 
-	printf("re-writing sector %llu: ", lba);
+	printf("reading sector %llu: ", lba);
 	fflush(stdout);
 
-	// Try and ensure that the system doesn't have our sector in cache:
-	flush_buffer_cache(fd);
-
 	if (do_taskfile_cmd(fd, r, timeout_60secs)) {
 		err = errno;
 		perror("FAILED");
 	} else {
 		printf("succeeded\n");
+		dump_sectors(r->data, 1, 0, sector_bytes);
 	}
-
 	free(r);
 	return err;
 }
 
-static int do_read_sector (int fd, __u64 lba, const char *devname)
+static int write_all (int ofd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t n = write(ofd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		p   += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Table-driven hex formatter for --read-sectors-hex,
+ * using the same layout as dump_sectors() but buffering whole lines.
+ */
+static int hex_dump_sectors (int ofd, const __u8 *data, size_t len)
+{
+	static char hex_pairs[256][2], out[64 * 1024];
+	static const char digits[] = "0123456789abcdef";
+	size_t i, pos = 0;
+	int err;
+
+	if (!hex_pairs[0][0]) {
+		for (i = 0; i < 256; ++i) {
+			hex_pairs[i][0] = digits[i >> 4];
+			hex_pairs[i][1] = digits[i & 15];
+		}
+	}
+	for (i = 0; i + 16 <= len; i += 16) {
+		char *o = out + pos;
+		int word;
+
+		for (word = 0; word < 8; ++word) {
+			memcpy(o, hex_pairs[data[i + word * 2]], 2);
+			memcpy(o + 2, hex_pairs[data[i + word * 2 + 1]], 2);
+			o[4] = (word == 7) ? '\n' : ' ';
+			o += 5;
+		}
+		pos += 40;
+		if (pos + 40 > sizeof(out)) {
+			if ((err = write_all(ofd, out, pos)))
+				return err;
+			pos = 0;
+		}
+	}
+	return pos ? write_all(ofd, out, pos) : 0;
+}
+
+/*
+ * Read a range of sectors using READ DMA EXT, in the largest transfers
+ * the queue allows, straight into one buffer which is then written to stdout.
+ * Chunks which fail with a media error are retried one sector at a time,
+ * and any unreadable sectors are zero-filled and reported on stderr.
+ */
+static int do_read_sectors (int fd, __u64 lba, __u64 count, int hex, const char *devname)
 {
+	unsigned int sector_bytes = get_current_sector_size(fd);
+	unsigned int max_kb, chunk, i;
+	__u64 bad = 0;
+	size_t buf_bytes;
+	__u8 *buf;
 	int err = 0;
-	__u8 ata_op;
-	struct hdio_taskfile *r;
-	int sector_bytes = get_current_sector_size(fd);
 
 	abort_if_not_full_device(fd, lba, devname, NULL);
-	r = malloc(sizeof(struct hdio_taskfile) + sector_bytes);
-	if (!r) {
+	if (sysfs_get_attr(fd, "queue/max_sectors_kb", "%u", &max_kb, NULL, 0) || max_kb == 0)
+		max_kb = 128;	/* "safe" default for most controllers */
+	chunk = (max_kb * 1024) / sector_bytes;
+	if (chunk > 0xffff)
+		chunk = 0xffff;
+	if (chunk == 0)
+		chunk = 1;
+	if (chunk > count)
+		chunk = count;
+	buf_bytes = (size_t)chunk * sector_bytes;
+	buf = mmap(NULL, buf_bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
 		err = errno;
-		perror("malloc()");
+		perror("mmap(MAP_ANONYMOUS)");
 		return err;
 	}
-	ata_op = (lba >= lba28_limit) ? ATA_OP_READ_PIO_EXT : ATA_OP_READ_PIO;
-	init_hdio_taskfile(r, ata_op, RW_READ, LBA28_OK, lba, 1, sector_bytes);
-
-	printf("reading sector %llu: ", lba);
 	fflush(stdout);
+	while (count && !err) {
+		struct ata_tf tf;
+		unsigned int n = (count < chunk) ? count : chunk;
 
-	if (do_taskfile_cmd(fd, r, timeout_60secs)) {
-		err = errno;
-		perror("FAILED");
-	} else {
-		printf("succeeded\n");
-		dump_sectors(r->data, 1, 0, sector_bytes);
+		tf_init(&tf, ATA_OP_READ_DMA_EXT, lba, n);
+		if (sg16(fd, SG_READ, SG_DMA, &tf, buf, n * sector_bytes, timeout_60secs)) {
+			if (errno != EIO) {
+				err = errno;
+				perror("READ_DMA_EXT failed");
+				break;
+			}
+			for (i = 0; i < n; ++i) {
+				__u8 *b = buf + (size_t)i * sector_bytes;
+
+				tf_init(&tf, ATA_OP_READ_DMA_EXT, lba + i, 1);
+				if (sg16(fd, SG_READ, SG_DMA, &tf, b, sector_bytes, timeout_60secs)) {
+					fprintf(stderr, "%s: sector %llu unreadable: %s\n", devname, lba + i, strerror(errno));
+					memset(b, 0, sector_bytes);
+					++bad;
+				}
+			}
+		}
+		if (hex)
+			err = hex_dump_sectors(1, buf, (size_t)n * sector_bytes);
+		else
+			err = write_all(1, buf, (size_t)n * sector_bytes);
+		if (err)
+			fprintf(stderr, "write(stdout): %s\n", strerror(err));
+		lba   += n;
+		count -= n;
+	}
+	munmap(buf, buf_bytes);
+	if (bad) {
+		fprintf(stderr, "%s: %llu unreadable sector(s) were zero-filled\n", devname, bad);
+		if (!err)
+			err = EIO;
 	}
-	free(r);
 	return err;
 }
 
@@ -1820,11 +2710,12 @@ static int do_idleunload (int fd, const char *devname)
 
 static int do_set_max_sectors (int fd, __u64 max_lba, int permanent)
 {
+	__u16 *id;
 	int err = 0;
 	struct hdio_taskfile r;
 	__u8 nsect = permanent ? 1 : 0;
 	
-	get_identify_data(fd);
+	id = get_identify_data(fd);
 	if (!id)
 		exit(EIO);
 	
@@ -1864,6 +2755,180 @@ static int do_set_max_sectors (int fd, __u64 max_lba, int permanent)
 	return err;
 }
 
+/*
+ * Short-stroke planner: sample sequential throughput at evenly spaced
+ * zones across the LBA span, and random 4kB read latency confined to
+ * each candidate span [0, max), all read-only.  The recommended max is
+ * the largest span whose zones all meet the target MB/sec, and/or whose
+ * p99 latency meets the target; with --short-stroke-apply it is then set
+ * (volatile, as for -N without the 'p') and read back to verify it.
+ */
+#define PLAN_SPANS		20	/* candidate max sectors at 5% steps */
+#define PLAN_ZONE_READS		8	/* sequential TIMING_BUF_BYTES reads per zone */
+#define PLAN_RANDOM_READS	128	/* random 4kB reads per span */
+#define PLAN_RANDOM_BYTES	4096
+
+struct plan_span {
+	__u64	max_sectors;
+	double	zone_MBps;	/* at the start of the last 5% of the span */
+	double	p50_ms, p99_ms;
+};
+
+static int plan_zone_throughput (int fd, char *buf, __u64 offset, double *MBps)
+{
+	struct hdparm_timer t;
+	unsigned int i;
+	int err;
+
+	if (lseek64(fd, offset, SEEK_SET) == (off64_t)-1) {
+		err = errno;
+		perror("lseek() failed");
+		return err;
+	}
+	timer_start(&t);
+	for (i = 0; i < PLAN_ZONE_READS; ++i) {
+		if ((err = read_big_block(fd, buf)))
+			return err;
+	}
+	*MBps = (double)PLAN_ZONE_READS * TIMING_BUF_MB / timer_stop(&t);
+	return 0;
+}
+
+static int plan_random_latency (int fd, char *buf, __u64 span_bytes, __u64 *seed, struct plan_span *s)
+{
+	double lat_ms[PLAN_RANDOM_READS];
+	struct hdparm_timer t;
+	unsigned int i;
+	int err;
+
+	timer_start(&t);
+	for (i = 0; i < PLAN_RANDOM_READS; ++i) {
+		__u64 offset;
+
+		*seed ^= *seed << 13;
+		*seed ^= *seed >> 7;
+		*seed ^= *seed << 17;
+		offset = (*seed % (span_bytes / PLAN_RANDOM_BYTES)) * PLAN_RANDOM_BYTES;
+		if (pread64(fd, buf, PLAN_RANDOM_BYTES, offset) != PLAN_RANDOM_BYTES) {
+			err = errno ? errno : EIO;
+			perror("pread() failed");
+			return err;
+		}
+		lat_ms[i] = timer_lap(&t) * 1000.0;
+	}
+	sort_doubles(lat_ms, PLAN_RANDOM_READS);
+	s->p50_ms = sorted_percentile(lat_ms, PLAN_RANDOM_READS, 50.0);
+	s->p99_ms = sorted_percentile(lat_ms, PLAN_RANDOM_READS, 99.0);
+	return 0;
+}
+
+static int plan_short_stroke (int fd, const char *devname, int apply)
+{
+	__u16 *id;
+	struct plan_span spans[PLAN_SPANS];
+	__u64 sectors, dev_bytes, seed = 0x9e3779b97f4a7c15ULL, best = 0;
+	unsigned int sector_bytes, i;
+	int dfd, err = 0;
+	char *buf;
+
+	abort_if_not_full_device(fd, 0, devname, "--short-stroke requires the raw device, not a partition.");
+	id = get_identify_data(fd);
+	if (!id)
+		return EIO;
+	sectors = get_lba_capacity(id);
+	sector_bytes = get_current_sector_size(fd);
+	dev_bytes = sectors * sector_bytes;
+	if (dev_bytes < (__u64)PLAN_SPANS * PLAN_ZONE_READS * TIMING_BUF_BYTES) {
+		fprintf(stderr, " device too small to plan a short-stroke\n");
+		return EINVAL;
+	}
+
+	/* random reads must not be satisfied from the page cache */
+	dfd = emu_is_emulated(fd) ? -1 : open(devname, O_RDONLY|O_DIRECT);
+	if (dfd == -1)
+		dfd = fd;
+	buf = prepare_timing_buf(TIMING_BUF_BYTES);
+	if (!buf) {
+		err = ENOMEM;
+		goto quit;
+	}
+	flush_buffer_cache(fd);
+
+	printf(" Short-stroke plan for %llu sectors: %u MB sequential per zone, %u random %ukB reads per span\n",
+		sectors, PLAN_ZONE_READS * TIMING_BUF_MB, PLAN_RANDOM_READS, PLAN_RANDOM_BYTES / 1024);
+	printf("\t span     max sectors   zone MB/sec    p50 ms    p99 ms\n");
+	for (i = 0; i < PLAN_SPANS; ++i) {
+		struct plan_span *s = &spans[i];
+		__u64 zone_start;
+
+		s->max_sectors = (i + 1 == PLAN_SPANS) ? sectors : sectors / PLAN_SPANS * (i + 1);
+		zone_start = (sectors / PLAN_SPANS * i) * sector_bytes;
+		if (zone_start + (__u64)PLAN_ZONE_READS * TIMING_BUF_BYTES > dev_bytes)
+			zone_start = dev_bytes - (__u64)PLAN_ZONE_READS * TIMING_BUF_BYTES;
+		zone_start &= ~((__u64)TIMING_BUF_BYTES - 1);
+		if ((err = plan_zone_throughput(fd, buf, zone_start, &s->zone_MBps)))
+			goto quit;
+		if ((err = plan_random_latency(dfd, buf, s->max_sectors * sector_bytes, &seed, s)))
+			goto quit;
+		printf("\t%4u%%  %14llu  %12.2f  %8.3f  %8.3f\n", (i + 1) * 100 / PLAN_SPANS,
+			s->max_sectors, s->zone_MBps, s->p50_ms, s->p99_ms);
+		fflush(stdout);
+	}
+
+	if (!short_stroke_MBps && !short_stroke_p99_ms)
+		goto quit;
+	for (i = 0; i < PLAN_SPANS; ++i) {
+		if (short_stroke_MBps && spans[i].zone_MBps < short_stroke_MBps)
+			break;	/* every zone below the max must meet the throughput target */
+		if (!short_stroke_p99_ms || spans[i].p99_ms <= short_stroke_p99_ms)
+			best = spans[i].max_sectors;
+	}
+	if (!best) {
+		printf(" No span meets the target; not even the first %u%% of the drive.\n", 100 / PLAN_SPANS);
+		err = ERANGE;
+		goto quit;
+	}
+	printf(" Recommended max sectors: %llu (%.0f%% of %llu)\n", best, best * 100.0 / sectors, sectors);
+	if (!apply) {
+		printf(" To apply it: hdparm -N%llu %s   (or -Np%llu to make it permanent)\n", best, devname, best);
+		goto quit;
+	}
+	if (best == sectors) {
+		printf(" The whole drive meets the target: nothing to set.\n");
+		goto quit;
+	}
+	confirm_i_know_what_i_am_doing("--short-stroke-apply", "You have requested reducing the apparent size of the drive.\nThis is a BAD idea, and can easily destroy all of the drive's contents.");
+	printf(" setting max visible sectors to %llu (temporary)\n", best);
+	if ((err = do_set_max_sectors(fd, best - 1, 0)))
+		goto quit;
+	invalidate_identify_data(fd);
+	id = get_identify_data(fd);
+	if (!id) {
+		err = EIO;
+		goto quit;
+	}
+	sectors = do_get_native_max_sectors(fd);
+	if (!sectors) {
+		err = errno;
+		goto quit;
+	}
+	printf(" max sectors   = %llu/%llu", get_lba_capacity(id), sectors);
+	if (get_lba_capacity(id) != best) {
+		printf(", VERIFY FAILED: expected %llu\n", best);
+		err = EIO;
+	} else {
+		printf(", %s is enabled\n", SUPPORTS_AMAX_ADDR(id) ? "ACCESSIBLE MAX ADDRESS" : "HPA");
+	}
+quit:
+	if (buf) {
+		munlockall();
+		munmap(buf, TIMING_BUF_BYTES);
+	}
+	if (dfd != fd)
+		close(dfd);
+	return err;
+}
+
 static void usage_help (int clue, int rc)
 {
 	FILE *desc = rc ? stderr : stdout;
@@ -1918,12 +2983,25 @@ static void usage_help (int clue, int rc)
 	" -Y   Put drive to sleep\n"
 	" -z   Re-read partition table\n"
 	" -Z   Disable Seagate auto-powersaving mode\n"
+	" --alignment-check   Report partitions, md data offsets and filesystems misaligned to the physical sectors\n"
+	" --alignment-penalty Same as --alignment-check, and measure the read penalty of each misaligned layer\n"
+	" --baseline-check  FILE  Compare -t/-T results against the saved baseline for this drive\n"
+	" --baseline-save   FILE  Save -t/-T results as the baseline for this drive (by model/serial)\n"
+	" --baseline-threshold  Percentage of the baseline below which --baseline-check fails (default 90)\n"
+	" --count           Number of samples to take with --interval (default: unlimited)\n"
+	" --cpu             Pin -t/-T timings to the given CPU number\n"
 	" --dco-freeze      Freeze/lock current device configuration until next power cycle\n"
 	" --dco-identify    Read/dump device configuration identify data\n"
 	" --dco-restore     Reset device configuration back to factory defaults\n"
 	" --dco-setmax      Use DCO to set maximum addressable sectors\n"
+	" --device-stats    Display the Device Statistics log; with --interval, sample host I/O rates\n"
 	" --direct          Use O_DIRECT to bypass page cache for timings\n"
 	" --drq-hsm-error   Crash system with a \"stuck DRQ\" error (VERY DANGEROUS)\n"
+	" --duration        Number of seconds to run -t (default 3), -T (default 2), or --write-timings (default 30)\n"
+	" --emulate         Treat each \"device\" as a disk image file, and emulate the ATA commands for it\n"
+	" --emulate-errors  LBA[:COUNT],..,abort=N  Unreadable sectors, and/or fail every Nth command, for --emulate\n"
+	" --emulate-latency Microseconds added to every emulated command (default 0)\n"
+	" --erase-monitor   Start sanitize/security-erase on all drives, then poll progress together\n"
 	" --fallocate       Create a file without writing data to disk\n"
 	" --fibmap          Show device extents (and fragmentation) for a file\n"
 	" --fwdownload            Download firmware file to drive (EXTREMELY DANGEROUS)\n"
@@ -1932,28 +3010,65 @@ static void usage_help (int clue, int rc)
 	" --fwdownload-mode7      Download firmware using a single segment (EXTREMELY DANGEROUS)\n"
 	" --fwdownload-modee      Download firmware using mode E (min-size segments) (EXTREMELY DANGEROUS)\n"
 	" --fwdownload-modee-max  Download firmware using mode E (max-size segments) (EXTREMELY DANGEROUS)\n"
+	" --hpa-audit [secs]  Report capacity hidden by HPA/AMAX/DCO on all given drives, in parallel\n"
+	" --hugepages       Use huge pages (or transparent hugepages) for -t/-T timing buffers\n"
+	" --Ibatch file     Decode a file of many --Istdout dumps, one record per line\n"
 	" --idle-immediate  Idle drive immediately\n"
 	" --idle-unload     Idle immediately and unload heads\n"
+	" --interval        Seconds between polls/samples for monitoring modes\n"
   " --Iraw filename   Write raw binary identify data to the specfied file\n"
 	" --Istdin          Read identify data from stdin as ASCII hex\n"
 	" --Istdout         Write identify data to stdout as ASCII hex\n"
+	" --iterations      Number of reads (or writes) to time with -t/-T/--write-timings, instead of a fixed duration\n"
 	" --make-bad-sector Deliberately corrupt a sector directly on the media (VERY DANGEROUS)\n"
+	" --numa-node       Pin -t/-T timings, and their memory, to the given NUMA node\n"
 	" --offset          use with -t, to begin timings at given offset (in GiB) from start of drive\n"
+	" --per-node        Use with -T, to repeat the cached read timings on each NUMA node in turn\n"
+	" --phy-events      Display SATA Phy Event Counters; with --interval, report changes\n"
+	" --phy-events-reset  Same as --phy-events, but also reset the counters after reading\n"
 	" --prefer-ata12    Use 12-byte (instead of 16-byte) SAT commands when possible\n"
+	" --query fields    Print only the named IDENTIFY fields (comma separated), as name=value\n"
 	" --read-sector     Read and dump (in hex) a sector directly from the media\n"
+	" --read-sectors    LBA:COUNT  Read a range of sectors from the media, raw binary to stdout\n"
+	" --read-sectors-hex  LBA:COUNT  Same as --read-sectors, but dump in hex\n"
+	" --repair-reverify  Use with --repair-sectors-stdin, to re-verify each sector after rewriting it\n"
 	" --repair-sector   Alias for the --write-sector option (VERY DANGEROUS)\n"
+	" --repair-sectors-stdin  Read LBAs from stdin, and rewrite only those which fail to read (VERY DANGEROUS)\n"
+	" --repeat          Repeat -t/-T timings up to N times (after warm-up runs), and summarize\n"
+	" --replay          TRACE  Replay a binary block I/O trace with O_DIRECT, and report latencies\n"
+	" --replay-qdepth   Maximum commands in flight for --replay (default 1)\n"
+	" --replay-speedup  Time scaling for --replay (default 1.0, 0 = as fast as possible)\n"
+	" --replay-writes   Also issue the write commands from the --replay trace (DANGEROUS)\n"
 	" --sanitize-antifreeze-lock  Block sanitize-freeze-lock command until next power cycle\n"
 	" --sanitize-block-erase      Start block erase operation\n"
 	" --sanitize-crypto-scramble  Change the internal encryption keys that used for used data\n"
 	" --sanitize-freeze-lock      Lock drive's sanitize features until next power cycle\n"
 	" --sanitize-overwrite  PATTERN  Overwrite the internal media with constant PATTERN\n"
 	" --sanitize-status           Show sanitize status information\n"
+	" --sct-temp        Display SCT temperature status and history; with --interval, sample all drives\n"
 	" --security-help             Display help for ATA security commands\n"
 	" --set-sector-size           Change logical sector size of drive\n"
+	" --short-stroke-apply        Same as --short-stroke-plan, and then set the recommended max (temporary, VERY DANGEROUS)\n"
+	" --short-stroke-mbps         Target MB/sec that every zone below the planned max must meet\n"
+	" --short-stroke-p99          Target p99 random read latency (milliseconds) for the planned max\n"
+	" --short-stroke-plan         Sample zone throughput and random read latency across the drive, and plan a max LBA\n"
 	" --trim-sector-ranges        Tell SSD firmware to discard unneeded data sectors: lba:count ..\n"
 	" --trim-sector-ranges-stdin  Same as above, but reads lba:count pairs from stdin\n"
+	" --tsc                       Use the (calibrated) CPU time stamp counter for timings, where available\n"
+	" --tune-readahead            Find the best fs readahead (-a) for sequential reads, by timing a range of sizes\n"
+	" --tune-readahead-apply      Same as --tune-readahead, and then set the best value\n"
+	" --until-stable              Repeat -t/-T timings until the coefficient of variation is below PCT percent (max 20 runs, or --repeat)\n"
 	" --verbose                   Display extra diagnostics from some commands\n"
+	" --warmup                    Number of discarded warm-up runs for --repeat/--until-stable (default 1)\n"
 	" --write-sector              Repair/overwrite a (possibly bad) sector directly on the media (VERY DANGEROUS)\n"
+	" --write-timings             Time sustained sequential O_DIRECT writes, sampled every second (DESTROYS DATA)\n"
+	" --write-timings-random      Same as --write-timings, but with random 4kB writes (DESTROYS DATA)\n"
+	" --zone-close   LBA|all      Close the zone holding LBA, or all open zones\n"
+	" --zone-finish  LBA|all      Make the zone holding LBA (or all partially written zones) full (DANGEROUS)\n"
+	" --zone-open    LBA          Explicitly open the zone holding LBA\n"
+	" --zone-reset   LBA|all      Reset the write pointer of the zone holding LBA, or of all zones (DESTROYS DATA)\n"
+	" --zone-timings [count]      Time sequential reads of count zones (default 32, 0 for all readable zones)\n"
+	" --zones                     Display the zone table of a zoned device, with fill/write pointer statistics\n"
 	"\n");
 	exit(rc);
 }
@@ -1994,10 +3109,17 @@ static void security_help (int rc)
 void process_dev (char *devname)
 {
 	int fd;
-	int err = 0;
+	__u16 *id;
+	int err = 0, timing_err = 0;
 	static long parm, multcount;
 
-	id = NULL;
+	if (hpa_audit) {
+		if (num_flags_processed > 1 + quiet)
+			usage_help(19,EINVAL);
+		add_hpa_audit_job(devname);
+		return;
+	}
+
 	fd = open(devname, open_flags);
 	if (fd < 0) {
 		err = errno;
@@ -2013,6 +3135,11 @@ void process_dev (char *devname)
 		close(fd);
 		exit(err);
 	}
+	if (emulate && (err = emu_attach(fd, devname, emulate_latency, emulate_errors, verbose))) {
+		close(fd);
+		exit(err);
+	}
+	invalidate_identify_data(fd);	/* the same device may be named more than once */
 
 	if (do_set_sector_size) {
 		if (num_flags_processed > 1 || argc)
@@ -2028,6 +3155,21 @@ void process_dev (char *devname)
 		exit(do_trim_from_stdin(fd, devname));
 	}
 
+	if (replay_path) {
+		if (num_flags_processed > 1 || argc)
+			usage_help(18,EINVAL);
+		if (replay_writes)
+			confirm_please_destroy_my_drive("--replay-writes", "This will overwrite data on the drive with the contents of the trace.");
+		exit(do_replay(devname, replay_path, replay_speedup, replay_qdepth, replay_writes));
+	}
+
+	if (repair_from_stdin) {
+		if (num_flags_processed > 1 || argc)
+			usage_help(17,EINVAL);
+		confirm_i_know_what_i_am_doing("--repair-sectors-stdin", "You are trying to deliberately overwrite low-level sectors on the media.\nThis is a BAD idea, and can easily result in total data loss.");
+		exit(do_repair_from_stdin(fd, devname, repair_reverify));
+	}
+
 	if (set_wdidle3) {
 		unsigned char timeout = wdidle3_msecs_to_timeout(wdidle3);
 		confirm_please_destroy_my_drive("-J", "This implementation is not as thorough as the official WDIDLE3.EXE. Use at your own risk!");
@@ -2239,24 +3381,15 @@ void process_dev (char *devname)
 		}
 	}
 	if (set_apmmode) {
-		__u8 args[4] = {ATA_OP_SETFEATURES,0,0,0};
-		if (get_apmmode)
+		if (get_apmmode) {
 			printf(" setting Advanced Power Management level to");
-		if (apmmode==255) {
-			/* disable Advanced Power Management */
-			args[2] = 0x85; /* feature register */
-			if (get_apmmode) printf(" disabled\n");
-		} else {
-			/* set Advanced Power Management mode */
-			args[2] = 0x05; /* feature register */
-			args[1] = apmmode; /* sector count register */
-			if (get_apmmode)
+			if (apmmode==255)
+				printf(" disabled\n");
+			else
 				printf(" 0x%02x (%d)\n",apmmode,apmmode);
 		}
-		if (do_drive_cmd(fd, args, 0)) {
-			err = errno;
-			perror(" HDIO_DRIVE_CMD failed");
-		}
+		if ((err = hdparm_set_apm(fd, apmmode)))
+			fprintf(stderr, " HDIO_DRIVE_CMD failed: %s\n", strerror(err));
 	}
 	if (set_cdromspeed) {
 		int err1, err2;
@@ -2275,17 +3408,10 @@ void process_dev (char *devname)
 		}
 	}
 	if (set_acoustic) {
-		__u8 args[4];
 		if (get_acoustic)
 			printf(" setting acoustic management to %d\n", acoustic);
-		args[0] = ATA_OP_SETFEATURES;
-		args[1] = acoustic;
-		args[2] = acoustic ? 0x42 : 0xc2;
-		args[3] = 0;
-		if (do_drive_cmd(fd, args, 0)) {
-			err = errno;
-			perror(" HDIO_DRIVE_CMD:ACOUSTIC failed");
-		}
+		if ((err = hdparm_set_aam(fd, acoustic)))
+			fprintf(stderr, " HDIO_DRIVE_CMD:ACOUSTIC failed: %s\n", strerror(err));
 	}
 	if (set_write_read_verify) {
 		__u8 args[4];
@@ -2330,13 +3456,41 @@ void process_dev (char *devname)
 		}
 	}
 	if (set_security) {
-		do_set_security(fd);
+		if (erase_monitor && security_command == ATA_OP_SECURITY_ERASE_UNIT) {
+			pid_t pid;
+			const char *op = enhanced_erase ? "enhanced-erase" : "security-erase";
+			id = get_identify_data(fd);
+			fflush(stdout);
+			pid = id ? fork() : -1;
+			if (pid == 0) {
+				do_set_security(fd);
+				exit(0);
+			} else if (pid == -1) {
+				/* reported as FAILED by the monitor, which still runs for the other drives */
+				if (id)
+					perror("fork()");
+				add_erase_job(fd, devname, op, 0, 0)->state = ERASE_JOB_FAILED;
+			} else {
+				add_erase_job(fd, devname, op, pid, get_erase_estimate_secs(id, enhanced_erase));
+			}
+		} else {
+			do_set_security(fd);
+		}
 	}
 	if (do_sanitize) {
 		if (do_sanitize > 1) {
 			confirm_i_know_what_i_am_doing("--sanitize", "This sanitize command destroys all user data.");
 		}
-		do_sanitize_cmd(fd);
+		if (erase_monitor && do_sanitize > 1 && sanitize_feature != SANITIZE_FREEZE_LOCK_EXT
+		 && sanitize_feature != SANITIZE_ANTIFREEZE_LOCK_EXT) {
+			/* a drive that fails to start is reported as FAILED by the monitor, not fatal here */
+			int failed = do_sanitize_cmd(fd);
+			struct erase_job *job = add_erase_job(fd, devname, sanitize_op_name(sanitize_feature), 0, 0);
+			if (failed)
+				job->state = ERASE_JOB_FAILED;
+		} else if ((err = do_sanitize_cmd(fd))) {
+			exit(err);
+		}
 	}
 	if (do_dco_identify) {
 		__u16 *dco = get_dco_identify_data(fd, 0);
@@ -2368,7 +3522,7 @@ void process_dev (char *devname)
 		}
 	}
 	if (do_dco_setmax) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			if (set_max_addr < get_lba_capacity(id))
 				confirm_i_know_what_i_am_doing("--dco-setmax", "You have requested reducing the apparent size of the drive.\nThis is a BAD idea, and can easily destroy all of the drive's contents.");
@@ -2379,7 +3533,7 @@ void process_dev (char *devname)
 			do_dco_setmax_cmd(fd);
 
 			// invalidate current IDENTIFY data
-			id = NULL; 
+			invalidate_identify_data(fd);
 		}
 	}
 	if (security_freeze) {
@@ -2411,16 +3565,16 @@ void process_dev (char *devname)
 	if (set_max_sectors) {
 		if (!quiet && get_native_max_sectors)
 			printf(" setting max visible sectors to %llu (%s)\n", set_max_addr, set_max_permanent ? "permanent" : "temporary");
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			if (set_max_addr < get_lba_capacity(id))
 				confirm_i_know_what_i_am_doing("-Nnnnnn", "You have requested reducing the apparent size of the drive.\nThis is a BAD idea, and can easily destroy all of the drive's contents.");
 			err = do_set_max_sectors(fd, set_max_addr - 1, set_max_permanent);
-			id = NULL; /* invalidate existing identify data */
+			invalidate_identify_data(fd);
 		}
 	}
 	if (make_bad_sector) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			confirm_i_know_what_i_am_doing("--make-bad-sector", "You are trying to deliberately corrupt a low-level sector on the media.\nThis is a BAD idea, and can easily result in total data loss.");
 			err = do_make_bad_sector(fd, make_bad_sector_addr, devname);
@@ -2456,7 +3610,7 @@ void process_dev (char *devname)
 		abort_if_not_full_device (fd, 0, devname, "--fwdownload requires the raw device, not a partition.");
 		confirm_i_know_what_i_am_doing("--fwdownload", "This flag has not been tested with many drives to date.\nYou are trying to deliberately overwrite the drive firmware with the contents of the specified file.\nIf this fails, your drive could be toast.");
 		confirm_please_destroy_my_drive("--fwdownload", "This might destroy the drive and well as all of the data on it.");
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			err = fwdownload(fd, id, fwpath, xfer_mode);
 			if (err)
@@ -2465,11 +3619,13 @@ void process_dev (char *devname)
 	}
 	if (read_sector)
 		err = do_read_sector(fd, read_sector_addr, devname);
+	if (read_sectors)
+		err = do_read_sectors(fd, read_sectors_addr, read_sectors_count, read_sectors_hex, devname);
 	if (drq_hsm_error) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			__u8 args[4] = {0,0,0,0};
-			args[0] = last_identify_op;
+			args[0] = get_dev_context(fd)->identify_op;
 			printf(" triggering \"stuck DRQ\" host state machine error\n");
 			flush_buffer_cache(fd);
 			sleep(1);
@@ -2479,7 +3635,7 @@ void process_dev (char *devname)
 			fprintf(stderr, "ata status=0x%02x ata error=0x%02x\n", args[0], args[1]);
 		}
 	}
-	id = NULL; /* force re-IDENTIFY in case something above modified settings */
+	invalidate_identify_data(fd); /* force re-IDENTIFY in case something above modified settings */
 	if (get_hitachi_temp) {
 		__u8 args[4] = {0xf0,0,0x01,0}; /* "Sense Condition", vendor-specific */
 		if (do_drive_cmd(fd, args, 0)) {
@@ -2496,12 +3652,27 @@ void process_dev (char *devname)
 			printf("\n drive temperature in range:  %s\n", YN(!(args[1]&0x10)) );
 		}
 	}
+	if (get_device_stats)
+		err = do_device_stats(fd, set_monitor_interval ? monitor_interval : 0, monitor_count);
+	if (get_sct_temp) {
+		id = get_identify_data(fd);
+		if (set_monitor_interval)
+			err = sct_temp_add_monitor(fd, devname);
+		else
+			err = do_sct_temp(fd, id);
+	}
+	if (get_phy_events) {
+		if (set_monitor_interval)
+			err = phy_events_add_monitor(fd, devname, reset_phy_events);
+		else
+			err = do_phy_events(fd, reset_phy_events);
+	}
 	if (do_defaults || get_mult || do_identity) {
 		multcount = -1;
 		err = 0;
 		if (ioctl(fd, HDIO_GET_MULTCOUNT, &multcount)) {
 			err = errno;
-			get_identify_data(fd);
+			id = get_identify_data(fd);
 			if (id) {
 				err = 0;
 				if ((id[59] & 0xff00) == 0x100)
@@ -2625,21 +3796,10 @@ void process_dev (char *devname)
 		}
 	}
 	if (get_powermode) {
-		__u8 args[4] = {ATA_OP_CHECKPOWERMODE1,0,0,0};
+		int mode;
 		const char *state = "unknown";
-		if (do_drive_cmd(fd, args, 0)
-		 && (args[0] = ATA_OP_CHECKPOWERMODE2) /* (single =) try again with 0x98 */
-		 && do_drive_cmd(fd, args, 0)) {
-			err = errno;
-		} else {
-			switch (args[2]) {
-				case 0x00: state = "standby";		break;
-				case 0x40: state = "NVcache_spindown";	break;
-				case 0x41: state = "NVcache_spinup";	break;
-				case 0x80: state = "idle";		break;
-				case 0xff: state = "active/idle";	break;
-			}
-		}
+		if (!(err = hdparm_get_power_mode(fd, &mode)))
+			state = hdparm_power_mode_name(mode);
 		printf(" drive state is:  %s\n", state);
 	}
 	if (do_identity) {
@@ -2660,7 +3820,7 @@ void process_dev (char *devname)
 		}
 	}
 	if (do_IDentity) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			if (do_IDentity == 2) {
 				dump_sectors(id, 1, 1, 512);
@@ -2689,8 +3849,13 @@ void process_dev (char *devname)
 			}
 		}
 	}
+	if (query_fields) {
+		id = get_identify_data(fd);
+		if (id)
+			err = identify_query(id, query_fields);
+	}
 	if (get_lookahead) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			int supported = id[82] & 0x0040;
 			if (supported) {
@@ -2703,7 +3868,7 @@ void process_dev (char *devname)
 		}
 	}
 	if (get_wcache) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			int supported = id[82] & 0x0020;
 			if (supported) {
@@ -2716,30 +3881,26 @@ void process_dev (char *devname)
 		}
 	}
 	if (get_apmmode) {
-		get_identify_data(fd);
-		if (id) {
+		int level, rc = hdparm_get_apm(fd, &level);
+		if (rc != EIO) {
 			printf(" APM_level	= ");
-			if ((id[83] & 0xc008) == 0x4008) {
-				if (id[86] & 0x0008)
-					printf("%u\n", id[91] & 0xff);
-				else
-					printf("off\n");
-			} else
+			if (rc)
 				printf("not supported\n");
+			else if (level == 255)
+				printf("off\n");
+			else
+				printf("%u\n", level);
 		}
 	}
 	if (get_acoustic) {
-		get_identify_data(fd);
-		if (id) {
-			int supported = id[83] & 0x200;
-			if (supported) 
-				printf(" acoustic      = %2u (128=quiet ... 254=fast)\n", id[94] & 0xff);
-			else
-				printf(" acoustic      = not supported\n");
-		}
+		int level, rc = hdparm_get_aam(fd, &level);
+		if (!rc)
+			printf(" acoustic      = %2u (128=quiet ... 254=fast)\n", level);
+		else if (rc != EIO)
+			printf(" acoustic      = not supported\n");
 	}
 	if (get_write_read_verify) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 				int supported = id[119] & 0x2;
 				if (supported)
@@ -2757,7 +3918,7 @@ void process_dev (char *devname)
 		}
 	}
 	if (get_native_max_sectors) {
-		get_identify_data(fd);
+		id = get_identify_data(fd);
 		if (id) {
 			__u64 visible = get_lba_capacity(id);
 			__u64 native  = do_get_native_max_sectors(fd);
@@ -2783,7 +3944,7 @@ void process_dev (char *devname)
 					__u16 *dco = get_dco_identify_data(fd, 1);
 					if (dco) {
 						__u64 dco_max = dco[5];
-						dco_max = ((((__u64)dco[5]) << 32) | (dco[4] << 16) | dco[3]) + 1;
+						dco_max = ((((__u64)dco[5]) << 32) | ((__u64)dco[4] << 16) | dco[3]) + 1;
 						printf("(%llu?)", dco_max);
 					}
 					printf(", HPA setting seems invalid");
@@ -2796,12 +3957,61 @@ void process_dev (char *devname)
 		
 
 	}	
-	if (do_ctimings)
-		time_cache(fd);
+	if (do_ctimings || do_timings || do_write_timings || do_tune_readahead || do_short_stroke || measure_alignment_penalty || do_zone_timings)
+		timing_init();
+	/* --baseline-* must only ever see this device's results */
+	memset(&timing_results, 0, sizeof(timing_results));
+	if (timing_cpu != ~0ULL && (do_ctimings || do_timings))
+		err = pin_to_cpu(timing_cpu);
+	if (timing_node != ~0ULL && (do_ctimings || do_timings))
+		err = bind_to_numa_node(timing_node);
+	if (do_ctimings && timing_per_node) {
+		int node, nodes = numa_num_nodes();
+
+		for (node = 0; node < nodes; ++node) {
+			if (numa_node_online(node) && !bind_to_numa_node(node)) {
+				/* drop the pages cached from the previous node, so they are refilled on this one */
+				flush_buffer_cache(fd);
+				if ((err = time_cache(fd)))
+					timing_err = err;
+			}
+		}
+		/* back to the --cpu/--numa-node binding (if any) for the timings which follow */
+		bind_to_numa_node(-1);
+		if (timing_cpu != ~0ULL)
+			pin_to_cpu(timing_cpu);
+		if (timing_node != ~0ULL)
+			bind_to_numa_node(timing_node);
+	} else if (do_ctimings)
+		timing_err = time_cache(fd);
 	if (do_flush_wcache)
 		err = flush_wcache(fd);
-	if (do_timings)
-		err = time_device(fd);
+	if (do_timings && (err = time_device(fd)))
+		timing_err = err;
+	if (timing_err)
+		err = timing_err;
+	else if (baseline_path && (do_timings || do_ctimings))
+		err = do_baseline(fd, devname);
+	if (do_tune_readahead)
+		err = tune_readahead(fd, apply_tuned_readahead);
+	if (do_short_stroke)
+		err = plan_short_stroke(fd, devname, apply_short_stroke);
+	if (check_alignment)
+		err = do_alignment_check(fd, devname, measure_alignment_penalty);
+	if (zone_mgmt_op == ZONE_RESET)
+		confirm_please_destroy_my_drive("--zone-reset", "This erases the data in the zone(s), by moving their write pointers back to the start.");
+	else if (zone_mgmt_op == ZONE_FINISH)
+		confirm_i_know_what_i_am_doing("--zone-finish", "This fills the zone(s): nothing more can be written to them until they are reset.");
+	if (zone_mgmt_op != -1)
+		err = do_zone_mgmt(fd, devname, zone_mgmt_op, zone_mgmt_lba, zone_mgmt_all);
+	if (do_zones)
+		err = do_zone_report(fd);
+	if (do_zone_timings)
+		err = time_zones(fd);
+	if (do_write_timings) {
+		confirm_please_destroy_my_drive("--write-timings", "This will overwrite the data on the drive.");
+		err = time_device_writes(devname, do_random_write_timings);
+	}
 	if (do_flush)
 		flush_buffer_cache(fd);
 	if (set_reread_partn) {
@@ -2877,59 +4087,6 @@ void process_dev (char *devname)
 			flag = 1;				\
 	} while (0)
 
-static int fromhex (__u8 c)
-{
-	if (c >= '0' && c <= '9')
-		return (c - '0');
-	if (c >= 'a' && c <= 'f')
-		return 10 + (c - 'a');
-	if (c >= 'A' && c <= 'F')
-		return 10 + (c - 'A');
-	fprintf(stderr, "bad char: '%c' 0x%02x\n", c, c);
-	exit(EINVAL);
-}
-
-static int ishex (char c)
-{
-	return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
-}
-
-static void
-identify_from_stdin (void)
-{
-	__u16 sbuf[512];
-	int err, wc = 0;
-
-	do {
-		int digit;
-		int d[4];
-
-		if (ishex(d[digit=0] = getchar())
-		 && ishex(d[++digit] = getchar())
-		 && ishex(d[++digit] = getchar())
-		 && ishex(d[++digit] = getchar())) {
-		 	sbuf[wc] = (fromhex(d[0]) << 12) | (fromhex(d[1]) << 8) | (fromhex(d[2]) << 4) | fromhex(d[3]);
-			++wc;
-		} else if (d[digit] == EOF) {
-			goto eof;
-		} else if (wc == 0) {
-			/* skip over leading lines of cruft */
-			while (d[digit] != '\n') {
-				if (d[digit] == EOF)
-					goto eof;
-				d[digit=0] = getchar();
-			};
-		}
-	} while (wc < 256);
-	putchar('\n');
-	identify(-1, sbuf);
-	return;
-eof:
-	err = errno;
-	fprintf(stderr, "read only %u/256 IDENTIFY words from stdin: %s\n", wc, strerror(err));
-	exit(err);
-}
-
 static void
 numeric_parm (char c, const char *name, int *val, int *setparm, int *getparm, int min, int max, int set_only)
 {
@@ -3121,6 +4278,15 @@ handle_standalone_longarg (char *name)
 		identify_from_stdin();
 		exit(0);
 	}
+	/* --Ibatch takes a dump file, not a device */
+	if (0 == strcasecmp(name, "Ibatch")) {
+		if (argc != 1) {
+			if (verbose)
+				fprintf(stderr, "%s: argc(%d) != 1\n", __func__, argc);
+			usage_help(2,EINVAL);
+		}
+		exit(identify_batch(*argv));
+	}
 	if (0 == strcasecmp(name, "dco-restore")) {
 		do_dco_restore = 1;
 	} else if (0 == strcasecmp(name, "dco-setmax")) {
@@ -3204,6 +4370,33 @@ do_fallocate (const char *name)
 	exit(do_fallocate_syscall(path, blkcount * 1024));
 }
 
+/*
+ * --zone-open/--zone-close/--zone-finish/--zone-reset LBA|all
+ */
+static void
+get_zone_mgmt_parm (const char *name)
+{
+	static const char *ops[] = {"zone-open", "zone-close", "zone-finish", "zone-reset"};
+	char *val, *endp;
+
+	for (zone_mgmt_op = ZONE_OPEN; strcasecmp(name, ops[zone_mgmt_op]); ++zone_mgmt_op);
+	get_filename_parm(&val, name);
+	zone_mgmt_all = (0 == strcasecmp(val, "all"));
+	if (zone_mgmt_all) {
+		if (zone_mgmt_op == ZONE_OPEN) {
+			fprintf(stderr, "  %s: needs an LBA: opening every zone would exceed the open zone limit\n", name);
+			exit(EINVAL);
+		}
+	} else {
+		errno = 0;
+		zone_mgmt_lba = strtoull(val, &endp, 0);
+		if (errno || endp == val || *endp) {
+			fprintf(stderr, "  %s: bad/missing LBA (or \"all\")\n", name);
+			exit(EINVAL);
+		}
+	}
+}
+
 static void
 do_fibmap_file (const char *name)
 {
@@ -3240,11 +4433,44 @@ get_longarg (void)
 	} else if (0 == strcasecmp(name, "please-destroy-my-drive")) {
 		please_destroy_my_drive = 1;
 		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "hpa-audit")) {
+		hpa_audit = 1;
+		get_u64_parm(1, 0, NULL, &hpa_audit_timeout, 1, 24 * 60 * 60, name, "bad per-device timeout (seconds)");
+	} else if (0 == strcasecmp(name, "erase-monitor")) {
+		erase_monitor = 1;
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "interval")) {
+		get_u64_parm(0, 0, NULL, &monitor_interval, 1, 24 * 60 * 60, name, "bad/missing interval (seconds)");
+		set_monitor_interval = 1;
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "count")) {
+		get_u64_parm(0, 0, NULL, &monitor_count, 0, ~0U, name, "bad/missing sample count");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "device-stats")) {
+		get_device_stats = 1;
+	} else if (0 == strcasecmp(name, "sct-temp")) {
+		get_sct_temp = 1;
+	} else if (0 == strcasecmp(name, "phy-events")) {
+		get_phy_events = 1;
+	} else if (0 == strcasecmp(name, "phy-events-reset")) {
+		get_phy_events = 1;
+		reset_phy_events = 1;
 	} else if (0 == strcasecmp(name, "direct")) {
 		open_flags |= O_DIRECT;
 		--num_flags_processed;	/* doesn't count as an action flag */
 	} else if (0 == strcasecmp(name, "drq-hsm-error")) {
 		drq_hsm_error = 1;
+	} else if (0 == strcasecmp(name, "emulate")) {
+		emulate = 1;
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "emulate-latency")) {
+		emulate = 1;
+		get_u64_parm(0, 0, NULL, &emulate_latency, 0, 10000000, name, "bad/missing latency (microseconds)");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "emulate-errors")) {
+		emulate = 1;
+		get_filename_parm(&emulate_errors, name);
+		--num_flags_processed;	/* doesn't count as an action flag */
 	} else if (0 == strcasecmp(name, "dco-freeze")) {
 		do_dco_freeze = 1;
 	} else if (0 == strcasecmp(name, "dco-identify")) {
@@ -3297,9 +4523,112 @@ get_longarg (void)
 			do_set_sector_size = 1;
 	} else if (0 == strcasecmp(name, "trim-sector-ranges-stdin")) {
 		trim_from_stdin = 1;
+	} else if (0 == strcasecmp(name, "baseline-save") || 0 == strcasecmp(name, "baseline-check")) {
+		baseline_save = (0 == strcasecmp(name, "baseline-save"));
+		get_filename_parm(&baseline_path, name);
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "baseline-threshold")) {
+		get_u64_parm(0, 0, NULL, &baseline_threshold, 1, 100, name, "bad/missing threshold (percent of baseline)");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "tune-readahead")) {
+		do_tune_readahead = 1;
+	} else if (0 == strcasecmp(name, "tune-readahead-apply")) {
+		do_tune_readahead = 1;
+		apply_tuned_readahead = 1;
+	} else if (0 == strcasecmp(name, "short-stroke-plan")) {
+		do_short_stroke = 1;
+	} else if (0 == strcasecmp(name, "short-stroke-apply")) {
+		do_short_stroke = 1;
+		apply_short_stroke = 1;
+	} else if (0 == strcasecmp(name, "short-stroke-mbps") || 0 == strcasecmp(name, "short-stroke-p99")) {
+		double *target = (0 == strcasecmp(name, "short-stroke-mbps")) ? &short_stroke_MBps : &short_stroke_p99_ms;
+		char *val, *endp;
+		get_filename_parm(&val, name);
+		*target = strtod(val, &endp);
+		if (endp == val || *endp || *target <= 0) {
+			fprintf(stderr, "  %s: bad/missing target (%s)\n", name, target == &short_stroke_MBps ? "MB/sec" : "milliseconds");
+			exit(EINVAL);
+		}
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "alignment-check")) {
+		check_alignment = 1;
+	} else if (0 == strcasecmp(name, "alignment-penalty")) {
+		check_alignment = 1;
+		measure_alignment_penalty = 1;
+	} else if (0 == strcasecmp(name, "zones")) {
+		do_zones = 1;
+	} else if (0 == strcasecmp(name, "zone-timings")) {
+		do_zone_timings = 1;
+		get_u64_parm(1, 0, NULL, &zone_timings_count, 0, ~0U, name, "bad number of zones to time (0 for all)");
+	} else if (0 == strcasecmp(name, "zone-open") || 0 == strcasecmp(name, "zone-close")
+		|| 0 == strcasecmp(name, "zone-finish") || 0 == strcasecmp(name, "zone-reset")) {
+		get_zone_mgmt_parm(name);
+	} else if (0 == strcasecmp(name, "write-timings")) {
+		do_write_timings = 1;
+	} else if (0 == strcasecmp(name, "write-timings-random")) {
+		do_write_timings = 1;
+		do_random_write_timings = 1;
+	} else if (0 == strcasecmp(name, "cpu")) {
+		get_u64_parm(0, 0, NULL, &timing_cpu, 0, 1023, name, "bad/missing CPU number");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "numa-node")) {
+		get_u64_parm(0, 0, NULL, &timing_node, 0, 1023, name, "bad/missing NUMA node number");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "per-node")) {
+		timing_per_node = 1;
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "hugepages")) {
+		timing_use_hugepages(1);
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "duration")) {
+		get_u64_parm(0, 0, NULL, &timings_duration, 1, 24 * 60 * 60, name, "bad/missing duration (seconds)");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "iterations")) {
+		get_u64_parm(0, 0, NULL, &timings_iterations, 1, ~0U, name, "bad/missing iteration count");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "repeat")) {
+		get_u64_parm(0, 0, NULL, &timings_repeat, 1, MAX_TIMING_RUNS, name, "bad/missing repeat count (1-1000)");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "until-stable")) {
+		char *cv, *endp;
+		get_filename_parm(&cv, name);
+		timings_until_stable = strtod(cv, &endp);
+		if (endp == cv || *endp || timings_until_stable <= 0) {
+			fprintf(stderr, "  %s: bad/missing coefficient of variation (percent)\n", name);
+			exit(EINVAL);
+		}
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "warmup")) {
+		get_u64_parm(0, 0, NULL, &timings_warmup, 0, 100, name, "bad/missing warm-up run count");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "tsc")) {
+		timing_use_tsc(1);
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "replay")) {
+		get_filename_parm(&replay_path, name);
+	} else if (0 == strcasecmp(name, "replay-writes")) {
+		replay_writes = 1;
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "replay-qdepth")) {
+		get_u64_parm(0, 0, NULL, &replay_qdepth, 1, 256, name, "bad/missing queue depth (1-256)");
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "replay-speedup")) {
+		char *speed, *endp;
+		get_filename_parm(&speed, name);
+		replay_speedup = strtod(speed, &endp);
+		if (endp == speed || *endp || replay_speedup < 0) {
+			fprintf(stderr, "  %s: bad/missing speedup factor (0 = as fast as possible)\n", name);
+			exit(EINVAL);
+		}
+		--num_flags_processed;	/* doesn't count as an action flag */
+	} else if (0 == strcasecmp(name, "repair-sectors-stdin")) {
+		repair_from_stdin = 1;
+	} else if (0 == strcasecmp(name, "repair-reverify")) {
+		repair_reverify = 1;
+		--num_flags_processed;	/* doesn't count as an action flag */
 	} else if (0 == strcasecmp(name, "trim-sector-ranges")) {
 		int i, optional = 0, max_ranges = argc;
-		trim_sector_ranges = malloc(sizeof(struct sector_range_s) * max_ranges);
+		trim_sector_ranges = malloc(sizeof(struct hdparm_lba_range) * max_ranges);
 		if (!trim_sector_ranges) {
 			int err = errno;
 			perror("malloc()");
@@ -3308,7 +4637,7 @@ get_longarg (void)
 		open_flags |= O_RDWR;
 		for (i = 0; i < max_ranges; ++i) {
 			char err_prefix[64];
-			struct sector_range_s *p = &trim_sector_ranges[i];
+			struct hdparm_lba_range *p = &trim_sector_ranges[i];
 			sprintf(err_prefix, "%s[%u]", name, i);
 			if (!get_u64_parm(optional, 0, NULL, &(p->lba), 0, lba_limit, err_prefix, lba_emsg))
 				break;
@@ -3323,6 +4652,17 @@ get_longarg (void)
 	} else if (0 == strcasecmp(name, "write-sector") || 0 == strcasecmp(name, "repair-sector")) {
 		write_sector = 1;
 		get_u64_parm(0, 0, NULL, &write_sector_addr, 0, lba_limit, name, lba_emsg);
+	} else if (0 == strcasecmp(name, "read-sectors") || 0 == strcasecmp(name, "read-sectors-hex")) {
+		read_sectors = 1;
+		read_sectors_hex = (0 == strcasecmp(name, "read-sectors-hex"));
+		get_u64_parm(0, 0, NULL, &read_sectors_addr, 0, lba_limit, name, "bad/missing LBA:COUNT");
+		if (*argp != ':') {
+			fprintf(stderr, "  %s: bad/missing LBA:COUNT\n", name);
+			exit(EINVAL);
+		}
+		++argp;
+		get_u64_parm(0, 0, NULL, &read_sectors_count, 1, lba_limit, name, "bad/missing LBA:COUNT");
+		quiet = 1;	/* keep the device name out of the output stream */
 	} else if (0 == strcasecmp(name, "read-sector")) {
 		read_sector = 1;
 		get_u64_parm(0, 0, NULL, &read_sector_addr, 0, lba_limit, name, lba_emsg);
@@ -3331,6 +4671,10 @@ get_longarg (void)
 	} else if (0 == strcasecmp(name, "Iraw")) {
 		do_IDentity = 3;
 		get_filename_parm(&raw_identify_path, name);
+	} else if (0 == strcasecmp(name, "query")) {
+		get_filename_parm(&query_fields, name);
+		if (identify_query(NULL, query_fields))
+			exit(EINVAL);
 	} else if (0 == strcasecmp(name, "security-mode")) {
 		if (argc && isalpha(**argv)) {
 			argp = *argv++, --argc;
@@ -3476,5 +4820,13 @@ int main (int _argc, char **_argv)
 		if (!argc)
 			usage_help(11,EINVAL);
 	}
+	if (sct_temp_have_monitors())
+		exit(sct_temp_run_monitor(monitor_interval, monitor_count));
+	if (phy_events_have_monitors())
+		exit(phy_events_run_monitor(monitor_interval, monitor_count, reset_phy_events));
+	if (erase_jobs)
+		exit(run_erase_monitor());
+	if (hpa_audit_jobs)
+		exit(run_hpa_audit());
 	return 0;
 }
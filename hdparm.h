@@ -2,6 +2,8 @@
 
 //#undef __KERNEL_STRICT_NAMES
 #include <sys/types.h>
+#include <stdio.h>
+#include "libhdparm.h"
 
 #if !defined(__GNUC__) && !defined(__attribute__)
 #define __attribute__(x)
@@ -10,6 +12,9 @@
 #define lba28_limit ((__u64)(1<<28) - 1)
 
 void identify (int fd, __u16 *id_supplied);
+int identify_query (const __u16 *id, const char *fields);
+void decode_identify (const __u16 *idw, struct hdparm_identity *ident);
+void id_to_string (const __u16 *w, unsigned int nwords, char *out);
 void usage_error(int out) __attribute__((noreturn));
 void no_scsi (void);
 void no_xt (void);
@@ -17,11 +22,92 @@ void process_dev (char *devname);
 int sysfs_get_attr (int fd, const char *attr, const char *fmt, void *val1, void *val2, int verbose);
 int sysfs_set_attr (int fd, const char *attr, const char *fmt, void *val_p, int verbose);
 int sysfs_get_attr_recursive (int fd, const char *attr, const char *fmt, void *val1, void *val2, int verbose);
+int sysfs_get_path_attr (const char *dir, const char *attr, const char *fmt, void *val1, void *val2, int verbose);
 
 int get_dev_geometry (int fd, __u32 *cyls, __u32 *heads, __u32 *sects, __u64 *start_lba, __u64 *nsectors);
 int get_dev_t_geometry (dev_t dev, __u32 *cyls, __u32 *heads, __u32 *sects,
 				__u64 *start_lba, __u64 *nsectors, unsigned int *sector_bytes);
 int do_filemap(const char *file_name);
+int print_file_extent (const struct hdparm_extent *e, void *arg);
+int identify_batch (const char *path);
+int do_alignment_check (int fd, const char *devname, int measure);
+
+/* textio.c */
+/*
+ * A DSM/TRIM payload being filled from "lba:count" pairs on a stream.
+ */
+struct trim_batch {
+	__u64		*data;		/* range entries, little-endian */
+	unsigned int	max_ranges;
+	unsigned int	nranges;
+	__u64		nsectors;
+	unsigned int	total_ranges;	/* parsed so far, for error messages */
+	int		eof;
+};
+int  read_trim_batch (FILE *fp, __u64 lba_limit, struct trim_batch *b);
+void dump_sectors (__u16 *w, unsigned int count, int raw, unsigned int sector_bytes);
+int  fromhex (__u8 c);
+void identify_from_stdin (void);
+
+/* zoned.c */
+enum { ZONE_OPEN, ZONE_CLOSE, ZONE_FINISH, ZONE_RESET };
+/*
+ * The zoned block device ABI from <linux/blkzoned.h>, defined locally
+ * (as for BLKGETSIZE64 below) so that hdparm still builds against kernel
+ * headers which predate it (4.10), or predate BLKGETNRZONES (5.2),
+ * BLKOPENZONE etc. (5.5) or the zone capacity field (5.9).
+ * The layouts are fixed by the kernel ABI; older kernels just leave
+ * the newer fields zero, or fail the newer ioctls with ENOTTY.
+ */
+struct hd_zone {
+	__u64	start;		/* sectors */
+	__u64	len;
+	__u64	wp;
+	__u8	type;
+	__u8	cond;
+	__u8	non_seq;
+	__u8	reset;
+	__u8	resv[4];
+	__u64	capacity;	/* valid if HD_ZONE_REP_CAPACITY */
+	__u8	reserved[24];
+};
+struct hd_zone_report {
+	__u64	sector;
+	__u32	nr_zones;
+	__u32	flags;
+	struct hd_zone zones[0];
+};
+struct hd_zone_range {
+	__u64	sector;
+	__u64	nr_sectors;
+};
+enum {	HD_ZONE_TYPE_CONVENTIONAL = 0x1, HD_ZONE_TYPE_SEQWRITE_REQ = 0x2,
+	HD_ZONE_TYPE_SEQWRITE_PREF = 0x3 };
+enum {	HD_ZONE_COND_NOT_WP = 0x0, HD_ZONE_COND_EMPTY = 0x1, HD_ZONE_COND_IMP_OPEN = 0x2,
+	HD_ZONE_COND_EXP_OPEN = 0x3, HD_ZONE_COND_CLOSED = 0x4, HD_ZONE_COND_READONLY = 0xd,
+	HD_ZONE_COND_FULL = 0xe, HD_ZONE_COND_OFFLINE = 0xf };
+#define HD_ZONE_REP_CAPACITY	(1 << 0)
+
+#undef  BLKREPORTZONE
+#undef  BLKRESETZONE
+#undef  BLKGETZONESZ
+#undef  BLKGETNRZONES
+#undef  BLKOPENZONE
+#undef  BLKCLOSEZONE
+#undef  BLKFINISHZONE
+#define BLKREPORTZONE	_IOWR(0x12,130,struct hd_zone_report)
+#define BLKRESETZONE	_IOW(0x12,131,struct hd_zone_range)
+#define BLKGETZONESZ	_IOR(0x12,132,__u32)
+#define BLKGETNRZONES	_IOR(0x12,133,__u32)
+#define BLKOPENZONE	_IOW(0x12,134,struct hd_zone_range)
+#define BLKCLOSEZONE	_IOW(0x12,135,struct hd_zone_range)
+#define BLKFINISHZONE	_IOW(0x12,136,struct hd_zone_range)
+
+int  zone_report (int fd, struct hd_zone **zones, unsigned int *nzones);
+__u64 zone_readable_sectors (const struct hd_zone *z);
+const char *zone_type_name (int type);
+int  do_zone_report (int fd);
+int  do_zone_mgmt (int fd, const char *devname, int op, __u64 lba, int all);
 int do_fallocate_syscall (const char *name, __u64 bytecount);
 int fwdownload (int fd, __u16 *id, const char *fwpath, int xfer_mode);
 void dco_identify_print (__u16 *dco);
@@ -33,12 +119,135 @@ int  wdidle3_get_timeout (int fd, unsigned char *timeout);
 void wdidle3_print_timeout (unsigned char timeout);
 unsigned char wdidle3_msecs_to_timeout (unsigned int msecs);
 
-int get_log_page_data (int fd, __u8 log_address, __u8 pagenr, __u8 *buf);
+int do_device_stats (int fd, unsigned int interval, unsigned int count);
+int do_sct_temp (int fd, __u16 *id);
+int sct_temp_add_monitor (int fd, const char *devname);
+int sct_temp_have_monitors (void);
+int sct_temp_run_monitor (unsigned int interval, unsigned int count);
+
+/* timing.c */
+#define TIMING_BUF_MB		HDPARM_TIMING_BUF_MB
+#define TIMING_BUF_BYTES	HDPARM_TIMING_BUF_BYTES
+struct hdparm_timer {
+	__u64	start_ns;
+	__u64	lap_ns;
+};
+void   timing_init (void);
+void   timing_use_tsc (int enable);
+const char *timing_clock_name (void);
+__u64  timing_now_ns (void);
+void   timer_start (struct hdparm_timer *t);
+double timer_lap (struct hdparm_timer *t);
+double timer_stop (struct hdparm_timer *t);
+void   timing_use_hugepages (int enable);
+void  *alloc_timing_buf (unsigned int len);
+void  *prepare_timing_buf (unsigned int len);
+int    read_big_block (int fd, char *buf);
+
+/* stats.c */
+struct run_stats {
+	unsigned int	n;
+	double		min, max, mean, median, stddev, cv, ci95;
+};
+void   compute_run_stats (const double *v, unsigned int n, struct run_stats *st);
+double sorted_percentile (const double *v, unsigned int n, double pct);
+void   sort_doubles (double *v, unsigned int n);
+
+/* baseline.c */
+#define BASELINE_ZONES	8
+struct timing_results {
+	int		have_cached, have_buffered;
+	double		cached_MBps, buffered_MBps;
+	double		lat_p50_ms, lat_p99_ms, lat_max_ms;
+	unsigned int	nzones;
+	double		zone_MBps[BASELINE_ZONES];
+};
+int  baseline_save_results (const char *path, const char *key, struct timing_results *r);
+int  baseline_check_results (const char *path, const char *key, struct timing_results *r, double fraction);
+
+int numa_num_nodes (void);
+int numa_node_online (int node);
+int numa_node_of (void *addr);
+int pin_to_cpu (int cpu);
+int bind_to_numa_node (int node);
+int do_replay (const char *devname, const char *path, double speedup, unsigned int qdepth, int allow_writes);
+int do_phy_events (int fd, int reset);
+int phy_events_add_monitor (int fd, const char *devname, int reset);
+int phy_events_have_monitors (void);
+int phy_events_run_monitor (unsigned int interval, unsigned int count, int reset);
+
+/* libhdparm.c */
+__u16 *get_identify_words (int fd, int refresh);
+__u64 get_lba_capacity (__u16 *idw);
 int get_current_sector_size (int fd);
+int get_log_page_data (int fd, __u8 log_address, __u8 pagenr, __u8 *buf);
+int read_log_ext (int fd, __u8 log_address, unsigned int pagenr, unsigned int npages, __u16 feat, void *buf);
+unsigned int get_log_page_count (int fd, __u8 log_address);
+__u8 *get_log_data (int fd, __u8 log_address, unsigned int *npages);
+unsigned int get_trim_payload_sectors (int fd, __u16 *idw);
+int trim_ranges_cmd (int fd, void *data, unsigned int nranges);
+
+/*
+ * How to talk to a device, learned from the first few commands and
+ * then honoured for every later one, so that each fallback costs
+ * at most one failed round-trip per device (rather than per command).
+ */
+enum {
+	TRANSPORT_UNKNOWN	= 0,
+	TRANSPORT_SG_IO,		/* SCSI ATA PASS-THROUGH via SG_IO */
+	TRANSPORT_HDIO,			/* SG_IO unsupported: legacy HDIO_DRIVE_* ioctls only */
+	TRANSPORT_EMULATED,		/* --emulate image file */
+};
+
+struct ata_tf;
+struct transport_profile {
+	int		method;		/* TRANSPORT_* */
+	int		ata12_broken;	/* ATA_12 CDB rejected: always use ATA_16 */
+	int		no_read_log_dma; /* READ LOG DMA EXT failed: use READ LOG EXT */
+	const char	*bridge;	/* USB bridge type from apt_detect(), or NULL if not yet probed */
+	unsigned int	sense_warned;	/* "questionable/missing sense data" already reported */
+	/* TRANSPORT_EMULATED: emulate.c's command handler, hooked in by emu_attach() */
+	int		(*emulate) (int fd, int rw, int dma, struct ata_tf *tf,
+				void *data, unsigned int data_bytes, unsigned int timeout_secs);
+};
+
+/*
+ * Everything hdparm learns about a device, shared by every fd open on it
+ * (keyed by dev/inode), so that nothing device-specific lives in globals.
+ * Lookups and creation are safe from multiple threads; the contents of a
+ * context are not locked, so each device should be driven by one thread.
+ */
+struct apt_data_struct;
+struct emu_dev;
+
+struct dev_context {
+	struct dev_context	*next;
+	dev_t			dev;
+	ino_t			ino;
+	int			have_identify;	/* libhdparm.c: IDENTIFY data cache */
+	__u8			identify_op;	/* ATA_OP_IDENTIFY or ATA_OP_PIDENTIFY */
+	__u16			identify[256];	/* host byte order */
+	struct transport_profile transport;	/* sgio.c */
+	struct apt_data_struct	*apt;		/* apt.c: USB bridge state */
+	struct emu_dev		*emu;		/* emulate.c: --emulate state */
+	char			*sysfs_path;	/* sysfs.c: /sys/block/.. directory */
+	int			sysfs_err;	/* sysfs.c: non-zero if not found */
+	char			*sysfs_attr_dir;/* sysfs.c: parent holding idVendor etc. */
+	int			have_log_dir;	/* libhdparm.c: General Purpose Log cache */
+	__u16			log_dir[256];	/* number of pages in each log */
+	__u8			*logs[256];	/* entire log contents, read on first use */
+};
+
+struct dev_context *get_dev_context (int fd);
+struct transport_profile *get_transport_profile (int fd);
 
 /* APT Functions */
 int apt_detect (int fd, int verbose);
-int apt_is_apt (void);
+int apt_is_apt (int fd);
+
+/* Emulated device (emulate.c) */
+int emu_attach (int fd, const char *devname, unsigned int latency_us, const char *errors, int verbose);
+int emu_is_emulated (int fd);
 
 extern const char *BuffType[4];
 
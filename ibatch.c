@@ -0,0 +1,326 @@
+/*
+ * --Ibatch: decode a file of many concatenated --Istdout dumps
+ * (eg. an inventory archive of a whole fleet), and print one
+ * tab-separated key=value record per drive.
+ *
+ * The file is mmap'd and split into runs of hex lines, each normally
+ * a single dump preceded by its "/dev/sdX:" line.  The runs are decoded
+ * (with a lookup table, rather than per-character getchar()/fromhex())
+ * by forked workers, one per CPU, into a shared array of results,
+ * which are then printed in file order.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+extern int verbose;  /* libhdparm.c */
+
+#define IBATCH_MAX_WORKERS	64
+#define IBATCH_MIN_RUNS		256	/* per worker: fewer are not worth a fork() */
+#define DUMP_MIN_BYTES		(256 * 5)	/* 256 4-digit words, each with a separator */
+
+struct ibatch_run {
+	const char	*label;		/* eg. "/dev/sda", from the line before the run */
+	unsigned int	label_len;
+	const char	*start, *end;
+	unsigned int	first;		/* index of its first result slot */
+	unsigned int	nslots;
+};
+
+enum { SLOT_UNUSED = 0, SLOT_DECODED, SLOT_MALFORMED };
+
+struct ibatch_result {
+	int			state;		/* SLOT_* */
+	unsigned int		nwords;		/* words found, if malformed */
+	struct hdparm_identity	ident;
+};
+
+static signed char hexval[256];
+static unsigned char is_space[256];
+
+static void init_tables (void)
+{
+	int c;
+
+	memset(hexval, -1, sizeof(hexval));
+	for (c = '0'; c <= '9'; ++c)
+		hexval[c] = c - '0';
+	for (c = 'a'; c <= 'f'; ++c)
+		hexval[c] = hexval[c - 'a' + 'A'] = 10 + (c - 'a');
+	is_space[' '] = is_space['\t'] = is_space['\n'] = is_space['\r'] = 1;
+}
+
+/*
+ * Value of the 4-digit hex word at p, or -1.
+ */
+static inline int hexword (const unsigned char *p)
+{
+	int a = hexval[p[0]], b = hexval[p[1]], c = hexval[p[2]], d = hexval[p[3]];
+
+	if ((a | b | c | d) < 0)
+		return -1;
+	return (a << 12) | (b << 8) | (c << 4) | d;
+}
+
+static int is_dump_line (const char *p, const char *end)
+{
+	if (end - p < 4 || hexword((const unsigned char *)p) < 0)
+		return 0;
+	return (end - p == 4) || is_space[(unsigned char)p[4]];
+}
+
+/*
+ * Split the file into runs of consecutive dump lines,
+ * each labelled with the non-blank line (if any) just before it.
+ */
+static int find_runs (const char *map, size_t len, struct ibatch_run **runsp, unsigned int *nruns, unsigned int *nslots)
+{
+	struct ibatch_run *runs = NULL, *r = NULL;
+	const char *p = map, *end = map + len, *label = NULL, *eol;
+	unsigned int n = 0, max = 0, slots = 0, label_len = 0;
+
+	while (p < end) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		if (is_dump_line(p, eol)) {
+			if (!r) {
+				if (n == max) {
+					struct ibatch_run *new = realloc(runs, (max + 4096) * sizeof(*runs));
+					if (!new) {
+						perror("realloc()");
+						free(runs);
+						return ENOMEM;
+					}
+					runs = new;
+					max += 4096;
+				}
+				r = &runs[n++];
+				r->label     = label;
+				r->label_len = label_len;
+				r->start     = p;
+			}
+			r->end = eol;
+		} else {
+			const char *e = eol;
+			r = NULL;
+			while (e > p && (is_space[(unsigned char)e[-1]] || e[-1] == ':'))
+				--e;
+			label     = (e > p) ? p : NULL;	/* a blank line forgets the label */
+			label_len = e - p;
+		}
+		p = eol + 1;
+	}
+	for (r = runs; r < runs + n; ++r) {
+		/* room for every complete dump in the run, plus a malformed remainder */
+		r->first  = slots;
+		r->nslots = (r->end - r->start + 1) / DUMP_MIN_BYTES + 1;
+		slots += r->nslots;
+	}
+	*runsp  = runs;
+	*nruns  = n;
+	*nslots = slots;
+	return 0;
+}
+
+static void decode_run (struct ibatch_run *r, struct ibatch_result *res)
+{
+	const unsigned char *p = (const unsigned char *)r->start, *end = (const unsigned char *)r->end;
+	unsigned int nwords = 0, n = 0;
+	__u16 w[256];
+	int v;
+
+	while (p < end) {
+		if (is_space[*p]) {
+			++p;
+			continue;
+		}
+		if (end - p < 4 || (v = hexword(p)) < 0 || (end - p > 4 && !is_space[p[4]]))
+			break;	/* not a 4-digit word: the rest of the run is unusable */
+		w[nwords++] = v;
+		p += 4;
+		if (nwords == 256) {
+			decode_identify(w, &res[n].ident);
+			res[n++].state = SLOT_DECODED;
+			nwords = 0;
+		}
+	}
+	if ((p < end || nwords || !n) && n < r->nslots) {
+		res[n].state  = SLOT_MALFORMED;
+		res[n].nwords = nwords;
+	}
+}
+
+static const char *checksum_status (const __u16 *w)
+{
+	unsigned int i;
+	__u8 sum = 0;
+
+	if ((w[255] & 0xff) != 0xa5)
+		return "none";
+	for (i = 0; i < 256; ++i)
+		sum += (w[i] & 0xff) + (w[i] >> 8);
+	return sum ? "bad" : "ok";
+}
+
+static void print_record (unsigned int n, struct ibatch_run *r, struct ibatch_result *res)
+{
+	static const char *features[] = {"lba48", "trim", "apm", "aam", "smart", "security",
+		"write_cache", "write_cache_enabled", "gpl", "ncq", "sanitize"};
+	struct hdparm_identity *id = &res->ident;
+	unsigned int i, comma = 0;
+
+	printf("dump=%u", n);
+	if (r->label)
+		printf("\tdevice=%.*s", r->label_len, r->label);
+	if (res->state == SLOT_MALFORMED) {
+		printf("\terror=malformed dump (%u/256 words)\n", res->nwords);
+		return;
+	}
+	/* the same names as for --query */
+	printf("\tmodel=%s\tserial=%s\tfirmware=%s\tsectors=%llu\tlogical_sector_size=%u\tphysical_sector_size=%u",
+		id->model, id->serial, id->firmware, id->sectors, id->logical_sector_bytes, id->physical_sector_bytes);
+	if (id->rotation_rate == 1)
+		printf("\trotation_rate=ssd");
+	else if (id->rotation_rate)
+		printf("\trotation_rate=%u", id->rotation_rate);
+	else
+		printf("\trotation_rate=unknown");
+	printf("\tfeatures=");
+	for (i = 0; i < sizeof(features) / sizeof(features[0]); ++i) {
+		if (id->features & (1 << i))
+			printf("%s%s", comma++ ? "," : "", features[i]);
+	}
+	printf("\tchecksum=%s\n", checksum_status(id->words));
+}
+
+/*
+ * Decode runs [from, to) in a child, or in-line if there is only one worker.
+ */
+static pid_t start_worker (struct ibatch_run *runs, unsigned int from, unsigned int to, struct ibatch_result *res, int fork_it)
+{
+	unsigned int i;
+	pid_t pid = 0;
+
+	if (fork_it) {
+		pid = fork();
+		if (pid)
+			return pid;	/* parent, or -1 */
+	}
+	for (i = from; i < to; ++i)
+		decode_run(&runs[i], res + runs[i].first);
+	if (fork_it)
+		_exit(0);
+	return pid;
+}
+
+int identify_batch (const char *path)
+{
+	struct ibatch_run *runs = NULL;
+	struct ibatch_result *res = MAP_FAILED;
+	unsigned int nruns, nslots, nworkers, w, i, j, ndumps = 0, nbad = 0;
+	pid_t pids[IBATCH_MAX_WORKERS];
+	size_t res_bytes = 0;
+	struct stat st;
+	long ncpus;
+	char *map;
+	int fd, err = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st)) {
+		err = errno;
+		perror(path);
+		return err;
+	}
+	if (st.st_size == 0) {
+		fprintf(stderr, "%s: empty file\n", path);
+		close(fd);
+		return EINVAL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		err = errno;
+		perror("mmap()");
+		return err;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	init_tables();
+
+	err = find_runs(map, st.st_size, &runs, &nruns, &nslots);
+	if (err)
+		goto out;
+	if (!nruns) {
+		fprintf(stderr, "%s: no IDENTIFY dumps found\n", path);
+		err = EINVAL;
+		goto out;
+	}
+	res_bytes = nslots * sizeof(*res);
+	res = mmap(NULL, res_bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED) {
+		err = errno;
+		perror("mmap(MAP_ANONYMOUS)");
+		goto out;
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nworkers = nruns / IBATCH_MIN_RUNS;
+	if (nworkers > (unsigned int)ncpus)
+		nworkers = ncpus;
+	if (nworkers > IBATCH_MAX_WORKERS)
+		nworkers = IBATCH_MAX_WORKERS;
+	if (nworkers < 1)
+		nworkers = 1;
+	fflush(stdout);
+	for (w = 0; w < nworkers; ++w) {
+		pids[w] = start_worker(runs, nruns * (__u64)w / nworkers, nruns * (__u64)(w + 1) / nworkers, res, nworkers > 1);
+		if (pids[w] == -1) {
+			err = errno;
+			perror("fork()");
+			nworkers = w;
+		}
+	}
+	for (w = 0; w < nworkers; ++w) {
+		int status;
+		if (pids[w] > 0 && (waitpid(pids[w], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status))) {
+			fprintf(stderr, "%s: decoding worker %u failed\n", path, w);
+			err = EIO;
+		}
+	}
+	if (err)
+		goto out;
+
+	for (i = 0; i < nruns; ++i) {
+		for (j = 0; j < runs[i].nslots; ++j) {
+			struct ibatch_result *r = &res[runs[i].first + j];
+			if (r->state == SLOT_UNUSED)
+				break;
+			print_record(ndumps++, &runs[i], r);
+			if (r->state == SLOT_MALFORMED)
+				++nbad;
+		}
+	}
+	if (verbose)
+		fprintf(stderr, "%s: %u dumps (%u malformed), decoded by %u worker(s)\n", path, ndumps, nbad, nworkers);
+	if (nbad)
+		err = EINVAL;
+out:
+	if (res != MAP_FAILED)
+		munmap(res, res_bytes);
+	free(runs);
+	munmap(map, st.st_size);
+	return err;
+}
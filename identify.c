@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <stddef.h>
 #include <linux/types.h>
 #include <endian.h>
 
@@ -165,6 +166,9 @@ const char *pkt_str[] = {
 	"",					/* word 0, bits 12-8 = 1e */
 	"Unknown",				/* word 0, bits 12-8 = 1f */
 };
+
+const char *BuffType[4] = {"unknown", "1Sect", "DualPort", "DualPortCache"};
+
 const char *ata1_cfg_str[] = {			/* word 0 in ATA-1 mode */
 	"reserved",				/* bit 0 */
 	"hard sectored",			/* bit 1 */
@@ -546,6 +550,27 @@ static const char *feat_sct_str[16] = {
 
 __u8 mode_loop(__u16 mode_sup, __u16 mode_sel, int cc, __u8 *have_mode);
 
+/*
+ * Identify strings are stored two characters per word, high byte first,
+ * and padded with spaces.
+ */
+void id_to_string (const __u16 *w, unsigned int nwords, char *out)
+{
+	unsigned int i, len = 0;
+	char *p = out;
+
+	for (i = 0; i < nwords; ++i) {
+		*p++ = w[i] >> 8;
+		*p++ = w[i] & 0xff;
+	}
+	*p = '\0';
+	for (p = out; *p == ' '; ++p);
+	memmove(out, p, strlen(p) + 1);
+	len = strlen(out);
+	while (len && (out[len - 1] == ' ' || out[len - 1] == '\0'))
+		out[--len] = '\0';
+}
+
 static void print_ascii(__u16 *p, unsigned int length) {
 	__u8 ii;
 	char cl;
@@ -710,6 +735,420 @@ print_logical_sector_sizes (int fd)
 		printf(" ]");
 }
 
+/*
+ * Structured IDENTIFY decode, for --query.
+ *
+ * identify() is a report, which tests and prints as it goes.
+ * Here the commonly wanted values are decoded once into struct id_fields
+ * (strings and feature bits driven from the tables below), and --query
+ * then prints just the fields asked for, as name=value lines.
+ */
+struct id_fields {
+	char	model[41], serial[21], firmware[9], media_serial[41];
+	__u64	lba28_sectors, lba48_sectors, sectors, capacity_bytes;
+	__u64	wwn;				/* 0 if not reported */
+	__u64	supported, enabled;		/* (1 << n) for id_features[n] */
+	__u32	logical_sector_bytes, physical_sector_bytes, alignment_offset;
+	__u16	rotation_rate;			/* 1 for solid state, 0 if not reported */
+	__u16	form_factor, queue_depth, trim_limit;
+	__u16	erase_minutes, enh_erase_minutes;
+	__u16	security;			/* word 128, if the feature set is supported */
+	__u8	transport;			/* word 222 bits 15:12, or 0xff if not reported */
+	__u8	sata_max_gen, sata_cur_gen;	/* 1,2,3 for 1.5,3.0,6.0Gb/s; 0 if not reported */
+	__u8	udma_max, udma_cur;		/* 0xff if none */
+	__u8	apm_level, aam_level;
+	__u8	chksum;				/* of all 512 bytes: zero if intact */
+	__u8	has_signature;			/* word 255 checksum is valid */
+};
+
+static const struct {
+	__u8	word, nwords;
+	__u16	offset;
+} id_strings[] = {
+	{START_MODEL,	LENGTH_MODEL,	offsetof(struct id_fields, model)},
+	{START_SERIAL,	LENGTH_SERIAL,	offsetof(struct id_fields, serial)},
+	{START_FW_REV,	LENGTH_FW_REV,	offsetof(struct id_fields, firmware)},
+	{START_MEDIA,	LENGTH_MEDIA,	offsetof(struct id_fields, media_serial)},
+};
+
+/* features with no enable word (en_word == 0) are never reported as enabled */
+static const struct {
+	const char	*name;
+	__u8		sup_word, en_word, bit;
+} id_features[] = {
+	{"smart",			CMDS_SUPP_0,	CMDS_EN_0,	 0},
+	{"security",			CMDS_SUPP_0,	CMDS_EN_0,	 1},
+	{"power_management",		CMDS_SUPP_0,	CMDS_EN_0,	 3},
+	{"write_cache",			CMDS_SUPP_0,	CMDS_EN_0,	 5},
+	{"look_ahead",			CMDS_SUPP_0,	CMDS_EN_0,	 6},
+	{"hpa",				CMDS_SUPP_0,	CMDS_EN_0,	10},
+	{"apm",				CMDS_SUPP_1,	CMDS_EN_1,	 3},
+	{"puis",			CMDS_SUPP_1,	CMDS_EN_1,	 5},
+	{"aam",				CMDS_SUPP_1,	CMDS_EN_1,	 9},
+	{"lba48",			CMDS_SUPP_1,	CMDS_EN_1,	10},
+	{"dco",				CMDS_SUPP_1,	CMDS_EN_1,	11},
+	{"flush_cache_ext",		CMDS_SUPP_1,	CMDS_EN_1,	13},
+	{"smart_error_log",		CMDS_SUPP_2,	CMDS_EN_2,	 0},
+	{"smart_self_test",		CMDS_SUPP_2,	CMDS_EN_2,	 1},
+	{"gpl",				CMDS_SUPP_2,	CMDS_EN_2,	 5},
+	{"fua",				CMDS_SUPP_2,	CMDS_EN_2,	 6},
+	{"write_read_verify",		CMDS_SUPP_3,	CMDS_EN_3,	 1},
+	{"download_microcode_dma",	CMDS_SUPP_3,	CMDS_EN_3,	 4},
+	{"ncq",				SATA_CAP_0,	0,		 8},
+	{"ncq_priority",		SATA_CAP_0,	0,		12},
+	{"dipm",			SATA_SUPP_0,	SATA_EN_0,	 3},
+	{"devslp",			SATA_SUPP_0,	SATA_EN_0,	 8},
+	{"trim",			169,		0,		 0},
+	{"deterministic_trim",		69,		0,		14},
+	{"trim_zeroes",			69,		0,		 5},
+	{"sanitize",			SECTOR_XFER_CUR, 0,		12},
+	{"crypto_scramble",		SECTOR_XFER_CUR, 0,		13},
+	{"overwrite_erase",		SECTOR_XFER_CUR, 0,		14},
+	{"block_erase",			SECTOR_XFER_CUR, 0,		15},
+	{"sct",				SCT_SUPP,	0,		 0},
+	{"sct_erc",			SCT_SUPP,	0,		 3},
+};
+#define NUM_ID_FEATURES	(sizeof(id_features) / sizeof(id_features[0]))
+
+/*
+ * Whether a feature word (or pair) holds valid data: words 82..87
+ * and 119..120 carry their own validity bits, the rest are
+ * simply unused when zero or all-ones.
+ */
+static int id_word_valid (const __u16 *val, __u8 word)
+{
+	switch (word) {
+		case CMDS_SUPP_0: case CMDS_SUPP_1: case CMDS_EN_0: case CMDS_EN_1:
+			return (val[CMDS_SUPP_1] & VALID) == VALID_VAL;
+		case CMDS_SUPP_2: case CMDS_EN_2:
+			return (val[CMDS_SUPP_2] & VALID) == VALID_VAL && (val[CMDS_EN_2] & VALID) == VALID_VAL;
+		case CMDS_SUPP_3: case CMDS_EN_3:
+			return (val[CMDS_EN_1] & 0x8000) && (val[CMDS_SUPP_3] & VALID) == VALID_VAL
+				&& (val[CMDS_EN_3] & VALID) == VALID_VAL;
+	}
+	return val[word] && val[word] != 0xffff;
+}
+
+static unsigned int highest_bit (unsigned int bits)
+{
+	unsigned int n = 0;
+
+	while (bits >>= 1)
+		++n;
+	return n;
+}
+
+static unsigned int erase_minutes (__u16 w)
+{
+	/* ACS-3 extended format has 15 bits, the original only 8 */
+	return 2 * ((w & 0x8000) ? (w & 0x7fff) : (w & 0x00ff));
+}
+
+static void decode_id_fields (const __u16 *val, struct id_fields *f)
+{
+	unsigned int i;
+
+	memset(f, 0, sizeof(*f));
+	for (i = 0; i < sizeof(id_strings) / sizeof(id_strings[0]); ++i)
+		id_to_string(val + id_strings[i].word, id_strings[i].nwords, (char *)f + id_strings[i].offset);
+
+	for (i = 0; i < NUM_ID_FEATURES; ++i) {
+		__u16 mask = 1 << id_features[i].bit;
+		if (!id_word_valid(val, id_features[i].sup_word) || !(val[id_features[i].sup_word] & mask))
+			continue;
+		f->supported |= 1ULL << i;
+		if (id_features[i].en_word && id_word_valid(val, id_features[i].en_word)
+		 && (val[id_features[i].en_word] & mask))
+			f->enabled |= 1ULL << i;
+	}
+
+	f->transport = 0xff;
+	if (val[TRANSPORT_MAJOR] && val[TRANSPORT_MAJOR] != 0xffff)
+		f->transport = val[TRANSPORT_MAJOR] >> 12;
+	if (id_word_valid(val, SATA_CAP_0)) {
+		if (val[SATA_CAP_0] & 0x000e)
+			f->sata_max_gen = highest_bit(val[SATA_CAP_0] & 0x000e);
+		if (val[SATA_RESERVED_77] != 0xffff)
+			f->sata_cur_gen = (val[SATA_RESERVED_77] >> 1) & 7;
+		if (val[SATA_CAP_0] & 0x0100)
+			f->queue_depth = (val[QUEUE_DEPTH] & DEPTH_BITS) + 1;
+	}
+	if ((val[CMDS_SUPP_1] & VALID) == VALID_VAL && (val[CMDS_SUPP_1] & 2))
+		f->queue_depth = (val[QUEUE_DEPTH] & DEPTH_BITS) + 1;	/* TCQ */
+
+	if (val[CAPAB_0] & LBA_SUP)
+		f->lba28_sectors = (__u32)val[LBA_SECTS_MSB] << 16 | val[LBA_SECTS_LSB];
+	if ((val[CMDS_SUPP_1] & VALID) == VALID_VAL && (val[CMDS_SUPP_1] & SUPPORT_48_BIT))
+		f->lba48_sectors = (__u64)val[LBA_64_MSB] << 48 | (__u64)val[LBA_48_MSB] << 32
+				 | (__u64)val[LBA_MID] << 16 | val[LBA_LSB];
+	f->sectors = f->lba48_sectors ? f->lba48_sectors : f->lba28_sectors;
+	f->logical_sector_bytes = 512;
+	if ((val[106] & 0xc000) == 0x4000) {
+		if (val[106] & (1<<12))
+			f->logical_sector_bytes = 2 * ((val[118] << 16) | val[117]);
+		f->physical_sector_bytes = f->logical_sector_bytes;
+		if (val[106] & (1<<13))
+			f->physical_sector_bytes <<= (val[106] & 0xf);
+		if ((val[209] & 0xc000) == 0x4000)
+			f->alignment_offset = (val[209] & 0x1fff) * f->logical_sector_bytes;
+	} else {
+		f->physical_sector_bytes = f->logical_sector_bytes;
+	}
+	f->capacity_bytes = f->sectors * f->logical_sector_bytes;
+
+	if (val[NMRR] == 1 || (val[NMRR] >= 0x401 && val[NMRR] != 0xffff))
+		f->rotation_rate = val[NMRR];
+	if (val[168] && (val[168] & 0xfff8) == 0)
+		f->form_factor = val[168];
+	if (val[169] & 1 && val[169] != 0xffff && val[105] != 0xffff)
+		f->trim_limit = val[105];
+	if (val[CMDS_SUPP_0] & 2 && val[CMDS_SUPP_0] != 0xffff) {
+		f->security = val[SECU_STATUS];
+		f->erase_minutes     = erase_minutes(val[ERASE_TIME]);
+		f->enh_erase_minutes = erase_minutes(val[ENH_ERASE_TIME]);
+	}
+	f->udma_max = f->udma_cur = 0xff;
+	if ((val[WHATS_VALID] & OK_W88) && (val[ULTRA_DMA] & 0xff)) {
+		f->udma_max = highest_bit(val[ULTRA_DMA] & 0xff);
+		if (val[ULTRA_DMA] >> 8)
+			f->udma_cur = highest_bit(val[ULTRA_DMA] >> 8);
+	}
+	f->apm_level = val[ADV_PWR] & 0xff;
+	f->aam_level = val[ACOUSTIC] & 0xff;
+	if ((val[CMDS_SUPP_2] & VALID) == VALID_VAL && (val[CMDS_SUPP_2] & WWN_SUP))
+		f->wwn = (__u64)val[108] << 48 | (__u64)val[109] << 32 | (__u64)val[110] << 16 | val[111];
+
+	for (i = GEN_CONFIG; i <= INTEGRITY; i++)
+		f->chksum += val[i] + (val[i] >> 8);
+	f->has_signature = (val[INTEGRITY] & SIG) == SIG_VAL;
+}
+
+static int id_feature_bit (const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_ID_FEATURES && strcmp(id_features[i].name, name); ++i);
+	return i;
+}
+
+/*
+ * Decode IDENTIFY data (in host byte order) from any source, the drive
+ * or saved --Istdout dumps (--Ibatch), for libhdparm: this is filled in
+ * from decode_id_fields(), so that it always agrees with -I and --query.
+ */
+void decode_identify (const __u16 *idw, struct hdparm_identity *ident)
+{
+	static const struct {
+		const char	*name;
+		unsigned int	flag;
+	} feats[] = {
+		{"lba48",	HDPARM_FEAT_LBA48},
+		{"trim",	HDPARM_FEAT_TRIM},
+		{"apm",		HDPARM_FEAT_APM},
+		{"aam",		HDPARM_FEAT_AAM},
+		{"smart",	HDPARM_FEAT_SMART},
+		{"security",	HDPARM_FEAT_SECURITY},
+		{"write_cache",	HDPARM_FEAT_WCACHE},
+		{"gpl",		HDPARM_FEAT_GPL},
+		{"ncq",		HDPARM_FEAT_NCQ},
+		{"sanitize",	HDPARM_FEAT_SANITIZE},
+	};
+	struct id_fields f;
+	unsigned int i;
+
+	decode_id_fields(idw, &f);
+	memset(ident, 0, sizeof(*ident));
+	memcpy(ident->words, idw, sizeof(ident->words));
+	strcpy(ident->model, f.model);
+	strcpy(ident->serial, f.serial);
+	strcpy(ident->firmware, f.firmware);
+	ident->sectors               = f.sectors;
+	ident->logical_sector_bytes  = f.logical_sector_bytes;
+	ident->physical_sector_bytes = f.physical_sector_bytes;
+	ident->rotation_rate         = f.rotation_rate;
+	for (i = 0; i < sizeof(feats) / sizeof(feats[0]); ++i) {
+		if (f.supported & (1ULL << id_feature_bit(feats[i].name)))
+			ident->features |= feats[i].flag;
+	}
+	if (f.enabled & (1ULL << id_feature_bit("write_cache")))
+		ident->features |= HDPARM_FEAT_WCACHE_ON;
+}
+
+enum {
+	QF_MODEL, QF_SERIAL, QF_FIRMWARE, QF_MEDIA_SERIAL, QF_TRANSPORT, QF_SATA_MAX, QF_SATA_CUR,
+	QF_SECTORS, QF_LBA28, QF_LBA48, QF_LOGICAL, QF_PHYSICAL, QF_ALIGNMENT, QF_CAPACITY,
+	QF_ROTATION, QF_FORM_FACTOR, QF_QUEUE_DEPTH, QF_TRIM_LIMIT, QF_ERASE, QF_ENH_ERASE,
+	QF_UDMA_MAX, QF_UDMA, QF_APM, QF_AAM, QF_SECURITY, QF_WWN, QF_CHECKSUM,
+	QF_SUPPORTED, QF_ENABLED, NUM_QUERY_FIELDS
+};
+
+static const char *query_fields[NUM_QUERY_FIELDS] = {
+	"model", "serial", "firmware", "media_serial", "transport", "sata_max_speed", "sata_speed",
+	"sectors", "lba28_sectors", "lba48_sectors", "logical_sector_size", "physical_sector_size",
+	"alignment_offset", "capacity", "rotation_rate", "form_factor", "queue_depth", "trim_limit",
+	"erase_time", "enhanced_erase_time", "udma_max", "udma_mode", "apm_level", "aam_level",
+	"security_state", "wwn", "checksum", "supported", "enabled"
+};
+
+static void print_feature_list (__u64 bits)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < NUM_ID_FEATURES; ++i) {
+		if (bits & (1ULL << i))
+			printf("%s%s", n++ ? "," : "", id_features[i].name);
+	}
+}
+
+static void print_level (const struct id_fields *f, const char *feature, unsigned int level)
+{
+	unsigned int i = id_feature_bit(feature);
+
+	if (f->enabled & (1ULL << i))
+		printf("%u", level);
+	else
+		printf("%s", (f->supported & (1ULL << i)) ? "disabled" : "unsupported");
+}
+
+static void print_query_field (const struct id_fields *f, unsigned int q)
+{
+	static const char *sata_speeds[] = {"unknown", "1.5Gb/s", "3.0Gb/s", "6.0Gb/s"};
+	static const char *form_factors[] = {"unknown", "5.25", "3.5", "2.5", "1.8", "<1.8", "unknown", "unknown"};
+	unsigned int i, n = 0;
+
+	printf("%s=", query_fields[q]);
+	switch (q) {
+		case QF_MODEL:		printf("%s", f->model);					break;
+		case QF_SERIAL:		printf("%s", f->serial);				break;
+		case QF_FIRMWARE:	printf("%s", f->firmware);				break;
+		case QF_MEDIA_SERIAL:	printf("%s", f->media_serial);				break;
+		case QF_TRANSPORT:
+			if (f->transport == 0)
+				printf("parallel");
+			else if (f->transport == 1 || f->sata_max_gen)
+				printf("serial");
+			else
+				printf("unknown");
+			break;
+		case QF_SATA_MAX:	printf("%s", sata_speeds[f->sata_max_gen & 3]);		break;
+		case QF_SATA_CUR:	printf("%s", sata_speeds[f->sata_cur_gen & 3]);		break;
+		case QF_SECTORS:	printf("%llu", f->sectors);				break;
+		case QF_LBA28:		printf("%llu", f->lba28_sectors);			break;
+		case QF_LBA48:		printf("%llu", f->lba48_sectors);			break;
+		case QF_LOGICAL:	printf("%u", f->logical_sector_bytes);			break;
+		case QF_PHYSICAL:	printf("%u", f->physical_sector_bytes);			break;
+		case QF_ALIGNMENT:	printf("%u", f->alignment_offset);			break;
+		case QF_CAPACITY:	printf("%llu", f->capacity_bytes);			break;
+		case QF_ROTATION:
+			if (f->rotation_rate == 1)
+				printf("ssd");
+			else if (f->rotation_rate)
+				printf("%u", f->rotation_rate);
+			else
+				printf("unknown");
+			break;
+		case QF_FORM_FACTOR:	printf("%s", form_factors[f->form_factor & 7]);		break;
+		case QF_QUEUE_DEPTH:	printf("%u", f->queue_depth);				break;
+		case QF_TRIM_LIMIT:	printf("%u", f->trim_limit);				break;
+		case QF_ERASE:		printf("%u", f->erase_minutes);				break;
+		case QF_ENH_ERASE:	printf("%u", f->enh_erase_minutes);			break;
+		case QF_UDMA_MAX:
+		case QF_UDMA:
+			i = (q == QF_UDMA) ? f->udma_cur : f->udma_max;
+			if (i == 0xff)
+				printf("none");
+			else
+				printf("udma%u", i);
+			break;
+		case QF_APM:		print_level(f, "apm", f->apm_level);			break;
+		case QF_AAM:		print_level(f, "aam", f->aam_level);			break;
+		case QF_SECURITY:
+			for (i = 0; i < NUM_SECU_STR; ++i) {
+				static const char *secu_names[NUM_SECU_STR] = {"supported", "enabled",
+					"locked", "frozen", "expired", "enhanced_erase"};
+				if (f->security & (1 << i))
+					printf("%s%s", n++ ? "," : "", secu_names[i]);
+			}
+			break;
+		case QF_WWN:
+			if (f->wwn)
+				printf("%016llx", f->wwn);
+			else
+				printf("none");
+			break;
+		case QF_CHECKSUM:
+			printf("%s", !f->has_signature ? "none" : f->chksum ? "bad" : "ok");
+			break;
+		case QF_SUPPORTED:	print_feature_list(f->supported);			break;
+		case QF_ENABLED:	print_feature_list(f->enabled);				break;
+	}
+	putchar('\n');
+}
+
+static void print_query_feature (const struct id_fields *f, unsigned int i)
+{
+	__u64 bit = 1ULL << i;
+	const char *state = "unsupported";
+
+	if (f->enabled & bit)
+		state = "enabled";
+	else if (f->supported & bit)
+		state = id_features[i].en_word ? "disabled" : "supported";
+	printf("%s=%s\n", id_features[i].name, state);
+}
+
+/*
+ * Print the named fields (a comma separated list, or "all"),
+ * or just check the names if id is NULL.
+ */
+int identify_query (const __u16 *id, const char *fields)
+{
+	struct id_fields f;
+	const char *name = fields;
+	unsigned int i, len;
+
+	if (id)
+		decode_id_fields(id, &f);
+	while (*name) {
+		len = strcspn(name, ",");
+		if (len == 3 && !strncmp(name, "all", 3)) {
+			for (i = 0; id && i < NUM_QUERY_FIELDS; ++i)
+				print_query_field(&f, i);
+			for (i = 0; id && i < NUM_ID_FEATURES; ++i)
+				print_query_feature(&f, i);
+		} else if (len) {
+			for (i = 0; i < NUM_QUERY_FIELDS; ++i) {
+				if (strlen(query_fields[i]) == len && !strncmp(name, query_fields[i], len))
+					break;
+			}
+			if (i < NUM_QUERY_FIELDS) {
+				if (id)
+					print_query_field(&f, i);
+			} else {
+				for (i = 0; i < NUM_ID_FEATURES; ++i) {
+					if (strlen(id_features[i].name) == len && !strncmp(name, id_features[i].name, len))
+						break;
+				}
+				if (i == NUM_ID_FEATURES) {
+					fprintf(stderr, "--query: unknown field \"%.*s\"; known fields are:\n\tall", len, name);
+					for (i = 0; i < NUM_QUERY_FIELDS; ++i)
+						fprintf(stderr, " %s", query_fields[i]);
+					for (i = 0; i < NUM_ID_FEATURES; ++i)
+						fprintf(stderr, " %s", id_features[i].name);
+					fputc('\n', stderr);
+					return EINVAL;
+				}
+				if (id)
+					print_query_feature(&f, i);
+			}
+		}
+		name += len;
+		if (*name == ',')
+			++name;
+	}
+	return 0;
+}
+
 /* our main() routine: */
 void identify (int fd, __u16 *id_supplied)
 {
@@ -722,13 +1161,11 @@ void identify (int fd, __u16 *id_supplied)
 	__u32 ll, mm, nn;
 	__u64 bb, bbbig; /* (:) */
 	int transport, is_cfa = 0, atapi_has_dmadir = 0, sdma_ok;
+	struct id_fields f;
 
 	memcpy(val, id_supplied, sizeof(val));
-
-	/* calculate checksum over all bytes */
-	for (ii = GEN_CONFIG; ii<=INTEGRITY; ii++) {
-		chksum += val[ii] + (val[ii] >> 8);
-	}
+	decode_id_fields(val, &f);
+	chksum = f.chksum;
 
 	/* check if we recognise the device type */
 	printf("\n");
@@ -1054,10 +1491,10 @@ void identify (int fd, __u16 *id_supplied)
 	}
 
 	/* Spinning disk or solid state? */
-	if(val[NMRR] == 1)
+	if(f.rotation_rate == 1)
 		printf("\tNominal Media Rotation Rate: Solid State Device\n");
-	else if(val[NMRR] > 0x401)
-		printf("\tNominal Media Rotation Rate: %u\n", val[NMRR]);
+	else if(f.rotation_rate)
+		printf("\tNominal Media Rotation Rate: %u\n", f.rotation_rate);
 
 	/* hw support of commands (capabilities) */
 	printf("Capabilities:\n");
@@ -1513,7 +1950,7 @@ void dco_identify_print (__u16 *dco)
 	else if (dco[2] & (1<<0)) printf(" udma0");
 	putchar('\n');
 
-	lba = ((((__u64)dco[5]) << 32) | (dco[4] << 16) | dco[3]) + 1;
+	lba = ((((__u64)dco[5]) << 32) | ((__u64)dco[4] << 16) | dco[3]) + 1;
 	printf("\tReal max sectors: %llu\n", lba);
 
 	printf("\tATA command/feature sets:");
@@ -0,0 +1,553 @@
+/*
+ * libhdparm.c - the drive operations behind the hdparm command,
+ * as functions returning structs (see libhdparm.h).
+ *
+ * Also home to the pieces of shared state which the rest of the
+ * library needs: IDENTIFY data and the General Purpose Log cache
+ * (both kept in the device context), and the verbose/ATA_12 options.
+ * Those two are process-wide settings, made before any device is opened
+ * and only read after that, so they are safe to share between threads.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <linux/types.h>
+#include <asm/byteorder.h>
+
+#include "hdparm.h"
+#include "sgio.h"
+
+int verbose = 0;
+int prefer_ata12 = 0;
+
+/*
+ * IDENTIFY DEVICE (or IDENTIFY PACKET DEVICE, if that fails), kept in
+ * host byte order in the device context.  The drive is only asked again
+ * when refresh is set, or after a SET FEATURES issued from here.
+ */
+__u16 *get_identify_words (int fd, int refresh)
+{
+	struct dev_context *ctx;
+	__u8 args[4+512];
+	int i;
+
+	ctx = get_dev_context(fd);
+	if (!ctx)
+		return NULL;
+	if (ctx->have_identify && !refresh)
+		return ctx->identify;
+	memset(args, 0, sizeof(args));
+	ctx->identify_op = ATA_OP_IDENTIFY;
+	args[0] = ctx->identify_op;
+	args[3] = 1;	/* sector count */
+	if (do_drive_cmd(fd, args, 0)) {
+		ctx->transport.ata12_broken = 1;
+		memset(args, 0, sizeof(args));
+		ctx->identify_op = ATA_OP_PIDENTIFY;
+		args[0] = ctx->identify_op;
+		args[3] = 1;	/* sector count */
+		if (do_drive_cmd(fd, args, 0)) {
+			perror(" HDIO_DRIVE_CMD(identify) failed");
+			ctx->have_identify = 0;
+			return NULL;
+		}
+	}
+	/* byte-swap the little-endian IDENTIFY data to match byte-order on host CPU */
+	for (i = 0; i < 0x100; ++i) {
+		unsigned char *b = args + 4 + (i * 2);
+		ctx->identify[i] = b[0] | (b[1] << 8);	/* le16_to_cpu() */
+	}
+	ctx->have_identify = 1;
+	return ctx->identify;
+}
+
+__u64 get_lba_capacity (__u16 *idw)
+{
+	__u64 nsects = ((__u32)idw[58] << 16) | idw[57];
+
+	if (idw[49] & 0x200) {
+		nsects = ((__u32)idw[61] << 16) | idw[60];
+		if ((idw[83] & 0xc000) == 0x4000 && (idw[86] & 0x0400)) {
+			nsects = (__u64)idw[103] << 48 | (__u64)idw[102] << 32 |
+			         (__u64)idw[101] << 16 | idw[100];
+		}
+	}
+	return nsects;
+}
+
+static unsigned int identify_sector_bytes (__u16 *idw)
+{
+	unsigned int words = 256;
+
+	if(idw && (idw[106] & 0xc000) == 0x4000) {
+		if (idw[106] & (1<<12))
+			words = (idw[118] << 16) | idw[117];
+	}
+	return 2 * words;
+}
+
+int get_current_sector_size (int fd)
+{
+	return identify_sector_bytes(get_identify_words(fd, 0));
+}
+
+/*
+ * Read npages of a General Purpose Log, starting at pagenr,
+ * using as few READ_LOG_EXT (or READ_LOG_DMA_EXT) commands as the
+ * transfer size limit (max_sectors_kb) of the device allows.
+ * This always goes to the drive, bypassing the cached copies below.
+ */
+int read_log_ext (int fd, __u8 log_address, unsigned int pagenr, unsigned int npages, __u16 feat, void *buf)
+{
+	struct dev_context *ctx = get_dev_context(fd);
+	struct hdio_taskfile *r;
+	unsigned int max_kb, max_pages, chunk;
+	__u8 ata_op = ATA_OP_READ_LOG_EXT, *dst = buf;
+	__u16 *idw = get_identify_words(fd, 0);
+	int err = 0;
+
+	if (!(ctx && ctx->transport.no_read_log_dma) && idw && (idw[119] & 0xc008) == 0x4008)
+		ata_op = ATA_OP_READ_LOG_DMA_EXT;
+	if (sysfs_get_attr(fd, "queue/max_sectors_kb", "%u", &max_kb, NULL, 0) || max_kb == 0)
+		max_pages = 128;	/* "safe" default for most controllers */
+	else
+		max_pages = max_kb * 2;
+	if (max_pages > 0xffff)
+		max_pages = 0xffff;
+	chunk = (npages < max_pages) ? npages : max_pages;
+
+	r = malloc(sizeof(struct hdio_taskfile) + (chunk * 512));
+	if (!r) {
+		err = errno;
+		perror("malloc()");
+		return err;
+	}
+	while (npages) {
+		__u64 lba = log_address | ((pagenr & 0xff) << 8) | ((__u64)(pagenr >> 8) << 32);
+
+		if (chunk > npages)
+			chunk = npages;
+		init_hdio_taskfile(r, ata_op, RW_READ, LBA48_FORCE, lba, chunk, chunk * 512);
+		r->lob.feat = feat;
+		r->hob.feat = feat >> 8;
+		r->oflags.bits.lob.feat = 1;
+		r->oflags.bits.hob.feat = 1;
+		if (do_taskfile_cmd(fd, r, 15)) {
+			err = errno;
+			if (ata_op == ATA_OP_READ_LOG_DMA_EXT) {
+				/* some controllers/bridges mishandle the DMA variant: fall back to PIO */
+				if (ctx)
+					ctx->transport.no_read_log_dma = 1;
+				ata_op = ATA_OP_READ_LOG_EXT;
+				err = 0;
+				continue;
+			}
+			break;
+		}
+		memcpy(dst, r->data, chunk * 512);
+		dst    += chunk * 512;
+		pagenr += chunk;
+		npages -= chunk;
+	}
+	free(r);
+	return err;
+}
+
+/*
+ * The General Purpose Log directory (log 0), and any logs read through it,
+ * are kept in the device context for the lifetime of the process.
+ */
+static struct dev_context *get_log_context (int fd)
+{
+	struct dev_context *ctx;
+	__u16 *idw;
+	int i, err;
+
+	ctx = get_dev_context(fd);
+	if (!ctx || ctx->have_log_dir)
+		return ctx;
+	idw = get_identify_words(fd, 0);
+	if (!idw)
+		return NULL;
+	if (!(idw[84] & (1 << 5)))
+		return NULL;  /* General Purpose Logging (READ_LOG_EXT) not supported */
+	err = read_log_ext(fd, 0, 0, 1, 0, ctx->log_dir);
+	if (err) {
+		fprintf(stderr, "READ_LOG_EXT(0,0) failed: %s\n", strerror(err));
+		return NULL;
+	}
+	for (i = 0; i < 256; ++i)
+		ctx->log_dir[i] = __le16_to_cpu(ctx->log_dir[i]);
+	ctx->have_log_dir = 1;
+	return ctx;
+}
+
+/*
+ * Return the size (in 512-byte pages) of a General Purpose Log,
+ * as reported by the log directory, or zero if it is not supported.
+ */
+unsigned int get_log_page_count (int fd, __u8 log_address)
+{
+	struct dev_context *ctx = get_log_context(fd);
+
+	if (!ctx || !log_address)
+		return 0;
+	return ctx->log_dir[log_address];
+}
+
+/*
+ * Return the entire contents of a General Purpose Log,
+ * reading it from the drive (in one go) only the first time.
+ */
+__u8 *get_log_data (int fd, __u8 log_address, unsigned int *npages)
+{
+	struct dev_context *ctx = get_log_context(fd);
+	unsigned int count;
+	int err;
+
+	if (!ctx || !(count = ctx->log_dir[log_address]))
+		return NULL;
+	if (!ctx->logs[log_address]) {
+		__u8 *data = malloc(count * 512);
+		if (!data) {
+			perror("malloc()");
+			return NULL;
+		}
+		err = read_log_ext(fd, log_address, 0, count, 0, data);
+		if (err) {
+			fprintf(stderr, "READ_LOG_EXT(0x%02x, 0..%u) failed: %s\n", log_address, count - 1, strerror(err));
+			free(data);
+			return NULL;
+		}
+		ctx->logs[log_address] = data;
+	}
+	if (npages)
+		*npages = count;
+	return ctx->logs[log_address];
+}
+
+int get_log_page_data (int fd, __u8 log_address, __u8 pagenr, __u8 *buf)
+{
+	unsigned int npages = 0;
+	__u8 *data = get_log_data(fd, log_address, &npages);
+
+	if (!data || npages <= pagenr)
+		return -ENOENT;
+	memcpy(buf, data + (pagenr * 512), 512);
+	return 0;
+}
+
+static void
+extract_id_string (__u16 *idw, int words, char *dst)
+{
+	char *e;
+	int bytes = words * 2;
+
+	memcpy(dst, idw, bytes);
+	dst[bytes] = '\0';
+	for (e = dst + bytes; --e != dst;) {
+		if (*e && *e != ' ')
+			break;
+		*e = '\0';
+	}
+}
+
+static unsigned int
+get_trim_dev_limit (__u16 *idw)
+{
+	char model[41];
+
+	if (idw[105] && idw[105] != 0xffff)
+		return idw[105];
+	extract_id_string(idw + 27, 20, model);
+	if (0 == strcmp(model, "OCZ VERTEX-LE"))
+		return 8;
+	if (0 == strcmp(model, "OCZ-VERTEX"))
+		return 64;
+	return 1;  /* all other drives, including Intel SSDs */
+}
+
+/*
+ * Largest DSM/TRIM payload (in 512-byte sectors, each of 64 ranges)
+ * which both the drive and the controller will accept in one command.
+ */
+unsigned int get_trim_payload_sectors (int fd, __u16 *idw)
+{
+	unsigned int max_kb, data_sects, dev_limit = get_trim_dev_limit(idw);
+
+	if (sysfs_get_attr(fd, "queue/max_sectors_kb", "%u", &max_kb, NULL, 0) || max_kb == 0)
+		data_sects = 128;	/* "safe" default for most controllers */
+	else
+		data_sects = max_kb * 2;
+	if (data_sects > dev_limit)
+		data_sects = dev_limit;
+	return data_sects;
+}
+
+/*
+ * Issue one DSM/TRIM command for nranges (little-endian) range entries.
+ * The buffer must be zero-filled up to the next 512-byte boundary.
+ */
+int trim_ranges_cmd (int fd, void *data, unsigned int nranges)
+{
+	struct ata_tf tf;
+	unsigned int data_bytes = nranges * sizeof(__u64);
+	unsigned int data_sects = (data_bytes + 511) / 512;
+
+	data_bytes = data_sects * 512;
+	tf_init(&tf, ATA_OP_DSM, 0, data_sects);
+	tf.lob.feat = 0x01;	/* DSM/TRIM */
+
+	if (sg16(fd, SG_WRITE, SG_DMA, &tf, data, data_bytes, 300 /* seconds */))
+		return errno;
+	return 0;
+}
+
+int hdparm_identify (int fd, struct hdparm_identity *ident)
+{
+	__u16 *idw = get_identify_words(fd, 1);
+
+	if (!idw) {
+		memset(ident, 0, sizeof(*ident));
+		return EIO;
+	}
+	decode_identify(idw, ident);
+	return 0;
+}
+
+int hdparm_get_power_mode (int fd, int *mode)
+{
+	__u8 args[4] = {ATA_OP_CHECKPOWERMODE1,0,0,0};
+
+	if (do_drive_cmd(fd, args, 0)
+	 && (args[0] = ATA_OP_CHECKPOWERMODE2) /* (single =) try again with 0x98 */
+	 && do_drive_cmd(fd, args, 0))
+		return errno;
+	*mode = args[2];
+	return 0;
+}
+
+const char *hdparm_power_mode_name (int mode)
+{
+	switch (mode) {
+		case HDPARM_POWER_STANDBY:		return "standby";
+		case HDPARM_POWER_NVCACHE_SPINDOWN:	return "NVcache_spindown";
+		case HDPARM_POWER_NVCACHE_SPINUP:	return "NVcache_spinup";
+		case HDPARM_POWER_IDLE:			return "idle";
+		case HDPARM_POWER_ACTIVE:		return "active/idle";
+	}
+	return "unknown";
+}
+
+/*
+ * SET FEATURES changes what IDENTIFY reports, so the cached copy
+ * is refreshed on the next use.
+ */
+static int set_features (int fd, __u8 feature, __u8 nsect)
+{
+	__u8 args[4] = {ATA_OP_SETFEATURES,0,0,0};
+	struct dev_context *ctx;
+
+	args[1] = nsect;	/* sector count register */
+	args[2] = feature;	/* feature register */
+	if (do_drive_cmd(fd, args, 0))
+		return errno;
+	ctx = get_dev_context(fd);
+	if (ctx)
+		ctx->have_identify = 0;
+	return 0;
+}
+
+int hdparm_get_apm (int fd, int *level)
+{
+	__u16 *idw = get_identify_words(fd, 0);
+
+	if (!idw)
+		return EIO;
+	if ((idw[83] & 0xc008) != 0x4008)
+		return EOPNOTSUPP;
+	*level = (idw[86] & 0x0008) ? (idw[91] & 0xff) : 255;
+	return 0;
+}
+
+int hdparm_set_apm (int fd, int level)
+{
+	if (level == 255)
+		return set_features(fd, 0x85, 0);	/* disable Advanced Power Management */
+	return set_features(fd, 0x05, level);
+}
+
+int hdparm_get_aam (int fd, int *level)
+{
+	__u16 *idw = get_identify_words(fd, 0);
+
+	if (!idw)
+		return EIO;
+	if (!(idw[83] & 0x200))
+		return EOPNOTSUPP;
+	*level = idw[94] & 0xff;
+	return 0;
+}
+
+int hdparm_set_aam (int fd, int level)
+{
+	return set_features(fd, level ? 0x42 : 0xc2, level);
+}
+
+int hdparm_trim (int fd, const struct hdparm_lba_range *ranges, unsigned int nranges)
+{
+	__u64 *data, lba, count, chunk;
+	unsigned int data_bytes, max_ranges, n = 0, i;
+	__u16 *idw = get_identify_words(fd, 0);
+	int err = 0;
+
+	if (!idw)
+		return EIO;
+	/* an entry holds a 48-bit LBA, so anything beyond the drive would alias another range */
+	lba = get_lba_capacity(idw);
+	for (i = 0; i < nranges; ++i) {
+		if (ranges[i].lba >= lba || ranges[i].nsectors > lba - ranges[i].lba)
+			return EINVAL;
+	}
+	data_bytes = get_trim_payload_sectors(fd, idw) * 512;
+	max_ranges = data_bytes / sizeof(*data);
+	data = mmap(NULL, data_bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED) {
+		err = errno;
+		perror("mmap(MAP_ANONYMOUS)");
+		return err;
+	}
+	memset(data, 0, data_bytes);
+	for (i = 0; i < nranges && !err; ++i) {
+		lba   = ranges[i].lba;
+		count = ranges[i].nsectors;
+		while (count && !err) {
+			/* each range entry covers at most 65535 sectors */
+			chunk = (count > 0xffff) ? 0xffff : count;
+			data[n++] = __cpu_to_le64((chunk << 48) | lba);
+			lba   += chunk;
+			count -= chunk;
+			if (n == max_ranges) {
+				err = trim_ranges_cmd(fd, data, n);
+				memset(data, 0, data_bytes);
+				n = 0;
+			}
+		}
+	}
+	if (!err && n)
+		err = trim_ranges_cmd(fd, data, n);
+	munmap(data, data_bytes);
+	return err;
+}
+
+unsigned int hdparm_log_pages (int fd, __u8 log_address)
+{
+	return get_log_page_count(fd, log_address);
+}
+
+int hdparm_read_log (int fd, __u8 log_address, unsigned int pagenr, unsigned int npages, void *buf)
+{
+	return read_log_ext(fd, log_address, pagenr, npages, 0, buf);
+}
+
+const __u8 *hdparm_get_log (int fd, __u8 log_address, unsigned int *npages)
+{
+	return get_log_data(fd, log_address, npages);
+}
+
+void *hdparm_timing_buf_alloc (void)
+{
+	return alloc_timing_buf(HDPARM_TIMING_BUF_BYTES);
+}
+
+void hdparm_timing_buf_free (void *buf)
+{
+	munmap(buf, HDPARM_TIMING_BUF_BYTES);
+}
+
+static int timing_more (struct hdparm_timing *t, double seconds, unsigned int max_reads)
+{
+	if (max_reads && t->reads >= max_reads)
+		return 0;
+	return !seconds || t->seconds < seconds;
+}
+
+int hdparm_time_cached_reads (int fd, void *buf, double seconds, unsigned int max_reads, struct hdparm_timing *t)
+{
+	struct hdparm_timer tm;
+	int err;
+
+	memset(t, 0, sizeof(*t));
+	if (!seconds && !max_reads)
+		return EINVAL;
+	/* Count only the reads themselves (not the lseek()s) */
+	timer_start(&tm);
+	do {
+		if (lseek(fd, 0, SEEK_SET)) {
+			perror("lseek() failed");
+			return EIO;
+		}
+		timer_lap(&tm);
+		if ((err = read_big_block(fd, buf)))
+			return err;
+		t->seconds += timer_lap(&tm);
+		++t->reads;
+	} while (timing_more(t, seconds, max_reads));
+	t->MBps = t->reads * HDPARM_TIMING_BUF_MB / t->seconds;
+	return 0;
+}
+
+int hdparm_time_device_reads (int fd, void *buf, __u64 offset, double seconds, unsigned int max_reads, struct hdparm_timing *t)
+{
+	struct hdparm_timer tm;
+	double *lat = NULL;
+	unsigned int lat_max = 0;
+	int err = 0;
+
+	memset(t, 0, sizeof(*t));
+	if (!seconds && !max_reads)
+		return EINVAL;
+	if (lseek(fd, offset, SEEK_SET) == (off_t)-1) {
+		err = errno;
+		perror("lseek() failed");
+		return err;
+	}
+	timer_start(&tm);
+	do {
+		double secs;
+
+		++t->reads;
+		if ((err = read_big_block(fd, buf)))
+			break;
+		secs = timer_lap(&tm);
+		if (t->reads > lat_max) {
+			double *p = realloc(lat, (lat_max + 1024) * sizeof(*lat));
+			if (p) {
+				lat = p;
+				lat_max += 1024;
+			}
+		}
+		if (t->reads <= lat_max)
+			lat[t->reads - 1] = secs * 1000;
+		t->seconds = timer_stop(&tm);
+	} while (timing_more(t, seconds, max_reads));
+	if (!err) {
+		unsigned int n = (t->reads < lat_max) ? t->reads : lat_max;
+
+		t->MBps = t->reads * HDPARM_TIMING_BUF_MB / t->seconds;
+		sort_doubles(lat, n);
+		t->lat_p50_ms = sorted_percentile(lat, n, 50);
+		t->lat_p99_ms = sorted_percentile(lat, n, 99);
+		t->lat_max_ms = n ? lat[n - 1] : 0;
+	}
+	free(lat);
+	return err;
+}
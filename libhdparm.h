@@ -0,0 +1,160 @@
+/*
+ * libhdparm.h - C interface to the hdparm drive operations,
+ * for programs which would otherwise run hdparm and parse its output.
+ *
+ * Link with -lhdparm (libhdparm.a or libhdparm.so).
+ *
+ * The device functions take an fd opened on the device (O_RDONLY|O_NONBLOCK
+ * is sufficient, as for the hdparm command), and return zero on success
+ * or an errno value on failure.  Diagnostics, if any, go to stderr.
+ * State learned about a device (transport, logs, IDENTIFY data) is kept
+ * per device for the life of the process, so repeated calls are cheap.
+ * Calls for different devices may be made from different threads,
+ * but each device should only be used by one thread at a time.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#ifndef LIBHDPARM_H
+#define LIBHDPARM_H
+
+#include <linux/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HDPARM_API_VERSION	1
+
+/*
+ * IDENTIFY DEVICE, decoded.
+ */
+enum {
+	HDPARM_FEAT_LBA48	= (1 << 0),
+	HDPARM_FEAT_TRIM	= (1 << 1),	/* DATA SET MANAGEMENT / TRIM */
+	HDPARM_FEAT_APM		= (1 << 2),	/* Advanced Power Management */
+	HDPARM_FEAT_AAM		= (1 << 3),	/* Automatic Acoustic Management */
+	HDPARM_FEAT_SMART	= (1 << 4),
+	HDPARM_FEAT_SECURITY	= (1 << 5),
+	HDPARM_FEAT_WCACHE	= (1 << 6),	/* write cache supported */
+	HDPARM_FEAT_WCACHE_ON	= (1 << 7),	/* write cache enabled */
+	HDPARM_FEAT_GPL		= (1 << 8),	/* General Purpose Logging (READ LOG EXT) */
+	HDPARM_FEAT_NCQ		= (1 << 9),
+	HDPARM_FEAT_SANITIZE	= (1 << 10),
+};
+
+struct hdparm_identity {
+	char		model[41];
+	char		serial[21];
+	char		firmware[9];
+	__u64		sectors;		/* user addressable capacity, in logical sectors */
+	unsigned int	logical_sector_bytes;
+	unsigned int	physical_sector_bytes;
+	unsigned int	rotation_rate;		/* rpm; 1 for solid state, 0 if not reported */
+	unsigned int	features;		/* HDPARM_FEAT_* */
+	__u16		words[256];		/* the raw IDENTIFY data, in host byte order */
+};
+
+int hdparm_identify (int fd, struct hdparm_identity *ident);
+
+/*
+ * CHECK POWER MODE.  The mode is the value returned by the drive,
+ * one of HDPARM_POWER_* for drives which follow the spec.
+ */
+enum {
+	HDPARM_POWER_STANDBY		= 0x00,
+	HDPARM_POWER_NVCACHE_SPINDOWN	= 0x40,
+	HDPARM_POWER_NVCACHE_SPINUP	= 0x41,
+	HDPARM_POWER_IDLE		= 0x80,
+	HDPARM_POWER_ACTIVE		= 0xff,	/* active or idle */
+};
+
+int hdparm_get_power_mode (int fd, int *mode);
+const char *hdparm_power_mode_name (int mode);
+
+/*
+ * Advanced Power Management level: 1..254, or 255 for "disabled".
+ * Automatic Acoustic Management level: 128 (quiet) .. 254 (fast), or 0 for "disabled".
+ * The get functions return EOPNOTSUPP if the drive lacks the feature.
+ */
+int hdparm_get_apm (int fd, int *level);
+int hdparm_set_apm (int fd, int level);
+int hdparm_get_aam (int fd, int *level);
+int hdparm_set_aam (int fd, int level);
+
+/*
+ * TRIM the given ranges, in as few DATA SET MANAGEMENT commands as the
+ * drive and controller allow.  Ranges of any length may be given,
+ * but nothing is trimmed (EINVAL) if any of them runs past the end of the drive.
+ */
+struct hdparm_lba_range {
+	__u64		lba;
+	__u64		nsectors;
+};
+
+int hdparm_trim (int fd, const struct hdparm_lba_range *ranges, unsigned int nranges);
+
+/*
+ * General Purpose Logs.  hdparm_read_log() always goes to the drive;
+ * hdparm_get_log() reads an entire log once, and returns the same copy
+ * (owned by the library) on later calls.
+ */
+unsigned int hdparm_log_pages (int fd, __u8 log_address);
+int hdparm_read_log (int fd, __u8 log_address, unsigned int pagenr, unsigned int npages, void *buf);
+const __u8 *hdparm_get_log (int fd, __u8 log_address, unsigned int *npages);
+
+/*
+ * Read timings, as for "hdparm -T" (cached) and "hdparm -t" (device).
+ * Each read is of HDPARM_TIMING_BUF_BYTES into a buffer from
+ * hdparm_timing_buf_alloc(), which is locked in memory until
+ * hdparm_timing_buf_free(); nothing else in the process is locked,
+ * and callers wanting the system to settle first must wait themselves.
+ * A run ends after max_reads reads, or after the given number of seconds,
+ * whichever comes first; zero means no limit, but at least one read is
+ * always done.  Giving zero for both is an error (EINVAL).
+ */
+#define HDPARM_TIMING_BUF_MB	2
+#define HDPARM_TIMING_BUF_BYTES	(HDPARM_TIMING_BUF_MB * 1024 * 1024)
+
+struct hdparm_timing {
+	unsigned int	reads;
+	double		seconds;
+	double		MBps;
+	double		lat_p50_ms, lat_p99_ms, lat_max_ms;	/* per read (device timings only) */
+};
+
+void *hdparm_timing_buf_alloc (void);
+void  hdparm_timing_buf_free (void *buf);
+int hdparm_time_cached_reads (int fd, void *buf, double seconds, unsigned int max_reads, struct hdparm_timing *t);
+int hdparm_time_device_reads (int fd, void *buf, __u64 offset, double seconds, unsigned int max_reads, struct hdparm_timing *t);
+
+/*
+ * Map a file to the device LBAs holding it (FIEMAP, or FIBMAP if that
+ * is unsupported), as for "hdparm --fibmap".  The callback is invoked for
+ * each extent in file order, and a non-zero return from it stops the walk
+ * and is returned.  Holes and extents of unknown location have begin_lba
+ * and end_lba of zero; unknown extents also have nsectors of zero.
+ */
+struct hdparm_file_map {
+	unsigned int	blksize;		/* filesystem block size */
+	unsigned int	sector_bytes;
+	__u64		start_lba;		/* of the filesystem, on the whole device */
+};
+
+struct hdparm_extent {
+	__u64		byte_offset;		/* within the file */
+	__u64		begin_lba;
+	__u64		end_lba;
+	__u64		nsectors;
+};
+
+typedef int (*hdparm_extent_fn) (const struct hdparm_extent *ext, void *arg);
+
+int hdparm_map_file (const char *path, struct hdparm_file_map *map, hdparm_extent_fn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBHDPARM_H */
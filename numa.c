@@ -0,0 +1,167 @@
+/*
+ * CPU/NUMA placement helpers for the -T/-t timing buffers.
+ *
+ * These use the raw syscalls rather than libnuma, to avoid a new dependency.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT	0
+#define MPOL_BIND	2
+#endif
+
+#define NUMA_MAX_NODES	1024
+#define NODE_SYSFS	"/sys/devices/system/node"
+
+/*
+ * Parse a sysfs list such as "0-3,8-11" into a callback per entry.
+ */
+static int parse_sysfs_list (const char *path, void (*fn)(unsigned int n, void *arg), void *arg)
+{
+	char buf[4096], *p;
+	FILE *fp;
+	int count = 0;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	if (!fgets(buf, sizeof(buf), fp)) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	for (p = buf; *p && *p != '\n'; ) {
+		unsigned int lo, hi, n;
+		char *end;
+
+		lo = hi = strtoul(p, &end, 10);
+		if (end == p)
+			break;
+		p = end;
+		if (*p == '-') {
+			hi = strtoul(++p, &end, 10);
+			p = end;
+		}
+		for (n = lo; n <= hi; ++n, ++count)
+			fn(n, arg);
+		if (*p == ',')
+			++p;
+	}
+	return count;
+}
+
+static void count_node (unsigned int n, void *arg)
+{
+	int *max = arg;
+
+	if ((int)n >= *max)
+		*max = n + 1;
+}
+
+/*
+ * Returns the number of node ids (highest online node + 1), or 1 on non-NUMA systems.
+ */
+int numa_num_nodes (void)
+{
+	int max = 0;
+
+	if (parse_sysfs_list(NODE_SYSFS "/online", count_node, &max) <= 0 || max < 1)
+		return 1;
+	return max;
+}
+
+int numa_node_online (int node)
+{
+	char path[64];
+
+	sprintf(path, NODE_SYSFS "/node%d/cpulist", node);
+	return access(path, R_OK) == 0;
+}
+
+static void add_cpu (unsigned int n, void *arg)
+{
+	if (n < CPU_SETSIZE)
+		CPU_SET(n, (cpu_set_t *)arg);
+}
+
+int pin_to_cpu (int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		int err = errno;
+		perror("sched_setaffinity()");
+		return err;
+	}
+	return 0;
+}
+
+/*
+ * Run on the CPUs of the given node, and allocate all further memory
+ * (including page cache pages faulted in by our reads) from it.
+ * A node of -1 undoes this.
+ */
+int bind_to_numa_node (int node)
+{
+	unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+	cpu_set_t set;
+	char path[64];
+	int err;
+
+	CPU_ZERO(&set);
+	if (node < 0) {
+		if (parse_sysfs_list("/sys/devices/system/cpu/online", add_cpu, &set) <= 0)
+			return 0;
+	} else {
+		sprintf(path, NODE_SYSFS "/node%d/cpulist", node);
+		if (node >= NUMA_MAX_NODES || parse_sysfs_list(path, add_cpu, &set) <= 0) {
+			fprintf(stderr, "NUMA node %d is not online\n", node);
+			return EINVAL;
+		}
+	}
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		err = errno;
+		perror("sched_setaffinity()");
+		return err;
+	}
+	memset(mask, 0, sizeof(mask));
+	if (node >= 0)
+		mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	if (syscall(__NR_set_mempolicy, node < 0 ? MPOL_DEFAULT : MPOL_BIND, node < 0 ? NULL : mask, NUMA_MAX_NODES + 1)) {
+		err = errno;
+		if (err != ENOSYS) {	/* kernel without NUMA support: CPU affinity alone is the best we can do */
+			perror("set_mempolicy()");
+			return err;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Which node holds the (already faulted in) page at addr, or -1 if unknown.
+ */
+int numa_node_of (void *addr)
+{
+	void *pages[1] = { addr };
+	int status[1] = { -1 };
+
+	if (syscall(__NR_move_pages, 0, 1UL, pages, NULL, status, 0))
+		return -1;
+	return status[0];
+}
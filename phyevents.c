@@ -0,0 +1,226 @@
+/*
+ * SATA Phy Event Counters (General Purpose Log 0x11).
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+#define PHY_EVENTS_LOG		0x11
+#define PHY_EVENTS_RESET	0x0001	/* READ_LOG_EXT feature: reset counters after reading */
+#define PHY_MAX_COUNTERS	128
+
+struct phy_counter {
+	__u16	id;
+	__u64	val;
+};
+
+static const char *phy_counter_name (__u16 id)
+{
+	switch (id) {
+		case 0x001: return "Command failed due to ICRC error";
+		case 0x002: return "R_ERR response for data FIS";
+		case 0x003: return "R_ERR response for device-to-host data FIS";
+		case 0x004: return "R_ERR response for host-to-device data FIS";
+		case 0x005: return "R_ERR response for non-data FIS";
+		case 0x006: return "R_ERR response for device-to-host non-data FIS";
+		case 0x007: return "R_ERR response for host-to-device non-data FIS";
+		case 0x008: return "Device-to-host non-data FIS retries";
+		case 0x009: return "Transitions from drive PHYRDY to drive PHYRDYn";
+		case 0x00a: return "Signature D2H Register FISes sent due to COMRESET";
+		case 0x00b: return "CRC errors within host-to-device FIS";
+		case 0x00d: return "Non-CRC errors within host-to-device FIS";
+		case 0x00f: return "R_ERR response for host-to-device data FIS, CRC";
+		case 0x010: return "R_ERR response for host-to-device data FIS, non-CRC";
+		case 0x012: return "R_ERR response for host-to-device non-data FIS, CRC";
+		case 0x013: return "R_ERR response for host-to-device non-data FIS, non-CRC";
+	}
+	return NULL;
+}
+
+/*
+ * Each counter is a 16-bit identifier followed by a 16/32/48/64-bit value.
+ * Bits 14:12 of the identifier give the value size in words,
+ * bit 15 marks vendor-specific counters, and an identifier of zero ends the list.
+ */
+static int parse_phy_counters (__u8 *buf, struct phy_counter *c)
+{
+	unsigned int off = 4, n = 0;
+
+	while (off + 2 <= 511 && n < PHY_MAX_COUNTERS) {
+		__u16 idw = buf[off] | (buf[off + 1] << 8);
+		unsigned int i, bytes = ((idw >> 12) & 7) * 2;
+
+		if (!idw || off + 2 + bytes > 511)
+			break;
+		c[n].id  = idw & 0x8fff;
+		c[n].val = 0;
+		for (i = bytes; i > 0; --i)
+			c[n].val = (c[n].val << 8) | buf[off + 1 + i];
+		off += 2 + bytes;
+		++n;
+	}
+	return n;
+}
+
+static int read_phy_counters (int fd, int reset, struct phy_counter *c)
+{
+	__u8 buf[512];
+	int err;
+
+	err = read_log_ext(fd, PHY_EVENTS_LOG, 0, 1, reset ? PHY_EVENTS_RESET : 0, buf);
+	if (err) {
+		fprintf(stderr, "READ_LOG_EXT(SATA_PHY_EVENT_COUNTERS) failed: %s\n", strerror(err));
+		return -1;
+	}
+	return parse_phy_counters(buf, c);
+}
+
+static void print_phy_counter (const char *prefix, struct phy_counter *c)
+{
+	const char *name = phy_counter_name(c->id);
+	char buf[32];
+
+	if (!name) {
+		sprintf(buf, "%s counter 0x%03x", (c->id & 0x8000) ? "Vendor" : "Unknown", c->id & 0xfff);
+		name = buf;
+	}
+	printf("%s%-56s", prefix, name);
+}
+
+int do_phy_events (int fd, int reset)
+{
+	struct phy_counter c[PHY_MAX_COUNTERS];
+	int i, n;
+
+	n = read_phy_counters(fd, reset, c);
+	if (n < 0)
+		return EIO;
+	printf(" SATA Phy Event Counters%s:\n", reset ? " (reset after reading)" : "");
+	for (i = 0; i < n; ++i) {
+		print_phy_counter("\t", &c[i]);
+		printf(" = %llu\n", c[i].val);
+	}
+	return 0;
+}
+
+/*
+ * With --interval, every drive is re-read once per interval and
+ * only the counters which moved are reported.  A link is flagged
+ * when a counter increases by more than it did in the previous interval,
+ * either by a clear margin, or over several intervals in a row:
+ * an odd error or two (a 0 -> 1 change) is not worth flagging.
+ */
+#define PHY_RISING_MIN_DELTA	10	/* events more than the previous interval */
+#define PHY_RISING_INTERVALS	3	/* consecutive intervals of a growing delta */
+
+struct phy_monitor {
+	struct phy_monitor	*next;
+	char			*devname;
+	int			fd;
+	int			ncounters;
+	struct phy_counter	prev[PHY_MAX_COUNTERS];
+	__u64			prev_delta[PHY_MAX_COUNTERS];
+	unsigned int		rising[PHY_MAX_COUNTERS];	/* intervals in a row with a growing delta */
+};
+
+static struct phy_monitor *phy_monitors = NULL;
+
+int phy_events_add_monitor (int fd, const char *devname, int reset)
+{
+	struct phy_monitor *m, **tail;
+	int err;
+
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		err = errno;
+		perror("calloc()");
+		return err;
+	}
+	m->ncounters = read_phy_counters(fd, reset, m->prev);
+	if (m->ncounters < 0) {
+		free(m);
+		return EIO;
+	}
+	m->devname = strdup(devname);
+	m->fd = dup(fd);	/* process_dev() closes the original */
+	for (tail = &phy_monitors; *tail; tail = &(*tail)->next);
+	*tail = m;
+	return 0;
+}
+
+int phy_events_have_monitors (void)
+{
+	return phy_monitors != NULL;
+}
+
+int phy_events_run_monitor (unsigned int interval, unsigned int count, int reset)
+{
+	struct phy_counter c[PHY_MAX_COUNTERS];
+	struct phy_monitor *m;
+	struct timeval start, tv;
+	unsigned int sample;
+	int i, n, err = 0;
+
+	gettimeofday(&start, NULL);
+	for (sample = 1; !count || sample <= count; ++sample) {
+		double elapsed;
+
+		sleep(interval);
+		gettimeofday(&tv, NULL);
+		elapsed = (tv.tv_sec - start.tv_sec) + ((tv.tv_usec - start.tv_usec) / 1000000.0);
+		for (m = phy_monitors; m; m = m->next) {
+			unsigned int events = 0, rising = 0;
+
+			n = read_phy_counters(m->fd, reset, c);
+			if (n < 0) {
+				printf("%8.1f %s: read failed\n", elapsed, m->devname);
+				err = EIO;
+				continue;
+			}
+			for (i = 0; i < n; ++i) {
+				__u64 delta;
+
+				/* counters saturate rather than wrap; a reset elsewhere makes them go backwards */
+				if (reset || i >= m->ncounters || c[i].id != m->prev[i].id || c[i].val < m->prev[i].val)
+					delta = c[i].val;
+				else
+					delta = c[i].val - m->prev[i].val;
+				if (sample > 1 && delta > m->prev_delta[i])
+					++m->rising[i];
+				else
+					m->rising[i] = 0;
+				if (delta) {
+					if (!events++)
+						printf("%8.1f %s:\n", elapsed, m->devname);
+					print_phy_counter("\t", &c[i]);
+					printf(" +%llu (total %llu)", delta, c[i].val);
+					if (m->rising[i] && (delta - m->prev_delta[i] >= PHY_RISING_MIN_DELTA
+							  || m->rising[i] >= PHY_RISING_INTERVALS)) {
+						printf("  RISING");
+						++rising;
+					}
+					putchar('\n');
+				}
+				m->prev_delta[i] = delta;
+				m->prev[i] = c[i];
+			}
+			m->ncounters = n;
+			if (rising) {
+				printf("%8.1f %s: link error rate is rising; check cabling/backplane\n", elapsed, m->devname);
+				err = EIO;
+			}
+		}
+		fflush(stdout);
+	}
+	return err;
+}
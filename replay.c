@@ -0,0 +1,409 @@
+/*
+ * Block I/O trace replay (--replay), for reproducing latency problems.
+ *
+ * The trace is a flat file of fixed-size little-endian records:
+ *
+ *	__u64	timestamp	nanoseconds, relative to any fixed origin
+ *	__u64	offset		in bytes from the start of the device
+ *	__u32	length		in bytes
+ *	__u32	op		0 = read, 1 = write
+ *
+ * such as can be converted from blkparse output with a few lines of script.
+ * Records are issued with O_DIRECT through Linux native AIO (raw syscalls,
+ * so no libaio is needed), honouring the recorded inter-arrival times
+ * scaled by a speedup factor, with a bounded number of commands in flight.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/aio_abi.h>
+#include <asm/byteorder.h>
+
+#include "hdparm.h"
+
+#define REPLAY_REC_BYTES	24
+#define REPLAY_MAX_QDEPTH	256
+#define REPLAY_MAX_IO_BYTES	(16 * 1024 * 1024)
+#define REPLAY_MAX_BUF_BYTES	(256 * 1024 * 1024)	/* qdepth * max_len, all of it mlock'd */
+#define REPLAY_LATE_NS		1000000ULL	/* count commands issued >1ms behind schedule */
+
+struct replay_rec {
+	__u64	ts;
+	__u64	offset;
+	__u32	len;
+	__u32	op;
+};
+
+struct replay_slot {
+	struct iocb	iocb;
+	__u64		start_ns;
+	unsigned int	rec;
+};
+
+static inline long sys_io_setup (unsigned int nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static inline long sys_io_destroy (aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline long sys_io_submit (aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static inline long sys_io_getevents (aio_context_t ctx, long min_nr, long nr, struct io_event *events, struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static __u64 get_le64 (const __u8 *p)
+{
+	__u64 v;
+
+	memcpy(&v, p, sizeof(v));
+	return __le64_to_cpu(v);
+}
+
+static __u32 get_le32 (const __u8 *p)
+{
+	__u32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return __le32_to_cpu(v);
+}
+
+/*
+ * Load the whole trace, dropping records which can't be issued
+ * against this device: beyond the end, or too large.
+ * Offsets/lengths are widened to the logical sector size for O_DIRECT.
+ */
+static struct replay_rec *load_trace (const char *path, __u64 dev_bytes, unsigned int sector_bytes,
+					unsigned int *nrecs, unsigned int *max_len, unsigned int *skipped)
+{
+	struct replay_rec *recs;
+	struct stat st;
+	__u8 *map;
+	unsigned int i, n = 0, total;
+	int tfd, err;
+
+	tfd = open(path, O_RDONLY);
+	if (tfd == -1 || fstat(tfd, &st)) {
+		err = errno;
+		perror(path);
+		exit(err);
+	}
+	if (st.st_size == 0 || (st.st_size % REPLAY_REC_BYTES)) {
+		fprintf(stderr, "%s: not a replay trace (size is not a multiple of %u bytes)\n", path, REPLAY_REC_BYTES);
+		exit(EINVAL);
+	}
+	total = st.st_size / REPLAY_REC_BYTES;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, tfd, 0);
+	if (map == MAP_FAILED) {
+		err = errno;
+		perror(path);
+		exit(err);
+	}
+	close(tfd);
+	recs = malloc(total * sizeof(*recs));
+	if (!recs) {
+		err = errno;
+		perror("malloc()");
+		exit(err);
+	}
+	*max_len = sector_bytes;
+	*skipped = 0;
+	for (i = 0; i < total; ++i) {
+		const __u8 *p = map + (size_t)i * REPLAY_REC_BYTES;
+		struct replay_rec *r = &recs[n];
+		__u64 end;
+
+		r->ts     = get_le64(p);
+		r->offset = get_le64(p + 8);
+		r->len    = get_le32(p + 16);
+		r->op     = get_le32(p + 20);
+		end       = r->offset + r->len;
+		r->offset = (r->offset / sector_bytes) * sector_bytes;
+		end       = ((end + sector_bytes - 1) / sector_bytes) * sector_bytes;
+		if (r->op > 1 || end > dev_bytes || end <= r->offset || (end - r->offset) > REPLAY_MAX_IO_BYTES) {
+			++*skipped;
+			continue;
+		}
+		r->len = end - r->offset;
+		if (r->len > *max_len)
+			*max_len = r->len;
+		++n;
+	}
+	munmap(map, st.st_size);
+	*nrecs = n;
+	return recs;
+}
+
+static int compare_lat (const void *a, const void *b)
+{
+	__u64 x = *(const __u64 *)a, y = *(const __u64 *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+static void report_latencies (const char *what, __u64 *lat, unsigned int n)
+{
+	static const double pct[] = {50, 90, 99, 99.9};
+	__u64 sum = 0;
+	unsigned int i;
+
+	if (!n)
+		return;
+	qsort(lat, n, sizeof(*lat), compare_lat);
+	for (i = 0; i < n; ++i)
+		sum += lat[i];
+	printf(" %-6s %8u cmds, latency (usecs): min %.1f, avg %.1f", what, n, lat[0] / 1000.0, sum / 1000.0 / n);
+	for (i = 0; i < sizeof(pct) / sizeof(pct[0]); ++i) {
+		unsigned int k = (unsigned int)((pct[i] / 100.0) * (n - 1) + 0.5);
+		printf(", p%g %.1f", pct[i], lat[k] / 1000.0);
+	}
+	printf(", max %.1f\n", lat[n - 1] / 1000.0);
+}
+
+/*
+ * Log2 histogram of all completions, from 16us up to 1s+.
+ */
+static void report_histogram (__u64 *lat, unsigned int n)
+{
+	unsigned int buckets[18], i, b;
+
+	memset(buckets, 0, sizeof(buckets));
+	for (i = 0; i < n; ++i) {
+		__u64 us = lat[i] / 1000;
+		for (b = 0; b < 17 && us >= (16ULL << b); ++b);
+		++buckets[b];
+	}
+	printf(" Latency histogram:\n");
+	for (b = 0; b < 18; ++b) {
+		if (!buckets[b])
+			continue;
+		if (b == 17)
+			printf("\t>= %8llu us: %8u (%5.1f%%)\n", 16ULL << 16, buckets[b], 100.0 * buckets[b] / n);
+		else
+			printf("\t<  %8llu us: %8u (%5.1f%%)\n", 16ULL << b, buckets[b], 100.0 * buckets[b] / n);
+	}
+}
+
+int do_replay (const char *devname, const char *path, double speedup, unsigned int qdepth, int allow_writes)
+{
+	struct replay_slot *slots;
+	struct iocb *iocbp;
+	struct io_event events[REPLAY_MAX_QDEPTH];
+	aio_context_t ctx = 0;
+	struct replay_rec *recs;
+	unsigned int nrecs, max_len, skipped, writes_skipped = 0, late = 0, failed = 0;
+	unsigned int next = 0, inflight = 0, nfree, nlat[2] = {0, 0}, i;
+	unsigned int *free_slots;
+	__u64 dev_bytes, t0, ts0, t_end, bytes_done = 0, *lat[2], *all;
+	__u8 *buf;
+	size_t buf_bytes;
+	int fd, err = 0, sector_bytes;
+
+	if (qdepth < 1 || qdepth > REPLAY_MAX_QDEPTH)
+		qdepth = 1;
+	fd = open(devname, (allow_writes ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd == -1) {
+		err = errno;
+		perror(devname);
+		return err;
+	}
+	if (ioctl(fd, BLKGETSIZE64, &dev_bytes)) {
+		err = errno;
+		perror("BLKGETSIZE64");
+		close(fd);
+		return err;
+	}
+	sector_bytes = get_current_sector_size(fd);
+	recs = load_trace(path, dev_bytes, sector_bytes, &nrecs, &max_len, &skipped);
+	if (!nrecs) {
+		fprintf(stderr, "%s: no usable records in trace\n", path);
+		free(recs);
+		close(fd);
+		return EINVAL;
+	}
+	max_len = (max_len + 4095) & ~4095;
+	if ((size_t)qdepth * max_len > REPLAY_MAX_BUF_BYTES) {
+		qdepth = REPLAY_MAX_BUF_BYTES / max_len;
+		fprintf(stderr, " %u byte commands in trace: queue depth reduced to %u\n", max_len, qdepth);
+	}
+	buf_bytes = (size_t)qdepth * max_len;
+
+	slots      = calloc(qdepth, sizeof(*slots));
+	free_slots = malloc(qdepth * sizeof(*free_slots));
+	lat[0]     = malloc(nrecs * sizeof(__u64));
+	lat[1]     = malloc(nrecs * sizeof(__u64));
+	if (!slots || !free_slots || !lat[0] || !lat[1]) {
+		err = errno;
+		perror("malloc()");
+		exit(err);
+	}
+	buf = prepare_timing_buf(buf_bytes);
+	if (!buf) {
+		close(fd);
+		return ENOMEM;
+	}
+	if (sys_io_setup(qdepth, &ctx)) {
+		err = errno;
+		perror("io_setup()");
+		munlockall();
+		munmap(buf, buf_bytes);
+		close(fd);
+		return err;
+	}
+	for (i = 0; i < qdepth; ++i)
+		free_slots[i] = i;
+	nfree = qdepth;
+
+	printf(" Replaying %u commands from %s", nrecs, path);
+	if (speedup > 0)
+		printf(" at %gx speed", speedup);
+	else
+		printf(" as fast as possible");
+	printf(", queue depth %u", qdepth);
+	if (skipped)
+		printf(" (%u unusable records skipped)", skipped);
+	printf("\n");
+	fflush(stdout);
+
+	timing_init();
+	ts0 = recs[0].ts;
+	t0 = timing_now_ns();
+	while (next < nrecs || inflight) {
+		struct timespec timeout, *tp = NULL;
+		__u64 now = timing_now_ns(), due = now;
+		long n;
+
+		while (next < nrecs && nfree) {
+			struct replay_rec *r = &recs[next];
+			struct replay_slot *s;
+
+			if (r->op && !allow_writes) {
+				++writes_skipped;
+				++next;
+				continue;
+			}
+			if (speedup > 0) {
+				due = t0 + (r->ts > ts0 ? (__u64)((r->ts - ts0) / speedup) : 0);
+				if (due > now)
+					break;
+				if (now - due > REPLAY_LATE_NS)
+					++late;
+			}
+			s = &slots[free_slots[--nfree]];
+			memset(&s->iocb, 0, sizeof(s->iocb));
+			s->iocb.aio_data       = s - slots;
+			s->iocb.aio_lio_opcode = r->op ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+			s->iocb.aio_fildes     = fd;
+			s->iocb.aio_buf        = (unsigned long)(buf + (s - slots) * (size_t)max_len);
+			s->iocb.aio_nbytes     = r->len;
+			s->iocb.aio_offset     = r->offset;
+			s->rec                 = next;
+			s->start_ns            = now = timing_now_ns();
+			iocbp = &s->iocb;
+			if (sys_io_submit(ctx, 1, &iocbp) != 1) {
+				err = errno;
+				perror("io_submit()");
+				goto done;
+			}
+			++inflight;
+			++next;
+		}
+		if (!inflight) {
+			if (next < nrecs && due > now) {
+				timeout.tv_sec  = (due - now) / 1000000000ULL;
+				timeout.tv_nsec = (due - now) % 1000000000ULL;
+				nanosleep(&timeout, NULL);
+			}
+			continue;
+		}
+		/* wait for a completion, but not past the next command's due time */
+		if (next < nrecs && nfree && due > now) {
+			timeout.tv_sec  = (due - now) / 1000000000ULL;
+			timeout.tv_nsec = (due - now) % 1000000000ULL;
+			tp = &timeout;
+		}
+		n = sys_io_getevents(ctx, 1, inflight, events, tp);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err = errno;
+			perror("io_getevents()");
+			goto done;
+		}
+		now = timing_now_ns();
+		for (i = 0; i < (unsigned int)n; ++i) {
+			struct replay_slot *s = &slots[events[i].data];
+			struct replay_rec *r = &recs[s->rec];
+
+			if (events[i].res != (__s64)r->len) {
+				if (!failed++)
+					fprintf(stderr, "%s at offset %llu failed: %s\n", r->op ? "write" : "read", r->offset,
+						(__s64)events[i].res < 0 ? strerror(-(__s64)events[i].res) : "short transfer");
+			} else {
+				lat[r->op][nlat[r->op]++] = now - s->start_ns;
+				bytes_done += r->len;
+			}
+			free_slots[nfree++] = s - slots;
+			--inflight;
+		}
+	}
+done:
+	t_end = timing_now_ns();
+	sys_io_destroy(ctx);
+	munlockall();
+	munmap(buf, buf_bytes);
+	close(fd);
+
+	if (!err) {
+		double secs = (t_end - t0) / 1e9;
+
+		printf(" Completed %u commands in %.2f seconds = %.1f IOPS, %.2f MB/sec\n",
+			nlat[0] + nlat[1], secs, (nlat[0] + nlat[1]) / secs, bytes_done / secs / 1e6);
+		if (late)
+			printf(" %u commands were issued more than 1ms behind schedule (queue depth too low?)\n", late);
+		if (writes_skipped)
+			printf(" %u write commands were skipped (use --replay-writes to issue them)\n", writes_skipped);
+		if (failed)
+			printf(" %u commands failed\n", failed);
+		report_latencies("reads", lat[0], nlat[0]);
+		report_latencies("writes", lat[1], nlat[1]);
+		all = malloc((nlat[0] + nlat[1]) * sizeof(__u64));
+		if (all) {
+			memcpy(all, lat[0], nlat[0] * sizeof(__u64));
+			memcpy(all + nlat[0], lat[1], nlat[1] * sizeof(__u64));
+			report_histogram(all, nlat[0] + nlat[1]);
+			free(all);
+		}
+		if (failed)
+			err = EIO;
+	}
+	free(lat[0]);
+	free(lat[1]);
+	free(free_slots);
+	free(slots);
+	free(recs);
+	return err;
+}
@@ -0,0 +1,231 @@
+/*
+ * SMART Command Transport (SCT) temperature reporting.
+ *
+ * SCT Status and the SCT Temperature History table are standard
+ * (ACS-2 and later), so this works across vendors, unlike the
+ * Hitachi-specific -H command.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <linux/types.h>
+
+#include "sgio.h"
+#include "hdparm.h"
+
+extern int verbose;  /* libhdparm.c */
+
+enum {
+	SMART_READ_LOG		= 0xd5,
+	SMART_WRITE_LOG		= 0xd6,
+	SMART_LBA_SIGNATURE	= 0xc24f00,
+	SCT_LOG_STATUS		= 0xe0,	/* read: SCT status, write: SCT command */
+	SCT_LOG_DATA		= 0xe1,
+	SCT_ACTION_DATA_TABLE	= 5,
+	SCT_FUNC_READ_TABLE	= 1,
+	SCT_TABLE_TEMP_HISTORY	= 2,
+	SCT_TEMP_INVALID	= 0x80,
+	SCT_TIMEOUT_SECS	= 15,
+};
+
+/* id[206] SCT Command Transport capability bits */
+#define SCT_SUPPORTED		(1 << 0)
+#define SCT_DATA_TABLES		(1 << 5)
+
+static int sct_issue (int fd, int rw, __u8 log, void *data, const char *msg)
+{
+	struct ata_tf tf;
+	int err;
+
+	tf_init(&tf, ATA_OP_SMART, SMART_LBA_SIGNATURE | log, 1);
+	tf.lob.feat = (rw == SG_WRITE) ? SMART_WRITE_LOG : SMART_READ_LOG;
+	tf.dev = 0xa0;
+	if (sg16(fd, rw, SG_PIO, &tf, data, 512, SCT_TIMEOUT_SECS)) {
+		err = errno;
+		if (verbose || msg)
+			perror(msg ? msg : __func__);
+		return err;
+	}
+	return 0;
+}
+
+static const char *sct_temp_str (__u8 t, char *buf)
+{
+	if (t == SCT_TEMP_INVALID)
+		return "-";
+	sprintf(buf, "%d C", (signed char)t);
+	return buf;
+}
+
+static int read_sct_status (int fd, __u8 *buf, const char *msg)
+{
+	memset(buf, 0, 512);
+	return sct_issue(fd, SG_READ, SCT_LOG_STATUS, buf, msg);
+}
+
+static int read_sct_temp_history (int fd, __u8 *buf)
+{
+	__u8 cmd[512];
+	int err;
+
+	memset(cmd, 0, sizeof(cmd));
+	cmd[0] = SCT_ACTION_DATA_TABLE;
+	cmd[2] = SCT_FUNC_READ_TABLE;
+	cmd[4] = SCT_TABLE_TEMP_HISTORY;
+	err = sct_issue(fd, SG_WRITE, SCT_LOG_STATUS, cmd, "SCT_DATA_TABLE");
+	if (err)
+		return err;
+	memset(buf, 0, 512);
+	return sct_issue(fd, SG_READ, SCT_LOG_DATA, buf, "SCT_READ_TEMP_HISTORY");
+}
+
+static void print_sct_status (__u8 *st)
+{
+	char b1[16], b2[16];
+
+	printf(" SCT Status:\n");
+	printf("\tFormat version            = %u\n", st[0] | (st[1] << 8));
+	printf("\tCurrent temperature       = %s\n", sct_temp_str(st[200], b1));
+	printf("\tPower cycle min/max       = %s / %s\n", sct_temp_str(st[201], b1), sct_temp_str(st[202], b2));
+	printf("\tLifetime min/max          = %s / %s\n", sct_temp_str(st[203], b1), sct_temp_str(st[204], b2));
+	printf("\tOver limit count          = %u\n", st[206] | (st[207] << 8) | (st[208] << 16) | (st[209] << 24));
+	printf("\tUnder limit count         = %u\n", st[210] | (st[211] << 8) | (st[212] << 16) | (st[213] << 24));
+}
+
+/*
+ * The history is a circular buffer, with the index pointing at the
+ * most recent entry.  Print it oldest first, skipping unused slots.
+ */
+static void print_sct_temp_history (__u8 *th)
+{
+	unsigned int interval = th[4] | (th[5] << 8);
+	unsigned int size     = th[30] | (th[31] << 8);
+	unsigned int index    = th[32] | (th[33] << 8);
+	unsigned int i, n, col = 0;
+	char b1[16], b2[16];
+
+	printf(" SCT Temperature History:\n");
+	printf("\tSampling period           = %u minutes\n", th[2] | (th[3] << 8));
+	printf("\tLogging interval          = %u minutes\n", interval);
+	printf("\tOperating range           = %s to %s\n", sct_temp_str(th[8], b1), sct_temp_str(th[6], b2));
+	printf("\tRecommended range         = %s to %s\n", sct_temp_str(th[9], b1), sct_temp_str(th[7], b2));
+	if (size > 512 - 34)
+		size = 512 - 34;
+	if (!size || index >= size)
+		return;
+	printf("\tHistory (%u entries, oldest first, minutes ago):", size);
+	for (n = 0; n < size; ++n) {
+		i = (index + 1 + n) % size;
+		if (th[34 + i] == SCT_TEMP_INVALID)
+			continue;
+		if ((col++ % 8) == 0)
+			printf("\n\t");
+		printf(" %5u:%3d", (size - 1 - n) * interval, (signed char)th[34 + i]);
+	}
+	putchar('\n');
+}
+
+/*
+ * Print SCT status and the temperature history table for one drive.
+ */
+int do_sct_temp (int fd, __u16 *id)
+{
+	__u8 buf[512];
+	int err;
+
+	if (id && !(id[206] & SCT_SUPPORTED)) {
+		fprintf(stderr, " SCT Command Transport is not supported\n");
+		return EINVAL;
+	}
+	err = read_sct_status(fd, buf, "SCT_STATUS");
+	if (err)
+		return err;
+	print_sct_status(buf);
+	if (id && !(id[206] & SCT_DATA_TABLES))
+		return 0;
+	err = read_sct_temp_history(fd, buf);
+	if (!err)
+		print_sct_temp_history(buf);
+	return err;
+}
+
+/*
+ * With --interval, every drive is sampled once per interval,
+ * one line per sample with a column per drive.
+ */
+struct sct_monitor {
+	struct sct_monitor	*next;
+	char			*devname;
+	int			fd;
+};
+
+static struct sct_monitor *sct_monitors = NULL;
+
+int sct_temp_add_monitor (int fd, const char *devname)
+{
+	struct sct_monitor *m, **tail;
+	__u8 buf[512];
+	int err;
+
+	err = read_sct_status(fd, buf, "SCT_STATUS");
+	if (err)
+		return err;
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		err = errno;
+		perror("calloc()");
+		return err;
+	}
+	m->devname = strdup(devname);
+	m->fd = dup(fd);	/* process_dev() closes the original */
+	for (tail = &sct_monitors; *tail; tail = &(*tail)->next);
+	*tail = m;
+	return 0;
+}
+
+int sct_temp_have_monitors (void)
+{
+	return sct_monitors != NULL;
+}
+
+int sct_temp_run_monitor (unsigned int interval, unsigned int count)
+{
+	struct sct_monitor *m;
+	struct timeval start, tv;
+	unsigned int sample;
+	__u8 buf[512];
+	char tbuf[16];
+	int err = 0;
+
+	printf("%8s", "seconds");
+	for (m = sct_monitors; m; m = m->next) {
+		const char *name = strrchr(m->devname, '/');
+		printf(" %8s", name ? name + 1 : m->devname);
+	}
+	putchar('\n');
+	gettimeofday(&start, NULL);
+	for (sample = 0; !count || sample < count; ++sample) {
+		if (sample)
+			sleep(interval);
+		gettimeofday(&tv, NULL);
+		printf("%8.1f", (tv.tv_sec - start.tv_sec) + ((tv.tv_usec - start.tv_usec) / 1000000.0));
+		for (m = sct_monitors; m; m = m->next) {
+			if (read_sct_status(m->fd, buf, NULL)) {
+				err = EIO;
+				printf(" %8s", "err");
+			} else {
+				printf(" %8s", sct_temp_str(buf[200], tbuf));
+			}
+		}
+		putchar('\n');
+		fflush(stdout);
+	}
+	return err;
+}
@@ -22,6 +22,30 @@ extern int prefer_ata12;
 
 static const unsigned int default_timeout_secs = 15;
 
+static void set_transport_method (struct transport_profile *p, int method)
+{
+	static const char *names[] = { "unknown", "SG_IO", "HDIO", "emulated" };
+
+	if (p->method == method)
+		return;
+	p->method = method;
+	if (verbose)
+		fprintf(stderr, "transport: using %s\n", names[method]);
+}
+
+/*
+ * Bridges which do not implement ATA_12 reject the CDB
+ * with ILLEGAL REQUEST / INVALID COMMAND OPERATION CODE.
+ */
+static int is_invalid_opcode (const unsigned char *sb)
+{
+	if ((sb[0] & 0x7f) == 0x72)	/* descriptor format */
+		return (sb[1] & 0x0f) == 0x05 && sb[2] == 0x20;
+	if ((sb[0] & 0x7f) == 0x70)	/* fixed format */
+		return (sb[2] & 0x0f) == 0x05 && sb[12] == 0x20;
+	return 0;
+}
+
 /*
  * Taskfile layout for SG_ATA_16 cdb:
  *
@@ -85,6 +109,8 @@ static inline int needs_lba48 (__u8 ata_op, __u64 lba, unsigned int nsect)
 		case ATA_OP_DSM:
 		case ATA_OP_READ_PIO_EXT:
 		case ATA_OP_READ_DMA_EXT:
+		case ATA_OP_READ_LOG_EXT:
+		case ATA_OP_READ_LOG_DMA_EXT:
 		case ATA_OP_WRITE_PIO_EXT:
 		case ATA_OP_WRITE_DMA_EXT:
 		case ATA_OP_READ_VERIFY_EXT:
@@ -115,6 +141,7 @@ static inline int is_dma (__u8 ata_op)
 	switch (ata_op) {
 		case ATA_OP_DSM:
 		case ATA_OP_READ_DMA_EXT:
+		case ATA_OP_READ_LOG_DMA_EXT:
 		case ATA_OP_READ_FPDMA:
 		case ATA_OP_WRITE_DMA_EXT:
 		case ATA_OP_WRITE_FPDMA:
@@ -193,14 +220,21 @@ int sg16 (int fd, int rw, int dma, struct ata_tf *tf,
 	unsigned char cdb[SG_ATA_16_LEN];
 	unsigned char sb[32], *desc;
 	struct scsi_sg_io_hdr io_hdr;
-	int prefer12 = prefer_ata12, demanded_sense = 0;
+	struct transport_profile *prof = get_transport_profile(fd);
+	int prefer12 = prefer_ata12, demanded_sense = 0, err;
 
-	if (tf->command == ATA_OP_PIDENTIFY)
+	if (tf->command == ATA_OP_PIDENTIFY || (prof && prof->ata12_broken))
 		prefer12 = 0;
 
-	if (apt_is_apt()) {
+	if (apt_is_apt(fd)) {
 		return apt_sg16(fd, rw, dma, tf, data, data_bytes, timeout_secs);
 	}
+	if (prof && prof->method == TRANSPORT_EMULATED)
+		return prof->emulate(fd, rw, dma, tf, data, data_bytes, timeout_secs);
+	if (prof && prof->method == TRANSPORT_HDIO) {
+		errno = EINVAL;		/* already known: go straight to the legacy ioctls */
+		return -1;
+	}
 
 	memset(&cdb, 0, sizeof(cdb));
 	memset(&sb,     0, sizeof(sb));
@@ -270,10 +304,20 @@ int sg16 (int fd, int rw, int dma, struct ata_tf *tf,
 	}
 
 	if (ioctl(fd, SG_IO, &io_hdr) == -1) {
+		err = errno;
 		if (verbose)
 			perror("ioctl(fd,SG_IO)");
+		/*
+		 * EINVAL can be specific to this command (eg. a transfer beyond the queue limits),
+		 * so only give up on SG_IO for good when even a non-data command is refused.
+		 */
+		if (prof && prof->method == TRANSPORT_UNKNOWN && (err == ENOTTY || (err == EINVAL && !data)))
+			set_transport_method(prof, TRANSPORT_HDIO);
+		errno = err;
 		return -1;	/* SG_IO not supported */
 	}
+	if (prof)
+		set_transport_method(prof, TRANSPORT_SG_IO);
 
 	if (verbose)
 		fprintf(stderr, "SG_IO: ATA_%u status=0x%x, host_status=0x%x, driver_status=0x%x\n",
@@ -291,6 +335,12 @@ int sg16 (int fd, int rw, int dma, struct ata_tf *tf,
 	  	errno = EBADE;
 		return -1;
 	}
+	if (io_hdr.cmd_len == SG_ATA_12_LEN && prof && is_invalid_opcode(sb)) {
+		if (verbose)
+			fprintf(stderr, "SG_IO: ATA_12 rejected, using ATA_16 from now on\n");
+		prof->ata12_broken = 1;
+		return sg16(fd, rw, dma, tf, data, data_bytes, timeout_secs);
+	}
 	if (verbose) {
 		dump_bytes("SG_IO: sb[]", sb, sizeof(sb));
 		if (!rw && data)
@@ -306,13 +356,12 @@ int sg16 (int fd, int rw, int dma, struct ata_tf *tf,
 
 	desc = sb + 8;
 	if (io_hdr.driver_status != SG_DRIVER_SENSE) {
+		/* reported once per device */
 		if (sb[0] | sb[1] | sb[2] | sb[3] | sb[4] | sb[5] | sb[6] | sb[7] | sb[8] | sb[9]) {
-			static int second_try = 0;
-			if (!second_try++)
+			if (!prof || !prof->sense_warned++)
 				fprintf(stderr, "SG_IO: questionable sense data, results may be incorrect\n");
 		} else if (demanded_sense) {
-			static int second_try = 0;
-			if (!second_try++)
+			if (!prof || !prof->sense_warned++)
 				fprintf(stderr, "SG_IO: missing sense data, results may be incorrect\n");
 		}
 	} else if (sb[0] != 0x72 || sb[7] < 14 || desc[0] != 0x09 || desc[1] < 0x0c) {
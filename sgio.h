@@ -11,6 +11,7 @@ enum {
 	ATA_OP_READ_PIO_EXT		= 0x24,
 	ATA_OP_READ_DMA_EXT		= 0x25,
 	ATA_OP_READ_LOG_EXT		= 0x2f,
+	ATA_OP_READ_LOG_DMA_EXT		= 0x47,
 	ATA_OP_READ_FPDMA		= 0x60,	// NCQ
 	ATA_OP_WRITE_PIO		= 0x30,
 	ATA_OP_WRITE_LONG		= 0x32,
@@ -239,5 +240,6 @@ void init_hdio_taskfile (struct hdio_taskfile *r, __u8 ata_op, int rw, int force
 				__u64 lba, unsigned int nsect, int data_bytes);
 
 /* APT */
+int emu_sg16 (int fd, int rw, int dma, struct ata_tf *tf, void *data, unsigned int data_bytes, unsigned int timeout_secs);
 int apt_sg16(int fd, int rw, int dma, struct ata_tf *tf,
 		void *data, unsigned int data_bytes, unsigned int timeout_secs);
@@ -0,0 +1,83 @@
+/*
+ * Summary statistics for repeated benchmark runs.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <linux/types.h>
+
+#include "hdparm.h"
+
+/* two-sided 95% Student's t critical values, for 1..30 degrees of freedom */
+static const double t95[30] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static int compare_double (const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+void sort_doubles (double *v, unsigned int n)
+{
+	qsort(v, n, sizeof(*v), compare_double);
+}
+
+/*
+ * Value at the given percentile (0..100) of an already sorted array,
+ * interpolating between the two nearest samples.
+ */
+double sorted_percentile (const double *v, unsigned int n, double pct)
+{
+	double pos, frac;
+	unsigned int i;
+
+	if (!n)
+		return 0;
+	pos  = (pct / 100.0) * (n - 1);
+	i    = (unsigned int)pos;
+	frac = pos - i;
+	if (i + 1 >= n)
+		return v[n - 1];
+	return v[i] + (v[i + 1] - v[i]) * frac;
+}
+
+void compute_run_stats (const double *v, unsigned int n, struct run_stats *st)
+{
+	double *sorted, sum = 0, sq = 0;
+	unsigned int i;
+
+	memset(st, 0, sizeof(*st));
+	st->n = n;
+	if (!n)
+		return;
+	for (i = 0; i < n; ++i)
+		sum += v[i];
+	st->mean = sum / n;
+	for (i = 0; i < n; ++i)
+		sq += (v[i] - st->mean) * (v[i] - st->mean);
+	if (n > 1) {
+		st->stddev = sqrt(sq / (n - 1));
+		st->ci95   = ((n - 1) <= 30 ? t95[n - 2] : 1.960) * st->stddev / sqrt(n);
+	}
+	if (st->mean)
+		st->cv = st->stddev / st->mean;
+
+	sorted = malloc(n * sizeof(*sorted));
+	if (sorted) {
+		memcpy(sorted, v, n * sizeof(*sorted));
+		sort_doubles(sorted, n);
+		st->min    = sorted[0];
+		st->max    = sorted[n - 1];
+		st->median = sorted_percentile(sorted, n, 50);
+		free(sorted);
+	}
+}
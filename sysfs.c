@@ -149,74 +149,95 @@ static int get_dev_from_fd (int fd, dev_t *dev, int verbose)
 	return 0;
 }
 
-static int sysfs_find_fd (int fd, char **path_p, int verbose)
+/*
+ * Copy the sysfs directory for fd's device into path[PATH_MAX].
+ * The lookup is done once per device, and remembered in its context.
+ */
+static int sysfs_find_fd (int fd, char *path, int verbose)
 {
-	static int have_prev = 0;
-	static dev_t prev;
-	static char path[PATH_MAX];
+	struct dev_context *ctx = get_dev_context(fd);
 	dev_t dev;
 	int err;
 
+	if (ctx && ctx->sysfs_path) {
+		strcpy(path, ctx->sysfs_path);
+		return 0;
+	}
+	if (ctx && ctx->sysfs_err)
+		return ctx->sysfs_err;
 	memset(&dev, 0, sizeof(dev));
 	err = get_dev_from_fd(fd, &dev, verbose);
-	if (!err) {
-		if (have_prev && 0 == memcmp(&dev, &prev, sizeof(dev))) {
-			/*re-use previous path, since dev was unchanged from before */
-		} else {
-			prev = dev;
-			have_prev = 1;
-			err = sysfs_find_dev(dev, path, verbose);
-		}
+	if (!err)
+		err = sysfs_find_dev(dev, path, verbose);
+	if (ctx) {
+		if (err)
+			ctx->sysfs_err = err;
+		else
+			ctx->sysfs_path = strdup(path);
 	}
-	if (err)
-		have_prev = 0;
-	else
-		*path_p = path;
 	return err;
 }
 
 int sysfs_get_attr (int fd, const char *attr, const char *fmt, void *val1, void *val2, int verbose)
 {
-	char *path;
+	char path[PATH_MAX];
 	int err;
 
-	err = sysfs_find_fd(fd, &path, verbose);
+	err = sysfs_find_fd(fd, path, verbose);
 	if (!err)
 		err = sysfs_read_attr(path, attr, fmt, val1, val2, verbose);
 	return err;
 }
 
+/*
+ * As sysfs_get_attr(), but for a sysfs directory given by its path,
+ * eg. a partition or holder of the device.
+ */
+int sysfs_get_path_attr (const char *dir, const char *attr, const char *fmt, void *val1, void *val2, int verbose)
+{
+	char path[PATH_MAX];
+
+	if (strlen(dir) + 1 + strlen(attr) >= sizeof(path))
+		return ENAMETOOLONG;
+	strcpy(path, dir);
+	return sysfs_read_attr(path, attr, fmt, val1, val2, verbose);
+}
+
 int sysfs_set_attr (int fd, const char *attr, const char *fmt, void *val_p, int verbose)
 {
-	char *path;
+	char path[PATH_MAX];
 	int err;
 
-	err = sysfs_find_fd(fd, &path, verbose);
+	err = sysfs_find_fd(fd, path, verbose);
 	if (!err)
 		err = sysfs_write_attr(path, attr, fmt, val_p, verbose);
 	return err;
 }
 
-static int sysfs_find_attr_file_path (const char *start_path, char **dest_path, const char *attr)
+/*
+ * Walk up from the device's sysfs directory to the first parent holding attr,
+ * leaving it in path[PATH_MAX].  Related attributes (eg. idVendor, idProduct)
+ * live in the same directory, so the one found is remembered for the device.
+ */
+static int sysfs_find_attr_file_path (struct dev_context *ctx, char *path, const char *attr)
 {
-	static char path[PATH_MAX];
-	static char have_prev = 0;
 	char file_path[PATH_MAX + FILENAME_MAX];
 	struct stat st;
 	ino_t stop_inode;
 	int depth = 0;
 
-	if (have_prev) {
-		*dest_path = path;
+	if (ctx && ctx->sysfs_attr_dir) {
+		sprintf(file_path, "%s/%s", ctx->sysfs_attr_dir, attr);
+		if (access(file_path, F_OK | R_OK) == 0) {
+			strcpy(path, ctx->sysfs_attr_dir);
 
-		return 0;
+			return 0;
+		}
 	}
 
 	stat("/sys/devices", &st);
 	stop_inode = st.st_ino;
 
-	strcpy(path, start_path);
-
 	while (depth++ < 20) {
 		strcat(path, "/..");
 
@@ -231,7 +252,8 @@ static int sysfs_find_attr_file_path (const char *start_path, char **dest_path,
 		strcat(file_path, attr);
 
 		if (access(file_path, F_OK | R_OK) == 0) {
-			*dest_path = path;
+			if (ctx && !ctx->sysfs_attr_dir)
+				ctx->sysfs_attr_dir = strdup(path);
 
 			return 0;
 		}
@@ -242,16 +264,15 @@ static int sysfs_find_attr_file_path (const char *start_path, char **dest_path,
 
 int sysfs_get_attr_recursive (int fd, const char *attr, const char *fmt, void *val1, void *val2, int verbose)
 {
-	char *path;
-	char *attr_path;
+	char path[PATH_MAX];
 	int err;
 
-	err = sysfs_find_fd(fd, &path, verbose);
+	err = sysfs_find_fd(fd, path, verbose);
 	if (!err) {
-		err = sysfs_find_attr_file_path(path, &attr_path, attr);
+		err = sysfs_find_attr_file_path(get_dev_context(fd), path, attr);
 
 		if (!err) {
-			err = sysfs_read_attr(attr_path, attr, fmt, val1, val2, verbose);
+			err = sysfs_read_attr(path, attr, fmt, val1, val2, verbose);
 		}
 	}
 
@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# "make check": run hdparm against --emulate disk images,
+# and compare what it reports with what the emulator holds.
+#
+# usage: tests/check.sh [path-to-hdparm]
+#
+HDPARM=${1:-./hdparm}
+DIR=$(mktemp -d "${TMPDIR:-/tmp}/hdparm-check.XXXXXX") || exit 1
+trap 'rm -rf "$DIR"' 0
+IMG=$DIR/disk.img
+SECTORS=131072		# a 64MB image
+
+passed=0
+failed=0
+
+ok ()
+{
+	passed=$((passed + 1))
+	echo "ok   $1"
+}
+
+fail ()
+{
+	failed=$((failed + 1))
+	echo "FAIL $1"
+	[ -f "$DIR/out" ] && sed 's/^/	| /' "$DIR/out"
+}
+
+# expect <description> <grep pattern>: match against $DIR/out
+expect ()
+{
+	if grep -q -e "$2" "$DIR/out"; then ok "$1"; else fail "$1"; fi
+}
+
+hdparm ()
+{
+	"$HDPARM" --emulate "$@"
+}
+
+dd if=/dev/urandom of="$IMG" bs=512 count=$SECTORS status=none || exit 1
+
+# -I: the emulated IDENTIFY, decoded
+hdparm -I "$IMG" > "$DIR/out" 2>&1
+expect "-I model"            'Model Number: *hdparm emulated disk'
+expect "-I capacity"         "LBA48  user addressable sectors: *$SECTORS\$"
+expect "-I sector size"      'Logical  Sector size: *512 bytes'
+expect "-I SCT"              'SMART Command Transport (SCT)'
+
+# --query: the same fields, as name=value
+hdparm --query model,capacity,logical_sector_size "$IMG" > "$DIR/out" 2>&1
+expect "--query model"       '^model=hdparm emulated disk$'
+expect "--query capacity"    "^capacity=$((SECTORS * 512))\$"
+expect "--query sector size" '^logical_sector_size=512$'
+
+# the log decoders: Device Statistics, SCT status, SATA Phy Event Counters
+hdparm --device-stats "$IMG" > "$DIR/out" 2>&1
+expect "--device-stats"      'Lifetime Power-On Resets *= 1$'
+hdparm --sct-temp "$IMG" > "$DIR/out" 2>&1
+expect "--sct-temp"          'Current temperature *= 35 C$'
+hdparm --phy-events "$IMG" > "$DIR/out" 2>&1
+expect "--phy-events"        'COMRESET *= 1$'
+
+# --read-sector: hex dump (in on-disk byte order) of the first word
+hdparm --read-sector 0 "$IMG" > "$DIR/out" 2>&1
+word=$(od -An -tx1 -N2 "$IMG" | tr -d ' ')
+expect "--read-sector"       "^$word "
+
+# --read-sectors: the raw contents, and zero-filled unreadable sectors
+: > "$DIR/out"
+dd if="$IMG" of="$DIR/expected" bs=512 skip=8 count=4 status=none
+if hdparm --read-sectors 8:4 "$IMG" > "$DIR/got" 2> "$DIR/out" && cmp -s "$DIR/expected" "$DIR/got"; then
+	ok "--read-sectors"
+else
+	fail "--read-sectors"
+fi
+dd if=/dev/zero of="$DIR/expected" bs=512 seek=2 count=2 conv=notrunc status=none
+if hdparm --emulate-errors 10:2 --read-sectors 8:4 "$IMG" > "$DIR/got" 2> "$DIR/out"; then
+	fail "--read-sectors with bad sectors: exit status"
+elif cmp -s "$DIR/expected" "$DIR/got"; then
+	ok "--read-sectors with bad sectors"
+else
+	fail "--read-sectors with bad sectors: output"
+fi
+
+# --repair-sectors-stdin: only the unreadable sectors are rewritten
+dd if="$IMG" of="$DIR/before" bs=512 skip=20 count=1 status=none
+echo "11 20 10 11" | hdparm --emulate-errors 10:2 --repair-sectors-stdin --repair-reverify \
+	--yes-i-know-what-i-am-doing "$IMG" > "$DIR/out" 2>&1
+expect "--repair-sectors-stdin" '3 sectors checked (1 duplicates dropped): 1 readable, 2 rewritten, 0 write failures, 0 still unreadable'
+dd if="$IMG" of="$DIR/got" bs=512 skip=10 count=2 status=none
+dd if=/dev/zero of="$DIR/expected" bs=512 count=2 status=none
+dd if="$IMG" of="$DIR/after" bs=512 skip=20 count=1 status=none
+: > "$DIR/out"
+if cmp -s "$DIR/expected" "$DIR/got" && cmp -s "$DIR/before" "$DIR/after"; then
+	ok "--repair-sectors-stdin contents"
+else
+	fail "--repair-sectors-stdin contents"
+fi
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
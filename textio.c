@@ -0,0 +1,123 @@
+/*
+ * The text input/output paths of hdparm which are worth timing on their own
+ * ("make bench"): hex sector dumps, "lba:count" trim ranges, and --Istdin.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <linux/types.h>
+#include <asm/byteorder.h>
+
+#include "hdparm.h"
+
+void dump_sectors (__u16 *w, unsigned int count, int raw, unsigned int sector_bytes)
+{
+	unsigned int i;
+
+	for (i = 0; i < (count*(sector_bytes/2)/8); ++i) {
+		if (raw) {
+			printf("%04x %04x %04x %04x %04x %04x %04x %04x\n",
+				w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7]);
+			w += 8;
+		} else {
+			int word;
+			for (word = 0; word < 8; ++word) {
+				unsigned char *b = (unsigned char *)w++;
+				printf("%02x%02x", b[0], b[1]);
+				putchar(word == 7 ? '\n' : ' ');
+			}
+		}
+	}
+}
+
+/*
+ * (Re)fill the batch from fp, stopping when it is full or at end of input.
+ */
+int read_trim_batch (FILE *fp, __u64 lba_limit, struct trim_batch *b)
+{
+	int err = 0;
+
+	memset(b->data, 0, b->max_ranges * sizeof(*b->data));
+	b->nranges  = 0;
+	b->nsectors = 0;
+	while (!err && b->nranges < b->max_ranges) {
+		__u64 lba, nsect;
+		int args;
+
+		errno = EINVAL;
+		args = fscanf(fp, "%llu:%llu", &lba, &nsect);
+		if (args == EOF) {
+			b->eof = 1;
+			break;
+		}
+		if (args != 2 || nsect > 0xffff || lba >= lba_limit) {
+			if (args == 2)
+				errno = ERANGE;
+			err = errno;
+			fprintf(stderr, "stdin: error at lba:count pair #%d: %s\n", (b->total_ranges + 1), strerror(err));
+		} else {
+			b->nsectors += nsect;
+			b->data[b->nranges++] = __cpu_to_le64((nsect << 48) | lba);
+			++b->total_ranges;
+		}
+	}
+	return err;
+}
+
+int fromhex (__u8 c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return 10 + (c - 'a');
+	if (c >= 'A' && c <= 'F')
+		return 10 + (c - 'A');
+	fprintf(stderr, "bad char: '%c' 0x%02x\n", c, c);
+	exit(EINVAL);
+}
+
+static int ishex (char c)
+{
+	return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+}
+
+void
+identify_from_stdin (void)
+{
+	__u16 sbuf[512];
+	int err, wc = 0;
+
+	do {
+		int digit;
+		int d[4];
+
+		if (ishex(d[digit=0] = getchar())
+		 && ishex(d[++digit] = getchar())
+		 && ishex(d[++digit] = getchar())
+		 && ishex(d[++digit] = getchar())) {
+		 	sbuf[wc] = (fromhex(d[0]) << 12) | (fromhex(d[1]) << 8) | (fromhex(d[2]) << 4) | fromhex(d[3]);
+			++wc;
+		} else if (d[digit] == EOF) {
+			goto eof;
+		} else if (wc == 0) {
+			/* skip over leading lines of cruft */
+			while (d[digit] != '\n') {
+				if (d[digit] == EOF)
+					goto eof;
+				d[digit=0] = getchar();
+			};
+		}
+	} while (wc < 256);
+	putchar('\n');
+	identify(-1, sbuf);
+	return;
+eof:
+	err = errno;
+	fprintf(stderr, "read only %u/256 IDENTIFY words from stdin: %s\n", wc, strerror(err));
+	exit(err);
+}
@@ -0,0 +1,259 @@
+/*
+ * High resolution timing for the benchmark modes (-t, -T, --write-timings, --replay),
+ * and the locked-down buffers they read into.
+ *
+ * Uses clock_gettime(CLOCK_MONOTONIC_RAW), which is immune to NTP slewing,
+ * or optionally (--tsc) the x86 time stamp counter, calibrated against it.
+ * The cost of reading the clock is measured once, and removed from each
+ * interval reported by timer_lap()/timer_stop().
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <linux/types.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "hdparm.h"
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW	4
+#endif
+
+#define HUGEPAGE_BYTES		(2 * 1024 * 1024)
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB		0x40000
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE		14
+#endif
+
+extern int verbose;  /* libhdparm.c */
+
+static int	clock_ready = 0, want_tsc = 0, use_tsc = 0, use_hugepages = 0;
+static clockid_t clock_id = CLOCK_MONOTONIC_RAW;
+static double	overhead_ns = 0;
+
+static __u64 clock_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime(clock_id, &ts);
+	return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static __u64	tsc_base, tsc_base_ns;
+static double	ns_per_tick;
+
+static inline __u64 read_tsc (void)
+{
+	unsigned int lo, hi, aux;
+
+	__asm__ __volatile__("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+	return ((__u64)hi << 32) | lo;
+}
+
+/*
+ * The TSC is only usable as a clock if it runs at a constant rate in all
+ * power states (invariant TSC), and rdtscp is needed to keep it ordered.
+ */
+static int tsc_usable (void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 27)))
+		return 0;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+		return 0;
+	return 1;
+}
+
+static void calibrate_tsc (void)
+{
+	__u64 t0, c0, t1, c1;
+
+	c0 = clock_ns();
+	t0 = read_tsc();
+	usleep(50000);
+	c1 = clock_ns();
+	t1 = read_tsc();
+	ns_per_tick = (double)(c1 - c0) / (double)(t1 - t0);
+	tsc_base    = t1;
+	tsc_base_ns = c1;
+}
+#endif
+
+__u64 timing_now_ns (void)
+{
+	if (!clock_ready)
+		timing_init();
+#if defined(__x86_64__) || defined(__i386__)
+	if (use_tsc)
+		return tsc_base_ns + (__u64)((read_tsc() - tsc_base) * ns_per_tick);
+#endif
+	return clock_ns();
+}
+
+void timing_use_tsc (int enable)
+{
+	want_tsc = enable;
+}
+
+const char *timing_clock_name (void)
+{
+	if (use_tsc)
+		return "TSC";
+	return (clock_id == CLOCK_MONOTONIC_RAW) ? "CLOCK_MONOTONIC_RAW" : "CLOCK_MONOTONIC";
+}
+
+void timing_init (void)
+{
+	struct timespec ts;
+	__u64 t0, t1, best = ~0ULL;
+	int i;
+
+	if (clock_ready)
+		return;
+	if (clock_gettime(clock_id, &ts))
+		clock_id = CLOCK_MONOTONIC;	/* pre-2.6.28 kernels */
+#if defined(__x86_64__) || defined(__i386__)
+	if (want_tsc) {
+		if (tsc_usable()) {
+			calibrate_tsc();
+			use_tsc = 1;
+		} else {
+			fprintf(stderr, "TSC is not invariant on this CPU, using %s\n", timing_clock_name());
+		}
+	}
+#else
+	if (want_tsc)
+		fprintf(stderr, "TSC timing is not available on this architecture, using %s\n", timing_clock_name());
+#endif
+	clock_ready = 1;
+
+	/* the fastest back-to-back reading is the fixed cost of each timestamp */
+	for (i = 0; i < 1000; ++i) {
+		t0 = timing_now_ns();
+		t1 = timing_now_ns();
+		if (t1 - t0 < best)
+			best = t1 - t0;
+	}
+	overhead_ns = best;
+	if (verbose)
+		printf(" timing: using %s, %.0f ns overhead per reading\n", timing_clock_name(), overhead_ns);
+}
+
+void timer_start (struct hdparm_timer *t)
+{
+	t->start_ns = t->lap_ns = timing_now_ns();
+}
+
+static double interval_secs (__u64 from, __u64 to)
+{
+	double ns = (double)(to - from) - overhead_ns;
+
+	return (ns > 0) ? ns / 1000000000.0 : 0;
+}
+
+/*
+ * Seconds since the previous lap (or the start).
+ */
+double timer_lap (struct hdparm_timer *t)
+{
+	__u64 now = timing_now_ns();
+	double secs = interval_secs(t->lap_ns, now);
+
+	t->lap_ns = now;
+	return secs;
+}
+
+/*
+ * Seconds since timer_start(), without disturbing the lap time.
+ */
+double timer_stop (struct hdparm_timer *t)
+{
+	return interval_secs(t->start_ns, timing_now_ns());
+}
+
+void timing_use_hugepages (int enable)
+{
+	use_hugepages = enable;
+}
+
+int read_big_block (int fd, char *buf)
+{
+	int i, rc;
+	if ((rc = read(fd, buf, TIMING_BUF_BYTES)) != TIMING_BUF_BYTES) {
+		if (rc) {
+			if (rc == -1)
+				perror("read() failed");
+			else
+				fprintf(stderr, "read(%u) returned %u bytes\n", TIMING_BUF_BYTES, rc);
+		} else {
+			fputs ("read() hit EOF - device too small\n", stderr);
+		}
+		return EIO;
+	}
+	/* access all sectors of buf to ensure the read fully completed */
+	for (i = 0; i < TIMING_BUF_BYTES; i += 512)
+		buf[i] &= 1;
+	return 0;
+}
+
+/*
+ * Allocate a timing buffer and lock it in memory, but leave the rest of
+ * the process alone: this is all that libhdparm does for its callers.
+ */
+void *alloc_timing_buf (unsigned int len)
+{
+	unsigned int i;
+	__u8 *buf = MAP_FAILED;
+
+	/* hugetlbfs mappings can only be unmapped in whole huge pages */
+	if (use_hugepages && (len % HUGEPAGE_BYTES) == 0) {
+		buf = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGETLB, -1, 0);
+		if (buf == MAP_FAILED && verbose)
+			perror("mmap(MAP_HUGETLB) failed, trying transparent hugepages");
+	}
+	if (buf == MAP_FAILED) {
+		buf = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+		if (buf == MAP_FAILED) {
+			perror("could not allocate timing buf");
+			return NULL;
+		}
+		if (use_hugepages)
+			madvise(buf, len, MADV_HUGEPAGE);
+	}
+	for (i = 0; i < len; i += 4096)
+		buf[i] = 0; /* guarantee memory is present/assigned */
+	if (-1 == mlock(buf, len)) {
+		perror("mlock() failed on timing buf");
+		munmap(buf, len);
+		return NULL;
+	}
+	return buf;
+}
+
+void *prepare_timing_buf (unsigned int len)
+{
+	__u8 *buf = alloc_timing_buf(len);
+
+	if (!buf)
+		return NULL;
+	mlockall(MCL_CURRENT|MCL_FUTURE); // don't care if this fails on low-memory machines
+	sync();
+
+	/* give time for I/O to settle */
+	sleep(3);
+	return buf;
+}
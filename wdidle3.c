@@ -11,7 +11,7 @@
 #include "sgio.h"
 #include "hdparm.h"
 
-extern int verbose;  /* hdparm.c */
+extern int verbose;  /* libhdparm.c */
 
 /*
  * The Western Digital (WD) "Green" drive IDLE3 timeout value is 8-bits.
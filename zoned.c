@@ -0,0 +1,398 @@
+/*
+ * Zoned block devices (ZBC/ZAC SMR drives, ZNS namespaces, null_blk zoned=1):
+ * a compact zone table with fill statistics (--zones), and explicit zone
+ * management (--zone-open/--zone-close/--zone-finish/--zone-reset).
+ *
+ * Everything goes through the kernel's BLKREPORTZONE and BLK*ZONE ioctls,
+ * rather than REPORT ZONES EXT etc. as pass-through commands, so that it
+ * works for any zoned transport, and the block layer's cached write
+ * pointers stay in step with the drive.
+ *
+ * You may use/distribute this freely, under the terms of either
+ * (your choice) the GNU General Public License version 2,
+ * or a BSD style license.
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/fs.h>
+
+#include "hdparm.h"
+
+extern int verbose;  /* libhdparm.c */
+
+#define ZONE_REPORT_BATCH	4096	/* zones per BLKREPORTZONE */
+#define ZONE_FILL_BUCKETS	10
+#define ZONE_BANDS		10	/* for the write pointer distribution */
+
+static const char *zone_cond_name (int cond)
+{
+	switch (cond) {
+		case HD_ZONE_COND_NOT_WP:	return "not-wp";
+		case HD_ZONE_COND_EMPTY:	return "empty";
+		case HD_ZONE_COND_IMP_OPEN:	return "imp-open";
+		case HD_ZONE_COND_EXP_OPEN:	return "exp-open";
+		case HD_ZONE_COND_CLOSED:	return "closed";
+		case HD_ZONE_COND_READONLY:	return "read-only";
+		case HD_ZONE_COND_FULL:	return "full";
+		case HD_ZONE_COND_OFFLINE:	return "offline";
+	}
+	return "unknown";
+}
+
+const char *zone_type_name (int type)
+{
+	switch (type) {
+		case HD_ZONE_TYPE_CONVENTIONAL:	return "conv";
+		case HD_ZONE_TYPE_SEQWRITE_REQ:	return "seq-req";
+		case HD_ZONE_TYPE_SEQWRITE_PREF:	return "seq-pref";
+	}
+	return "unknown";
+}
+
+/*
+ * Open and closed zones are the partially written ones,
+ * with a write pointer somewhere inside them.
+ */
+static int zone_is_partial (const struct hd_zone *z)
+{
+	return z->cond == HD_ZONE_COND_IMP_OPEN || z->cond == HD_ZONE_COND_EXP_OPEN
+	    || z->cond == HD_ZONE_COND_CLOSED;
+}
+
+/*
+ * Sectors (of 512 bytes) from the start of the zone which hold data,
+ * and so can be read: reads beyond the write pointer fail on host-managed drives.
+ */
+__u64 zone_readable_sectors (const struct hd_zone *z)
+{
+	if (z->type == HD_ZONE_TYPE_CONVENTIONAL)
+		return z->capacity;
+	switch (z->cond) {
+		case HD_ZONE_COND_FULL:
+		case HD_ZONE_COND_READONLY:
+			return z->capacity;
+		case HD_ZONE_COND_IMP_OPEN:
+		case HD_ZONE_COND_EXP_OPEN:
+		case HD_ZONE_COND_CLOSED:
+			return z->wp - z->start;
+	}
+	return 0;
+}
+
+static int not_zoned (void)
+{
+	fprintf(stderr, " not a zoned block device\n");
+	return EOPNOTSUPP;
+}
+
+/*
+ * All zones of the device, in LBA order, into a malloc'd array.
+ * Zone capacity is filled in (as the zone length) by kernels which predate it.
+ */
+int zone_report (int fd, struct hd_zone **zonesp, unsigned int *nzones)
+{
+	struct hd_zone_report *rep;
+	struct hd_zone *zones;
+	unsigned int n = 0, i;
+	__u32 nr = 0;
+	__u64 sector = 0;
+	int err = 0;
+
+	*zonesp = NULL;
+	*nzones = 0;
+	if (emu_is_emulated(fd) || ioctl(fd, BLKGETNRZONES, &nr) || !nr)
+		return not_zoned();
+	zones = malloc(nr * sizeof(*zones));
+	rep = malloc(sizeof(*rep) + ZONE_REPORT_BATCH * sizeof(*zones));
+	if (!zones || !rep) {
+		perror("malloc()");
+		free(zones);
+		free(rep);
+		return ENOMEM;
+	}
+	while (n < nr) {
+		memset(rep, 0, sizeof(*rep));
+		rep->sector   = sector;
+		rep->nr_zones = (nr - n < ZONE_REPORT_BATCH) ? nr - n : ZONE_REPORT_BATCH;
+		if (ioctl(fd, BLKREPORTZONE, rep)) {
+			err = errno;
+			perror(" BLKREPORTZONE failed");
+			break;
+		}
+		if (!rep->nr_zones)
+			break;
+		for (i = 0; i < rep->nr_zones; ++i) {
+			zones[n + i] = rep->zones[i];
+			if (!(rep->flags & HD_ZONE_REP_CAPACITY))
+				zones[n + i].capacity = rep->zones[i].len;
+		}
+		n += rep->nr_zones;
+		sector = zones[n - 1].start + zones[n - 1].len;
+	}
+	free(rep);
+	if (err) {
+		free(zones);
+		return err;
+	}
+	*zonesp = zones;
+	*nzones = n;
+	return 0;
+}
+
+static unsigned int logical_sector_bytes (int fd)
+{
+	int bytes = 0;
+
+	if (ioctl(fd, BLKSSZGET, &bytes) || bytes < 512)
+		bytes = 512;
+	return bytes;
+}
+
+static const char *format_size (char *s, __u64 bytes)
+{
+	static const char *units[] = {"kB", "MB", "GB", "TB", "PB"};
+	double v = bytes / 1024.0;
+	unsigned int u = 0;
+
+	while (v >= 1024 && u + 1 < sizeof(units) / sizeof(units[0])) {
+		v /= 1024;
+		++u;
+	}
+	sprintf(s, "%.1f %s", v, units[u]);
+	return s;
+}
+
+/*
+ * Consecutive zones which differ only in where they start share a line,
+ * unless they are partially written, where the write pointer matters.
+ */
+static int same_zone_row (const struct hd_zone *a, const struct hd_zone *b)
+{
+	return a->type == b->type && a->cond == b->cond && a->len == b->len
+	    && a->capacity == b->capacity && !zone_is_partial(a);
+}
+
+static void print_zone_table (const struct hd_zone *zones, unsigned int nzones, unsigned int lba_sectors)
+{
+	unsigned int i, j;
+
+	printf("\t%-16s %14s %10s  %-9s %-10s %14s %6s\n", "zones", "start LBA", "length", "type", "condition", "write pointer", "used");
+	for (i = 0; i < nzones; i = j) {
+		const struct hd_zone *z = &zones[i];
+		char range[32], wp[24] = "-", used[16] = "-";
+
+		for (j = i + 1; j < nzones && same_zone_row(z, &zones[j]); ++j);
+		if (j - i > 1)
+			sprintf(range, "%u-%u", i, j - 1);
+		else
+			sprintf(range, "%u", i);
+		if (z->type != HD_ZONE_TYPE_CONVENTIONAL && zone_is_partial(z)) {
+			sprintf(wp, "%llu", z->wp / lba_sectors);
+			sprintf(used, "%.1f%%", (z->wp - z->start) * 100.0 / z->capacity);
+		}
+		printf("\t%-16s %14llu %10llu  %-9s %-10s %14s %6s\n", range, z->start / lba_sectors,
+			z->len / lba_sectors, zone_type_name(z->type), zone_cond_name(z->cond), wp, used);
+	}
+}
+
+/*
+ * Zone types, conditions, how full the sequential zones are,
+ * and where on the device the written data lies: what is needed
+ * to decide which zones are worth compacting.
+ */
+static void print_zone_summary (int fd, const struct hd_zone *zones, unsigned int nzones)
+{
+	unsigned int types[4] = {0,}, conds[16] = {0,}, fill[ZONE_FILL_BUCKETS] = {0,};
+	__u64 band_written[ZONE_BANDS] = {0,}, band_capacity[ZONE_BANDS] = {0,};
+	__u64 seq_capacity = 0, seq_written = 0, partial_written = 0, partial_free = 0, total = 0;
+	unsigned int npartial = 0, i, max_open = 0, max_active = 0;
+	char model[32] = "", s1[32], s2[32];
+
+	for (i = 0; i < nzones; ++i) {
+		const struct hd_zone *z = &zones[i];
+		unsigned int band = (__u64)i * ZONE_BANDS / nzones;
+
+		total += z->len;
+		types[z->type & 3]++;
+		conds[z->cond & 15]++;
+		if (z->type == HD_ZONE_TYPE_CONVENTIONAL)
+			continue;
+		seq_capacity += z->capacity;
+		seq_written  += zone_readable_sectors(z);
+		band_capacity[band] += z->capacity;
+		band_written[band]  += zone_readable_sectors(z);
+		if (zone_is_partial(z)) {
+			__u64 used = z->wp - z->start;
+			unsigned int bucket = used * ZONE_FILL_BUCKETS / z->capacity;
+			++npartial;
+			partial_written += used;
+			partial_free    += z->capacity - used;
+			fill[bucket < ZONE_FILL_BUCKETS ? bucket : ZONE_FILL_BUCKETS - 1]++;
+		}
+	}
+
+	if (sysfs_get_attr(fd, "queue/zoned", "%31s", model, NULL, 0))
+		strcpy(model, "zoned");
+	printf(" summary: %u zones of %s, %s, %s total\n", nzones, format_size(s1, zones[0].len * 512), model,
+		format_size(s2, total * 512));
+	printf("\ttypes:      %u conventional, %u sequential-write-required, %u sequential-write-preferred\n",
+		types[HD_ZONE_TYPE_CONVENTIONAL], types[HD_ZONE_TYPE_SEQWRITE_REQ], types[HD_ZONE_TYPE_SEQWRITE_PREF]);
+	printf("\tconditions:");
+	for (i = 0; i < 16; ++i) {
+		if (conds[i])
+			printf(" %u %s", conds[i], zone_cond_name(i));
+	}
+	putchar('\n');
+	if (0 == sysfs_get_attr(fd, "queue/max_open_zones", "%u", &max_open, NULL, 0)
+	 && 0 == sysfs_get_attr(fd, "queue/max_active_zones", "%u", &max_active, NULL, 0))
+		printf("\tlimits:     max open zones %u, max active zones %u (0 = no limit)\n", max_open, max_active);
+	if (!seq_capacity)
+		return;
+	printf("\twritten:    %s of %s in sequential zones (%.1f%%)\n", format_size(s1, seq_written * 512),
+		format_size(s2, seq_capacity * 512), seq_written * 100.0 / seq_capacity);
+	printf("\tpartial:    %u zones, %s written, %s left behind their write pointers\n", npartial,
+		format_size(s1, partial_written * 512), format_size(s2, partial_free * 512));
+	if (npartial) {
+		printf("\tfill:      ");
+		for (i = 0; i < ZONE_FILL_BUCKETS; ++i)
+			printf(" %u-%u%%:%u", i * 100 / ZONE_FILL_BUCKETS, (i + 1) * 100 / ZONE_FILL_BUCKETS, fill[i]);
+		putchar('\n');
+	}
+	printf("\tby tenth:  ");
+	for (i = 0; i < ZONE_BANDS; ++i) {
+		if (band_capacity[i])
+			printf(" %3.0f%%", band_written[i] * 100.0 / band_capacity[i]);
+		else
+			printf("    -");
+	}
+	printf("  (sequential zones written, from the start of the device)\n");
+}
+
+int do_zone_report (int fd)
+{
+	struct hd_zone *zones;
+	unsigned int nzones;
+	int err;
+
+	err = zone_report(fd, &zones, &nzones);
+	if (err)
+		return err;
+	print_zone_table(zones, nzones, logical_sector_bytes(fd) / 512);
+	print_zone_summary(fd, zones, nzones);
+	free(zones);
+	return 0;
+}
+
+static void print_zone_after (int fd, __u64 sector, unsigned int lba_sectors)
+{
+	struct {
+		struct hd_zone_report	rep;
+		struct hd_zone		zone;
+	} r;
+
+	memset(&r, 0, sizeof(r));
+	r.rep.sector   = sector;
+	r.rep.nr_zones = 1;
+	if (ioctl(fd, BLKREPORTZONE, &r) || r.rep.nr_zones != 1)
+		return;
+	printf(" zone at LBA %llu is now %s", r.zone.start / lba_sectors, zone_cond_name(r.zone.cond));
+	if (r.zone.type != HD_ZONE_TYPE_CONVENTIONAL && zone_is_partial(&r.zone))
+		printf(", write pointer at LBA %llu", r.zone.wp / lba_sectors);
+	putchar('\n');
+}
+
+/*
+ * Open, close, finish or reset the zone holding lba, or with "all":
+ * reset every zone, or close/finish every partially written one.
+ * The kernel only accepts these on a file opened for writing.
+ */
+int do_zone_mgmt (int fd, const char *devname, int op, __u64 lba, int all)
+{
+	static const struct {
+		unsigned long	cmd;
+		const char	*name;
+	} ops[] = {
+		[ZONE_OPEN]	= {BLKOPENZONE,   "open"},
+		[ZONE_CLOSE]	= {BLKCLOSEZONE,  "close"},
+		[ZONE_FINISH]	= {BLKFINISHZONE, "finish"},
+		[ZONE_RESET]	= {BLKRESETZONE,  "reset"},
+	};
+	struct hd_zone_range range;
+	struct hd_zone *zones = NULL;
+	unsigned int lba_sectors = logical_sector_bytes(fd) / 512, nzones = 0, i, n = 0;
+	__u32 zone_sectors = 0;
+	__u64 dev_bytes, sector;
+	int wfd, err = 0;
+
+	if (emu_is_emulated(fd) || ioctl(fd, BLKGETZONESZ, &zone_sectors) || !zone_sectors)
+		return not_zoned();
+	if (ioctl(fd, BLKGETSIZE64, &dev_bytes)) {
+		err = errno;
+		perror(" BLKGETSIZE64 failed");
+		return err;
+	}
+	sector = lba * lba_sectors;
+	if (!all && sector >= dev_bytes / 512) {
+		fprintf(stderr, " LBA %llu is beyond the end of the device\n", lba);
+		return EINVAL;
+	}
+	if (all && op != ZONE_RESET && (err = zone_report(fd, &zones, &nzones)))
+		return err;
+	wfd = open(devname, O_WRONLY);
+	if (wfd == -1) {
+		err = errno;
+		perror(devname);
+		free(zones);
+		return err;
+	}
+
+	if (all && op == ZONE_RESET) {
+		/* a single range covering the device becomes one RESET ALL */
+		range.sector     = 0;
+		range.nr_sectors = dev_bytes / 512;
+		printf(" resetting all zones\n");
+		if (ioctl(wfd, ops[op].cmd, &range)) {
+			err = errno;
+			perror(" BLKRESETZONE failed");
+		}
+	} else if (all) {
+		for (i = 0; i < nzones && !err; ++i) {
+			if (zones[i].type == HD_ZONE_TYPE_CONVENTIONAL || !zone_is_partial(&zones[i]))
+				continue;
+			if (op == ZONE_CLOSE && zones[i].cond == HD_ZONE_COND_CLOSED)
+				continue;
+			range.sector     = zones[i].start;
+			range.nr_sectors = zones[i].len;
+			if (ioctl(wfd, ops[op].cmd, &range)) {
+				err = errno;
+				fprintf(stderr, " zone %u:", i);
+				perror(" zone management ioctl failed");
+			} else {
+				++n;
+			}
+		}
+		printf(" %s: %u partially written zone(s)\n", ops[op].name, n);
+	} else {
+		range.sector     = sector - (sector % zone_sectors);
+		range.nr_sectors = zone_sectors;
+		if (range.sector + range.nr_sectors > dev_bytes / 512)
+			range.nr_sectors = dev_bytes / 512 - range.sector;	/* a smaller last zone */
+		printf(" %s zone at LBA %llu (%llu sectors)\n", ops[op].name,
+			range.sector / lba_sectors, range.nr_sectors / lba_sectors);
+		if (ioctl(wfd, ops[op].cmd, &range)) {
+			err = errno;
+			perror(" zone management ioctl failed");
+		} else {
+			print_zone_after(fd, range.sector, lba_sectors);
+		}
+	}
+	close(wfd);
+	free(zones);
+	return err;
+}